@@ -0,0 +1,182 @@
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "atlas.h"
+
+static_assert(!(MAP_X % ATLAS_THUMB_X) && !(MAP_Y % ATLAS_THUMB_Y),
+              "a thumbnail cell must cover a whole block of the map");
+static_assert((1 << (ATLAS_LEVELS - 1)) < WORLD_SIZE,
+              "the top level of the atlas must have more than one block");
+
+/* Level 0 is a summary per map, with its thumbnail.  The levels above *
+ * count terrain over every map generated in their block, so that the  *
+ * most common terrain of a block is exact rather than a vote among    *
+ * the blocks below it.                                                */
+typedef struct atlas_map {
+  terrain_type_t top;
+  uint8_t flags;
+  /* Index into atlas_thumbs, plus one; zero if not generated. */
+  uint32_t thumb;
+} atlas_map_t;
+
+typedef struct atlas_node {
+  uint32_t count[num_terrain_types];
+  uint32_t maps;
+  terrain_type_t top;
+  uint8_t flags;
+} atlas_node_t;
+
+static std::vector<atlas_map_t> atlas_maps;
+/* atlas_nodes[0] is unused; level 0 is atlas_maps. */
+static std::vector<atlas_node_t> atlas_nodes[ATLAS_LEVELS];
+static std::vector<atlas_thumb_t> atlas_thumbs;
+
+int atlas_side(int level)
+{
+  return (WORLD_SIZE + (1 << level) - 1) >> level;
+}
+
+void atlas_init()
+{
+  atlas_map_t none = { ter_debug, 0, 0 };
+  int k;
+
+  atlas_maps.assign(WORLD_SIZE * WORLD_SIZE, none);
+  for (k = 1; k < ATLAS_LEVELS; k++) {
+    atlas_nodes[k].assign(atlas_side(k) * atlas_side(k), atlas_node_t());
+  }
+  atlas_thumbs.clear();
+}
+
+void atlas_delete()
+{
+  int k;
+
+  std::vector<atlas_map_t>().swap(atlas_maps);
+  for (k = 1; k < ATLAS_LEVELS; k++) {
+    std::vector<atlas_node_t>().swap(atlas_nodes[k]);
+  }
+  std::vector<atlas_thumb_t>().swap(atlas_thumbs);
+}
+
+static terrain_type_t atlas_top(const uint32_t count[num_terrain_types])
+{
+  int t, top;
+
+  for (top = 0, t = 1; t < num_terrain_types; t++) {
+    if (count[t] > count[top]) {
+      top = t;
+    }
+  }
+
+  return (terrain_type_t) top;
+}
+
+/* Flags for a cell's terrain, or zero for terrain that is counted. */
+static uint8_t atlas_flag(terrain_type_t t)
+{
+  switch (t) {
+  case ter_path:
+  case ter_bailey:
+  case ter_gate:
+    return ATLAS_ROAD;
+  case ter_mart:
+    return ATLAS_MART;
+  case ter_center:
+    return ATLAS_CENTER;
+  default:
+    return 0;
+  }
+}
+
+void atlas_add(const map *m, int x, int y)
+{
+  uint32_t count[num_terrain_types], cell[num_terrain_types];
+  atlas_thumb_t thumb;
+  atlas_map_t *a;
+  atlas_node_t *n;
+  uint8_t flags, f;
+  int tx, ty, cx, cy, mx, my, k, t;
+
+  memset(count, 0, sizeof (count));
+  flags = 0;
+  for (ty = 0; ty < ATLAS_THUMB_Y; ty++) {
+    for (tx = 0; tx < ATLAS_THUMB_X; tx++) {
+      memset(cell, 0, sizeof (cell));
+      f = 0;
+      for (cy = 0; cy < MAP_Y / ATLAS_THUMB_Y; cy++) {
+        for (cx = 0; cx < MAP_X / ATLAS_THUMB_X; cx++) {
+          my = ty * (MAP_Y / ATLAS_THUMB_Y) + cy;
+          mx = tx * (MAP_X / ATLAS_THUMB_X) + cx;
+          if (atlas_flag(m->map[my][mx])) {
+            f |= atlas_flag(m->map[my][mx]);
+          } else if (mx && my && mx != MAP_X - 1 && my != MAP_Y - 1) {
+            cell[m->map[my][mx]]++;
+          }
+        }
+      }
+      if (f & ATLAS_MART) {
+        thumb.t[ty][tx] = ter_mart;
+      } else if (f & ATLAS_CENTER) {
+        thumb.t[ty][tx] = ter_center;
+      } else if (f & ATLAS_ROAD) {
+        thumb.t[ty][tx] = ter_path;
+      } else {
+        thumb.t[ty][tx] = atlas_top(cell);
+      }
+      for (t = 0; t < num_terrain_types; t++) {
+        count[t] += cell[t];
+      }
+      flags |= f;
+    }
+  }
+
+  a = &atlas_maps[y * WORLD_SIZE + x];
+  a->top = atlas_top(count);
+  a->flags = flags;
+  atlas_thumbs.push_back(thumb);
+  a->thumb = atlas_thumbs.size();
+
+  for (k = 1; k < ATLAS_LEVELS; k++) {
+    n = &atlas_nodes[k][(y >> k) * atlas_side(k) + (x >> k)];
+    for (t = 0; t < num_terrain_types; t++) {
+      n->count[t] += count[t];
+    }
+    n->maps++;
+    n->flags |= flags;
+    n->top = atlas_top(n->count);
+  }
+}
+
+uint32_t atlas_block(int level, int x, int y,
+                     terrain_type_t *top, uint8_t *flags)
+{
+  const atlas_map_t *a;
+  const atlas_node_t *n;
+
+  if (!level) {
+    a = &atlas_maps[y * WORLD_SIZE + x];
+    if (!a->thumb) {
+      return 0;
+    }
+    *top = a->top;
+    *flags = a->flags;
+    return 1;
+  }
+
+  n = &atlas_nodes[level][y * atlas_side(level) + x];
+  if (n->maps) {
+    *top = n->top;
+    *flags = n->flags;
+  }
+
+  return n->maps;
+}
+
+const atlas_thumb_t *atlas_thumb(int x, int y)
+{
+  const atlas_map_t *a = &atlas_maps[y * WORLD_SIZE + x];
+
+  return a->thumb ? &atlas_thumbs[a->thumb - 1] : NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef ATLAS_H
+# define ATLAS_H
+
+# include <stdint.h>
+
+# include "curse.h"
+
+/* Summaries of every map generated so far, for the world map view.     *
+ * Each map is summarized once, when it is generated: its most common   *
+ * terrain, whether it has roads and buildings, and a thumbnail.  Those *
+ * go into a mipmap pyramid, where level k has one summary for every    *
+ * 2^k by 2^k block of maps, kept up to date as each map is added, so   *
+ * any block at any level is one lookup whatever the size of the world. *
+ *                                                                      *
+ * The most common terrain leaves out roads, gates and buildings, which *
+ * are flags instead, and the boulders around the edge of every map.    */
+# define ATLAS_LEVELS  5
+
+/* A thumbnail has a cell for every ATLAS_THUMB_X by ATLAS_THUMB_Y *
+ * block of the map: a building if there is one in the block, else *
+ * a road if there is one, else the most common terrain.            */
+# define ATLAS_THUMB_X 10
+# define ATLAS_THUMB_Y 3
+
+# define ATLAS_ROAD    0x01
+# define ATLAS_MART    0x02
+# define ATLAS_CENTER  0x04
+
+typedef struct atlas_thumb {
+  terrain_type_t t[ATLAS_THUMB_Y][ATLAS_THUMB_X];
+} atlas_thumb_t;
+
+/* Empties the atlas; call before generating the first map. */
+void atlas_init();
+void atlas_delete();
+/* Summarizes m, the newly generated map at world index (x, y). */
+void atlas_add(const map *m, int x, int y);
+
+/* Blocks across (and down) level k. */
+int atlas_side(int level);
+/* The number of maps generated in block (x, y) of level k.  Unless    *
+ * that is zero, their most common terrain goes in *top and the union *
+ * of their flags in *flags.                                           */
+uint32_t atlas_block(int level, int x, int y,
+                     terrain_type_t *top, uint8_t *flags);
+/* The thumbnail of the map at world index (x, y), or NULL if that map *
+ * has not been generated.                                             */
+const atlas_thumb_t *atlas_thumb(int x, int y);
+
+#endif
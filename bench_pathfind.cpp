@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "curse.h"
+#include "mapgen.h"
+#include "path.h"
+#include "pqueue.h"
+
+/* Headless pathfinding benchmark.  Builds a fixed, seeded corpus of maps *
+ * covering every geography type, runs every distance-field backend and  *
+ * every road router over each map, and prints one CSV row per           *
+ * (kind, backend, map) on stdout.  Links against the generation and     *
+ * pathfinding code only; no world, no terminal, no database.            */
+
+#define DEFAULT_ITERATIONS 100
+#define DEFAULT_MAPS       8
+#define DEFAULT_SEED       1
+
+static const char *geo_type_name[num_geo_types] = {
+  "wild",
+  "plain",
+  "wet",
+  "woods",
+  "cliffs",
+  "mountain",
+  "town",
+};
+
+typedef struct bench_field {
+  const char *name;
+  dist_map_t d;
+} bench_field_t;
+
+static const bench_field_t bench_field[num_dist_maps] = {
+  { "hiker", dist_hiker },
+  { "rival", dist_rival },
+};
+
+/* A generated map, the terrain and heights it had before the roads went *
+ * in (so road routing can be rerun from the same start), and the cell   *
+ * the distance fields are computed from.                                */
+typedef struct bench_map {
+  map m;
+  terrain_type_t bare[MAP_Y][MAP_X];
+  uint8_t bare_height[MAP_Y][MAP_X];
+  pair_t from;
+} bench_map_t;
+
+static uint64_t now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Mirrors the fresh-map path through new_map(), minus the world. */
+static void bench_generate(bench_map_t *b, geo_type_t g, uint32_t seed)
+{
+  map *m = &b->m;
+  int8_t n, s, e, w;
+
+  srand(seed);
+
+  m->geotype = g;
+  smooth_height(m);
+  n = 3 + rand() % (MAP_X - 6);
+  s = 3 + rand() % (MAP_X - 6);
+  w = 3 + rand() % (MAP_Y - 6);
+  e = 3 + rand() % (MAP_Y - 6);
+  map_terrain(m, n, s, e, w);
+  place_boulders(m);
+  place_trees(m);
+  memcpy(b->bare, m->map, sizeof (b->bare));
+  memcpy(b->bare_height, m->height, sizeof (b->bare_height));
+  build_paths(m);
+  place_pokemart(m);
+  place_center(m);
+  cost_grid(m, move_cost[char_hiker], m->cost[dist_hiker]);
+  cost_grid(m, move_cost[char_rival], m->cost[dist_rival]);
+
+  do {
+    b->from[dim_x] = rand() % (MAP_X - 2) + 1;
+    b->from[dim_y] = rand() % (MAP_Y - 2) + 1;
+  } while (move_cost[char_pc][m->map[b->from[dim_y]][b->from[dim_x]]] ==
+           DIJKSTRA_PATH_MAX);
+}
+
+static void bench_row(const char *kind, const char *backend, bench_map_t *b,
+                      int index, int calls, uint64_t ns)
+{
+  printf("%s,%s,%s,%d,%d,%.1f,%.1f,%.1f\n",
+         kind, backend, geo_type_name[b->m.geotype], index, calls,
+         (double) ns / calls,
+         (double) path_stats.expanded / calls,
+         (double) path_stats.heap_ops / calls);
+}
+
+/* Returns the number of backends that disagreed with Dijkstra. */
+static int bench_fields(bench_map_t *b, int index, int iterations)
+{
+  static uint16_t reference[MAP_Y][MAP_X], dist[MAP_Y][MAP_X];
+  uint64_t start, ns;
+  int f, i, bad;
+  pathfind_backend_t p;
+
+  bad = 0;
+  for (f = 0; f < num_dist_maps; f++) {
+    dijkstra_field(b->m.cost[bench_field[f].d], b->from, reference);
+    for (p = pathfind_dijkstra;
+         p < num_pathfind_backends;
+         p = (pathfind_backend_t) (p + 1)) {
+      pathfind_backend = p;
+      memset(&path_stats, 0, sizeof (path_stats));
+      start = now_ns();
+      for (i = 0; i < iterations; i++) {
+        dist_field(b->m.cost[bench_field[f].d], b->from, dist);
+      }
+      ns = now_ns() - start;
+      bench_row(bench_field[f].name, pathfind_backend_name[p],
+                b, index, iterations, ns);
+      if (memcmp(dist, reference, sizeof (dist))) {
+        fprintf(stderr, "%s field from %s disagrees with dijkstra "
+                "on %s map %d\n", bench_field[f].name,
+                pathfind_backend_name[p], geo_type_name[b->m.geotype], index);
+        bad++;
+      }
+    }
+  }
+
+  return bad;
+}
+
+/* Routes west gate to east gate from the bare terrain every time. */
+static void bench_roads(bench_map_t *b, int index, int iterations)
+{
+  uint64_t start, ns;
+  pair_t from, to;
+  road_backend_t r;
+  int i;
+
+  from[dim_x] = 1;
+  from[dim_y] = b->m.w;
+  to[dim_x] = MAP_X - 2;
+  to[dim_y] = b->m.e;
+
+  for (r = road_dijkstra;
+       r < num_road_backends;
+       r = (road_backend_t) (r + 1)) {
+    road_backend = r;
+    memset(&path_stats, 0, sizeof (path_stats));
+    ns = 0;
+    for (i = 0; i < iterations; i++) {
+      memcpy(b->m.map, b->bare, sizeof (b->bare));
+      memcpy(b->m.height, b->bare_height, sizeof (b->bare_height));
+      start = now_ns();
+      dijkstra_path(&b->m, from, to);
+      ns += now_ns() - start;
+    }
+    bench_row("road", road_backend_name[r], b, index, iterations, ns);
+  }
+}
+
+/* The turn queue's workload: a map's worth of characters, each popped *
+ * and pushed back with a later turn, which is all game_loop() does.    *
+ * The actors stand in for characters, ordered the same way.           */
+#define BENCH_ACTORS 16
+
+typedef struct bench_actor {
+  int next_turn;
+  int seq_num;
+} bench_actor_t;
+
+struct bench_actor_less {
+  bool operator()(const bench_actor_t *key, const bench_actor_t *with) const
+  {
+    return (key->next_turn < with->next_turn ||
+            (key->next_turn == with->next_turn &&
+             key->seq_num < with->seq_num));
+  }
+
+  static int32_t key(const bench_actor_t *a)
+  {
+    return a->next_turn;
+  }
+};
+
+template <class Q>
+static void bench_turn(const char *name, int iterations, uint32_t seed)
+{
+  bench_actor_t actor[BENCH_ACTORS], *a;
+  uint64_t start, ns;
+  int i, calls;
+  Q q;
+
+  srand(seed);
+  for (i = 0; i < BENCH_ACTORS; i++) {
+    actor[i].next_turn = 0;
+    actor[i].seq_num = i;
+    q.push(&actor[i]);
+  }
+
+  calls = iterations * 1000;
+  start = now_ns();
+  for (i = 0; i < calls; i++) {
+    a = q.pop();
+    a->next_turn += 10 + rand() % 11;
+    q.push(a);
+  }
+  ns = now_ns() - start;
+
+  printf("turn,%s,none,0,%d,%.1f,%.1f,%.1f\n",
+         name, calls, (double) ns / calls, 0.0, 2.0);
+}
+
+static void usage(char *s)
+{
+  fprintf(stderr, "Usage: %s [-n|--iterations <n>] [-m|--maps <n>] "
+          "[-s|--seed <seed>]\n", s);
+
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  bench_map_t *corpus;
+  uint32_t seed;
+  int iterations, maps;
+  int long_arg;
+  int i, g, bad;
+
+  iterations = DEFAULT_ITERATIONS;
+  maps = DEFAULT_MAPS;
+  seed = DEFAULT_SEED;
+
+  for (i = 1, long_arg = 0; i < argc; i++, long_arg = 0) {
+    if (argv[i][0] != '-') {
+      usage(argv[0]);
+    }
+    if (argv[i][1] == '-') {
+      argv[i]++;
+      long_arg = 1;
+    }
+    switch (argv[i][1]) {
+    case 'n':
+      if ((!long_arg && argv[i][2]) ||
+          (long_arg && strcmp(argv[i], "-iterations")) ||
+          argc < ++i + 1 ||
+          sscanf(argv[i], "%d", &iterations) != 1 || iterations < 1) {
+        usage(argv[0]);
+      }
+      break;
+    case 'm':
+      if ((!long_arg && argv[i][2]) ||
+          (long_arg && strcmp(argv[i], "-maps")) ||
+          argc < ++i + 1 ||
+          sscanf(argv[i], "%d", &maps) != 1 || maps < 1) {
+        usage(argv[0]);
+      }
+      break;
+    case 's':
+      if ((!long_arg && argv[i][2]) ||
+          (long_arg && strcmp(argv[i], "-seed")) ||
+          argc < ++i + 1 ||
+          sscanf(argv[i], "%u", &seed) != 1) {
+        usage(argv[0]);
+      }
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  corpus = new bench_map_t[num_geo_types * maps];
+  for (g = 0; g < num_geo_types; g++) {
+    for (i = 0; i < maps; i++) {
+      bench_generate(&corpus[g * maps + i], (geo_type_t) g,
+                     seed + g * maps + i);
+    }
+  }
+
+  printf("kind,backend,geotype,map,calls,ns_per_call,"
+         "expanded_per_call,heap_ops_per_call\n");
+
+  bad = 0;
+  for (g = 0; g < num_geo_types; g++) {
+    for (i = 0; i < maps; i++) {
+      bad += bench_fields(&corpus[g * maps + i], i, iterations);
+      bench_roads(&corpus[g * maps + i], i, iterations);
+    }
+  }
+
+  delete [] corpus;
+
+  bench_turn<pq_fibonacci<bench_actor_t *, bench_actor_less> >("dijkstra",
+                                                               iterations,
+                                                               seed);
+  bench_turn<pq_binary<bench_actor_t *, bench_actor_less> >("binary",
+                                                            iterations, seed);
+  bench_turn<pq_4ary<bench_actor_t *, bench_actor_less> >("4ary",
+                                                          iterations, seed);
+  bench_turn<pq_pairing<bench_actor_t *, bench_actor_less> >("pairing",
+                                                             iterations,
+                                                             seed);
+  bench_turn<pq_wheel<bench_actor_t *, bench_actor_less> >("wheel",
+                                                           iterations, seed);
+
+  return !!bad;
+}
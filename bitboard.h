@@ -0,0 +1,190 @@
+#ifndef BITBOARD_H
+# define BITBOARD_H
+
+# include <stdint.h>
+# include <string.h>
+
+/* One bit per cell of an X by Y grid, row-major, packed into 64-bit words; *
+ * an 80x21 map is 1,680 bits, or 27 words.  Masks over a whole map are     *
+ * combined a word at a time, and shifting a whole board by one cell is a   *
+ * shift by one bit (or by X bits for a row), with the column masks         *
+ * keeping anything from wrapping around from one row to the next.  The     *
+ * bits past the last cell are always zero.                                 */
+template <int X, int Y>
+class bitboard {
+ public:
+  enum {
+    cells = X * Y,
+    words = (X * Y + 63) / 64
+  };
+
+  uint64_t w[words];
+
+  static int index(int x, int y)
+  {
+    return y * X + x;
+  }
+
+  void clear()
+  {
+    memset(w, 0, sizeof (w));
+  }
+
+  bool test(int x, int y) const
+  {
+    int i = index(x, y);
+
+    return (w[i >> 6] >> (i & 63)) & 1;
+  }
+
+  void set(int x, int y)
+  {
+    int i = index(x, y);
+
+    w[i >> 6] |= (uint64_t) 1 << (i & 63);
+  }
+
+  void reset(int x, int y)
+  {
+    int i = index(x, y);
+
+    w[i >> 6] &= ~((uint64_t) 1 << (i & 63));
+  }
+
+  void put(int x, int y, bool v)
+  {
+    v ? set(x, y) : reset(x, y);
+  }
+
+  uint32_t count() const
+  {
+    uint32_t n;
+    int i;
+
+    for (n = 0, i = 0; i < words; i++) {
+      n += __builtin_popcountll(w[i]);
+    }
+
+    return n;
+  }
+
+  /* The cell of the kth set bit, counting from zero in row-major order; *
+   * k must be less than count().                                        */
+  void select(uint32_t k, int *x, int *y) const
+  {
+    uint32_t n;
+    uint64_t v;
+    int i;
+
+    for (i = 0; (n = __builtin_popcountll(w[i])) <= k; i++) {
+      k -= n;
+    }
+    for (v = w[i]; k; k--) {
+      v &= v - 1;
+    }
+    n = (i << 6) + __builtin_ctzll(v);
+    *x = n % X;
+    *y = n / X;
+  }
+
+  bitboard operator&(const bitboard &b) const
+  {
+    bitboard r;
+    int i;
+
+    for (i = 0; i < words; i++) {
+      r.w[i] = w[i] & b.w[i];
+    }
+
+    return r;
+  }
+
+  bitboard operator|(const bitboard &b) const
+  {
+    bitboard r;
+    int i;
+
+    for (i = 0; i < words; i++) {
+      r.w[i] = w[i] | b.w[i];
+    }
+
+    return r;
+  }
+
+  /* this & ~b */
+  bitboard without(const bitboard &b) const
+  {
+    bitboard r;
+    int i;
+
+    for (i = 0; i < words; i++) {
+      r.w[i] = w[i] & ~b.w[i];
+    }
+
+    return r;
+  }
+
+  /* Every cell with a set cell among its eight neighbors; a set cell *
+   * with none is not itself included.                                */
+  bitboard neighbors() const
+  {
+    bitboard h, v, r;
+
+    /* Left and right, then up and down from the row plus left and right. */
+    h = shifted(1).without(column(0)) | shifted(-1).without(column(X - 1));
+    v = *this | h;
+    r = h | v.shifted(X) | v.shifted(-X);
+    r.trim();
+
+    return r;
+  }
+
+ private:
+  /* Moves every bit n cells later (n > 0) or earlier (n < 0). */
+  bitboard shifted(int n) const
+  {
+    bitboard r;
+    int i, q, b;
+
+    if (n >= 0) {
+      q = n >> 6;
+      b = n & 63;
+      for (i = words - 1; i >= 0; i--) {
+        r.w[i] = ((i - q >= 0 ? w[i - q] << b : 0) |
+                  (b && i - q - 1 >= 0 ? w[i - q - 1] >> (64 - b) : 0));
+      }
+    } else {
+      q = -n >> 6;
+      b = -n & 63;
+      for (i = 0; i < words; i++) {
+        r.w[i] = ((i + q < words ? w[i + q] >> b : 0) |
+                  (b && i + q + 1 < words ? w[i + q + 1] << (64 - b) : 0));
+      }
+    }
+    r.trim();
+
+    return r;
+  }
+
+  static bitboard column(int x)
+  {
+    bitboard r;
+    int y;
+
+    r.clear();
+    for (y = 0; y < Y; y++) {
+      r.set(x, y);
+    }
+
+    return r;
+  }
+
+  void trim()
+  {
+    if (cells & 63) {
+      w[words - 1] &= ((uint64_t) 1 << (cells & 63)) - 1;
+    }
+  }
+};
+
+#endif
@@ -1,27 +1,12 @@
 #include <limits.h>
+#include <vector>
 
 #include "character.h"
 #include "curse.h"
 #include "io.h"
 #include "pokemon.h"
-
-/* Just to make the following table fit in 80 columns */
-#define PM DIJKSTRA_PATH_MAX
-#define NN NO_NPCS
-/* Swimmers are not allowed to move onto paths in general, and this *
- * is governed by the swimmer movement code.  However, paths over   *
- * or adjacent to water are bridges.  They can't have inifinite     *
- * movement cost, or it throws a wrench into the turn queue.        */
-int32_t move_cost[num_character_types][num_terrain_types] = {
-//  boulder,tree,path,mart,center,grass,clearing,mountain,forest,water,gate,bly
-  { PM, PM, 10, 10, 10, 20, 10, PM, PM, PM, 10, 10, PM },
-  { PM, PM, 10, NN, NN, 15, 10, 15, 15, PM, PM, NN, 15 },
-  { PM, PM, 10, NN, NN, 20, 10, PM, PM, PM, PM, NN, PM },
-  { PM, PM,  7, PM, PM, PM, PM, PM, PM,  7, PM, PM, PM },
-  { PM, PM, 10, NN, NN, 20, 10, PM, PM, PM, PM, PM, PM },
-};
-#undef PM
-#undef NN
+#include "path.h"
+#include "sim.h"
 
 const char *char_type_name[num_character_types] = {
   "PC",
@@ -31,43 +16,30 @@ const char *char_type_name[num_character_types] = {
   "Trainer"
 };
 
-#define is_adjacent(pos, ter)                                \
-  ((world.cur_map->map[pos[dim_y] - 1][pos[dim_x] - 1] == ter) || \
-   (world.cur_map->map[pos[dim_y] - 1][pos[dim_x]    ] == ter) || \
-   (world.cur_map->map[pos[dim_y] - 1][pos[dim_x] + 1] == ter) || \
-   (world.cur_map->map[pos[dim_y]    ][pos[dim_x] - 1] == ter) || \
-   (world.cur_map->map[pos[dim_y]    ][pos[dim_x] + 1] == ter) || \
-   (world.cur_map->map[pos[dim_y] + 1][pos[dim_x] - 1] == ter) || \
-   (world.cur_map->map[pos[dim_y] + 1][pos[dim_x]    ] == ter) || \
-   (world.cur_map->map[pos[dim_y] + 1][pos[dim_x] + 1] == ter))
+#define near_water(x, y) (world.cur_map->near_water.test(x, y))
 
 bool is_pc(character *c)
 {
   return c == &world.pc;
 }
 
-uint32_t can_see(map *m, character *voyeur, character *exhibitionist)
+/* Whether nothing but water and path lies strictly between v and e on *
+ * the Bresenham line from v to e.  Bresenham isn't symmetric, so the  *
+ * line from e to v can pass through different cells.                 */
+static uint32_t line_clear(map *m, const pair_t voyeur,
+                           const pair_t exhibitionist)
 {
-  /* Application of Bresenham's Line Drawing Algorithm.  If we can draw a   *
-   * line from v to e without intersecting any foreign terrain, then v can  *
-   * see * e.  Unfortunately, Bresenham isn't symmetric, so line-of-sight   *
-   * based on this approach is not reciprocal (Helmholtz Reciprocity).      *
-   * This is a very real problem in roguelike games, and one we're going to *
-   * ignore for now.  Algorithms that are symmetrical are far more          *
-   * expensive.                                                             */
-
-  /* Adapted from rlg327.  For the purposes of poke327, can swimmers see    *
-   * the PC adjacent to water or on a bridge?  v is always a swimmer, and e *
-   * is always the player character.                                        */
+  /* Application of Bresenham's Line Drawing Algorithm, adapted from *
+   * rlg327.                                                         */
 
   pair_t first, second;
   pair_t del, f;
   int16_t a, b, c, i;
 
-  first[dim_x] = voyeur->pos[dim_x];
-  first[dim_y] = voyeur->pos[dim_y];
-  second[dim_x] = exhibitionist->pos[dim_x];
-  second[dim_y] = exhibitionist->pos[dim_y];
+  first[dim_x] = voyeur[dim_x];
+  first[dim_y] = voyeur[dim_y];
+  second[dim_x] = exhibitionist[dim_x];
+  second[dim_y] = exhibitionist[dim_y];
 
   if (second[dim_x] > first[dim_x]) {
     del[dim_x] = second[dim_x] - first[dim_x];
@@ -90,7 +62,7 @@ uint32_t can_see(map *m, character *voyeur, character *exhibitionist)
     c = a - del[dim_x];
     b = c - del[dim_x];
     for (i = 0; i <= del[dim_x]; i++) {
-      if (((mappair(first) != ter_water) && (mappair(first) != ter_path)) &&
+      if (!m->sight.test(first[dim_x], first[dim_y]) &&
           i && (i != del[dim_x])) {
         return 0;
       }
@@ -108,7 +80,7 @@ uint32_t can_see(map *m, character *voyeur, character *exhibitionist)
     c = a - del[dim_y];
     b = c - del[dim_y];
     for (i = 0; i <= del[dim_y]; i++) {
-      if (((mappair(first) != ter_water) && (mappair(first) != ter_path)) &&
+      if (!m->sight.test(first[dim_x], first[dim_y]) &&
           i && (i != del[dim_y])) {
         return 0;
       }
@@ -126,280 +98,398 @@ uint32_t can_see(map *m, character *voyeur, character *exhibitionist)
   return 1;
 }
 
-static void move_hiker_func(character *c, pair_t dest)
+/* Can a swimmer at v see the PC at e?  Either clear line counts, so   *
+ * sight is reciprocal (Helmholtz Reciprocity): v sees e exactly when   *
+ * e sees v.  That lets the answer be kept per cell the PC stands on,   *
+ * as the set of swimmable cells in sight, worked out the first time a  *
+ * swimmer looks there.  The PC visits few cells by water while         *
+ * swimmers lap all over it, so few sets are ever built, and each is    *
+ * shared by every swimmer; after that a look is a bit test.            */
+uint32_t can_see(map *m, const pair_t voyeur, const pair_t exhibitionist)
+{
+  int16_t *slot = &m->view_slot[exhibitionist[dim_y]][exhibitionist[dim_x]];
+  map_bits_t *view;
+  pair_t v;
+
+  if (*slot < 0) {
+    *slot = m->view.size();
+    m->view.resize(*slot + 1);
+    view = &m->view[*slot];
+    view->clear();
+    for (v[dim_y] = 0; v[dim_y] < MAP_Y; v[dim_y]++) {
+      for (v[dim_x] = 0; v[dim_x] < MAP_X; v[dim_x]++) {
+        if (m->swim.test(v[dim_x], v[dim_y]) &&
+            (line_clear(m, v, exhibitionist) ||
+             line_clear(m, exhibitionist, v))) {
+          view->set(v[dim_x], v[dim_y]);
+        }
+      }
+    }
+  }
+
+  return m->view[*slot].test(voyeur[dim_x], voyeur[dim_y]);
+}
+
+static void move_hiker_func(uint32_t id, pair_t dest)
 {
+  npc_store *s = &world.cur_map->npcs;
+  pair_t pos;
   int min;
   int base;
   int i;
   
-  base = rand() & 0x7;
+  s->get_pos(id, pos);
+  base = rand_r(&s->seed[id]) & 0x7;
 
-  dest[dim_x] = c->pos[dim_x];
-  dest[dim_y] = c->pos[dim_y];
+  dest[dim_x] = pos[dim_x];
+  dest[dim_y] = pos[dim_y];
   min = DIJKSTRA_PATH_MAX;
+
+  pathfind_ensure(dist_hiker);
   
   for (i = base; i < 8 + base; i++) {
-    if ((world.hiker_dist[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
-                         [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]] <= min) &&
-        !world.cur_map->cmap[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
-                            [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]] &&
-        c->pos[dim_x] + all_dirs[i & 0x7][dim_x] != 0 &&
-        c->pos[dim_x] + all_dirs[i & 0x7][dim_x] != MAP_X - 1 &&
-        c->pos[dim_y] + all_dirs[i & 0x7][dim_y] != 0 &&
-        c->pos[dim_y] + all_dirs[i & 0x7][dim_y] != MAP_Y - 1 &&
-        move_cost[char_hiker][world.cur_map->map[c->pos[dim_y] +
+    if ((dist_widen(world.hiker_dist[pos[dim_y] +
+                                     all_dirs[i & 0x7][dim_y]]
+                                    [pos[dim_x] +
+                                     all_dirs[i & 0x7][dim_x]]) <= min) &&
+        !world.cur_map->cmap[pos[dim_y] + all_dirs[i & 0x7][dim_y]]
+                            [pos[dim_x] + all_dirs[i & 0x7][dim_x]] &&
+        pos[dim_x] + all_dirs[i & 0x7][dim_x] != 0 &&
+        pos[dim_x] + all_dirs[i & 0x7][dim_x] != MAP_X - 1 &&
+        pos[dim_y] + all_dirs[i & 0x7][dim_y] != 0 &&
+        pos[dim_y] + all_dirs[i & 0x7][dim_y] != MAP_Y - 1 &&
+        move_cost[char_hiker][world.cur_map->map[pos[dim_y] +
                                                  all_dirs[i & 0x7][dim_y]]
-                                                [c->pos[dim_x] +
+                                                [pos[dim_x] +
                                                  all_dirs[i & 0x7][dim_x]]] <
           NO_NPCS) {
-      dest[dim_x] = c->pos[dim_x] + all_dirs[i & 0x7][dim_x];
-      dest[dim_y] = c->pos[dim_y] + all_dirs[i & 0x7][dim_y];
-      min = world.hiker_dist[dest[dim_y]][dest[dim_x]];
+      dest[dim_x] = pos[dim_x] + all_dirs[i & 0x7][dim_x];
+      dest[dim_y] = pos[dim_y] + all_dirs[i & 0x7][dim_y];
+      min = dist_widen(world.hiker_dist[dest[dim_y]][dest[dim_x]]);
     }
-    if (world.hiker_dist[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
-                        [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]] == 0) {
-      io_battle(c, &world.pc);
+    if (world.hiker_dist[pos[dim_y] + all_dirs[i & 0x7][dim_y]]
+                        [pos[dim_x] + all_dirs[i & 0x7][dim_x]] == 0) {
+      io_battle(s->party[id], &world.pc);
       break;
     }
   }
 }
 
-static void move_rival_func(character *c, pair_t dest)
+static void move_rival_func(uint32_t id, pair_t dest)
 {
+  npc_store *s = &world.cur_map->npcs;
+  pair_t pos;
   int min;
   int base;
   int i;
   
-  base = rand() & 0x7;
+  s->get_pos(id, pos);
+  base = rand_r(&s->seed[id]) & 0x7;
 
-  dest[dim_x] = c->pos[dim_x];
-  dest[dim_y] = c->pos[dim_y];
+  dest[dim_x] = pos[dim_x];
+  dest[dim_y] = pos[dim_y];
   min = DIJKSTRA_PATH_MAX;
+
+  pathfind_ensure(dist_rival);
   
   for (i = base; i < 8 + base; i++) {
-    if ((world.rival_dist[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
-                         [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]] <
+    if ((dist_widen(world.rival_dist[pos[dim_y] +
+                                     all_dirs[i & 0x7][dim_y]]
+                                    [pos[dim_x] +
+                                     all_dirs[i & 0x7][dim_x]]) <
          min) &&
-        !world.cur_map->cmap[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
-                            [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]] &&
-        c->pos[dim_x] + all_dirs[i & 0x7][dim_x] != 0 &&
-        c->pos[dim_x] + all_dirs[i & 0x7][dim_x] != MAP_X - 1 &&
-        c->pos[dim_y] + all_dirs[i & 0x7][dim_y] != 0 &&
-        c->pos[dim_y] + all_dirs[i & 0x7][dim_y] != MAP_Y - 1 &&
-        move_cost[char_rival][world.cur_map->map[c->pos[dim_y] +
+        !world.cur_map->cmap[pos[dim_y] + all_dirs[i & 0x7][dim_y]]
+                            [pos[dim_x] + all_dirs[i & 0x7][dim_x]] &&
+        pos[dim_x] + all_dirs[i & 0x7][dim_x] != 0 &&
+        pos[dim_x] + all_dirs[i & 0x7][dim_x] != MAP_X - 1 &&
+        pos[dim_y] + all_dirs[i & 0x7][dim_y] != 0 &&
+        pos[dim_y] + all_dirs[i & 0x7][dim_y] != MAP_Y - 1 &&
+        move_cost[char_rival][world.cur_map->map[pos[dim_y] +
                                                  all_dirs[i & 0x7][dim_y]]
-                                                [c->pos[dim_x] +
+                                                [pos[dim_x] +
                                                  all_dirs[i & 0x7][dim_x]]] <
         NO_NPCS) {
-      dest[dim_x] = c->pos[dim_x] + all_dirs[i & 0x7][dim_x];
-      dest[dim_y] = c->pos[dim_y] + all_dirs[i & 0x7][dim_y];
-      min = world.rival_dist[dest[dim_y]][dest[dim_x]];
+      dest[dim_x] = pos[dim_x] + all_dirs[i & 0x7][dim_x];
+      dest[dim_y] = pos[dim_y] + all_dirs[i & 0x7][dim_y];
+      min = dist_widen(world.rival_dist[dest[dim_y]][dest[dim_x]]);
     }
-    if (world.rival_dist[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
-                        [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]] == 0) {
-      io_battle(c, &world.pc);
+    if (world.rival_dist[pos[dim_y] + all_dirs[i & 0x7][dim_y]]
+                        [pos[dim_x] + all_dirs[i & 0x7][dim_x]] == 0) {
+      io_battle(s->party[id], &world.pc);
       break;
     }
   }
 }
 
-static void move_pacer_func(character *c, pair_t dest)
-{
+/* Pacers, wanderers, sentries and explorers only ever look at the cell  *
+ * in front of them, so a run of them due on the same turn is moved as a *
+ * batch: each kernel below takes every member of one movement type,     *
+ * looks up the cells in front of them all in one pass, then decides     *
+ * every move against the board as it stood when the batch started.     *
+ * Nothing moves until move_batch() returns; the caller commits the      *
+ * moves in seq_num order and settles any two that picked the same cell. *
+ * A single NPC's turn is a batch of one.                                */
+typedef struct batch_front {
+  int16_t x, y;
   terrain_type_t t;
-  npc *n = (npc *) c;
-  
-  dest[dim_x] = n->pos[dim_x];
-  dest[dim_y] = n->pos[dim_y];
-
-  if (!n->defeated &&
-      world.cur_map->cmap[n->pos[dim_y] + n->dir[dim_y]]
-                         [n->pos[dim_x] + n->dir[dim_x]] ==
-      &world.pc) {
-      io_battle(c, &world.pc);
-      return;
-  }
+  character *c;
+} batch_front_t;
 
-  t = world.cur_map->map[n->pos[dim_y] + n->dir[dim_y]]
-                        [n->pos[dim_x] + n->dir[dim_x]];
+static std::vector<batch_front_t> batch_front;
 
-  if ((t != ter_path && t != ter_grass && t != ter_clearing) ||
-      world.cur_map->cmap[n->pos[dim_y] + n->dir[dim_y]]
-                         [n->pos[dim_x] + n->dir[dim_x]] ||
-      move_cost[n->ctype][t] >= NO_NPCS) {
-    n->dir[dim_x] *= -1;
-    n->dir[dim_y] *= -1;
+static void batch_gather(uint32_t n, const uint32_t member[],
+                         const uint32_t id[])
+{
+  npc_store *s = &world.cur_map->npcs;
+  uint32_t i, k;
+
+  batch_front.resize(n);
+  for (i = 0; i < n; i++) {
+    k = id[member[i]];
+    batch_front[i].x = s->pos[dim_x][k] + s->dir[dim_x][k];
+    batch_front[i].y = s->pos[dim_y][k] + s->dir[dim_y][k];
+  }
+  for (i = 0; i < n; i++) {
+    batch_front[i].t = world.cur_map->map[batch_front[i].y][batch_front[i].x];
+    batch_front[i].c = world.cur_map->cmap[batch_front[i].y][batch_front[i].x];
   }
+}
 
-  if ((t == ter_path || t == ter_grass || t == ter_clearing) &&
-      !world.cur_map->cmap[n->pos[dim_y] + n->dir[dim_y]]
-                          [n->pos[dim_x] + n->dir[dim_x]] &&
-      move_cost[n->ctype][t] < NO_NPCS) {
-    dest[dim_x] = n->pos[dim_x] + n->dir[dim_x];
-    dest[dim_y] = n->pos[dim_y] + n->dir[dim_y];
+/* Meets a PC standing in front; returns nonzero if there was a battle. */
+static int batch_challenge(npc_store *s, uint32_t k, const batch_front_t *f)
+{
+  if (!s->defeated[k] && f->c == &world.pc) {
+    io_battle(s->party[k], &world.pc);
+    return 1;
   }
+
+  return 0;
 }
 
-static void move_wanderer_func(character *c, pair_t dest)
+static void pace_batch(uint32_t n, const uint32_t member[],
+                       const uint32_t id[], pair_t dest[])
 {
+  npc_store *s = &world.cur_map->npcs;
   terrain_type_t t;
-  npc *n = (npc *) c;
+  uint32_t i, k;
+  int16_t *d;
+  pair_t pos;
 
-  dest[dim_x] = n->pos[dim_x];
-  dest[dim_y] = n->pos[dim_y];
+  batch_gather(n, member, id);
+  for (i = 0; i < n; i++) {
+    k = id[member[i]];
+    d = dest[member[i]];
+    s->get_pos(k, pos);
+    d[dim_x] = pos[dim_x];
+    d[dim_y] = pos[dim_y];
 
-  if (!n->defeated &&
-      world.cur_map->cmap[n->pos[dim_y] + n->dir[dim_y]]
-                         [n->pos[dim_x] + n->dir[dim_x]] ==
-      &world.pc) {
-      io_battle(c, &world.pc);
-      return;
-  }
+    if (batch_challenge(s, k, &batch_front[i])) {
+      continue;
+    }
 
-  t = world.cur_map->map[n->pos[dim_y] + n->dir[dim_y]]
-                        [n->pos[dim_x] + n->dir[dim_x]];
+    t = batch_front[i].t;
+    if ((t != ter_path && t != ter_grass && t != ter_clearing) ||
+        batch_front[i].c || move_cost[s->ctype[k]][t] >= NO_NPCS) {
+      s->dir[dim_x][k] *= -1;
+      s->dir[dim_y][k] *= -1;
+    }
 
-  if ((world.cur_map->map[n->pos[dim_y] + n->dir[dim_y]]
-                         [n->pos[dim_x] + n->dir[dim_x]] !=
-       world.cur_map->map[n->pos[dim_y]][n->pos[dim_x]]) ||
-      world.cur_map->cmap[n->pos[dim_y] + n->dir[dim_y]]
-                         [n->pos[dim_x] + n->dir[dim_x]] ||
-      move_cost[n->ctype][t] >= NO_NPCS) {
-    rand_dir(n->dir);
+    if ((t == ter_path || t == ter_grass || t == ter_clearing) &&
+        !world.cur_map->cmap[pos[dim_y] + s->dir[dim_y][k]]
+                            [pos[dim_x] + s->dir[dim_x][k]] &&
+        move_cost[s->ctype[k]][t] < NO_NPCS) {
+      d[dim_x] = pos[dim_x] + s->dir[dim_x][k];
+      d[dim_y] = pos[dim_y] + s->dir[dim_y][k];
+    }
   }
+}
 
-  if ((world.cur_map->map[n->pos[dim_y] + n->dir[dim_y]]
-                         [n->pos[dim_x] + n->dir[dim_x]] ==
-       world.cur_map->map[n->pos[dim_y]][n->pos[dim_x]]) &&
-      !world.cur_map->cmap[n->pos[dim_y] + n->dir[dim_y]]
-                          [n->pos[dim_x] + n->dir[dim_x]] &&
-      move_cost[n->ctype][t] < NO_NPCS) {
-    dest[dim_x] = n->pos[dim_x] + n->dir[dim_x];
-    dest[dim_y] = n->pos[dim_y] + n->dir[dim_y];
+static void wander_batch(uint32_t n, const uint32_t member[],
+                         const uint32_t id[], pair_t dest[])
+{
+  npc_store *s = &world.cur_map->npcs;
+  terrain_type_t t, here;
+  uint32_t i, k;
+  int16_t *d;
+  pair_t pos, dir;
+
+  batch_gather(n, member, id);
+  for (i = 0; i < n; i++) {
+    k = id[member[i]];
+    d = dest[member[i]];
+    s->get_pos(k, pos);
+    d[dim_x] = pos[dim_x];
+    d[dim_y] = pos[dim_y];
+
+    if (batch_challenge(s, k, &batch_front[i])) {
+      continue;
+    }
+
+    t = batch_front[i].t;
+    here = world.cur_map->map[pos[dim_y]][pos[dim_x]];
+    if (t != here || batch_front[i].c ||
+        move_cost[s->ctype[k]][t] >= NO_NPCS) {
+      rand_dir_r(dir, &s->seed[k]);
+      s->set_dir(k, dir);
+    }
+
+    if ((world.cur_map->map[pos[dim_y] + s->dir[dim_y][k]]
+                           [pos[dim_x] + s->dir[dim_x][k]] == here) &&
+        !world.cur_map->cmap[pos[dim_y] + s->dir[dim_y][k]]
+                            [pos[dim_x] + s->dir[dim_x][k]] &&
+        move_cost[s->ctype[k]][t] < NO_NPCS) {
+      d[dim_x] = pos[dim_x] + s->dir[dim_x][k];
+      d[dim_y] = pos[dim_y] + s->dir[dim_y][k];
+    }
   }
 }
 
-static void move_sentry_func(character *c, pair_t dest)
+static void sentry_batch(uint32_t n, const uint32_t member[],
+                         const uint32_t id[], pair_t dest[])
 {
+  uint32_t i;
+
   // Not a bug.  Sentries are non-aggro.
-  dest[dim_x] = c->pos[dim_x];
-  dest[dim_y] = c->pos[dim_y];
+  for (i = 0; i < n; i++) {
+    world.cur_map->npcs.get_pos(id[member[i]], dest[member[i]]);
+  }
 }
 
-static void move_explorer_func(character *c, pair_t dest)
+static void explore_batch(uint32_t n, const uint32_t member[],
+                          const uint32_t id[], pair_t dest[])
 {
-  npc *n = (npc *) c;
+  npc_store *s = &world.cur_map->npcs;
+  uint32_t i, k;
+  int16_t *d;
+  pair_t pos, dir;
+
+  batch_gather(n, member, id);
+  for (i = 0; i < n; i++) {
+    k = id[member[i]];
+    d = dest[member[i]];
+    s->get_pos(k, pos);
+    d[dim_x] = pos[dim_x];
+    d[dim_y] = pos[dim_y];
+
+    if (batch_challenge(s, k, &batch_front[i])) {
+      continue;
+    }
+
+    if (move_cost[char_other][batch_front[i].t] >= NO_NPCS ||
+        batch_front[i].c) {
+      rand_dir_r(dir, &s->seed[k]);
+      s->set_dir(k, dir);
+    }
+
+    if ((move_cost[char_other][world.cur_map->map[pos[dim_y] +
+                                                  s->dir[dim_y][k]]
+                                                 [pos[dim_x] +
+                                                  s->dir[dim_x][k]]] <
+         NO_NPCS) &&
+        !world.cur_map->cmap[pos[dim_y] + s->dir[dim_y][k]]
+                            [pos[dim_x] + s->dir[dim_x][k]]) {
+      d[dim_x] = pos[dim_x] + s->dir[dim_x][k];
+      d[dim_y] = pos[dim_y] + s->dir[dim_y][k];
+    }
+  }
+}
 
-  dest[dim_x] = n->pos[dim_x];
-  dest[dim_y] = n->pos[dim_y];
+static void (*const batch_func[num_movement_types])(uint32_t,
+                                                    const uint32_t [],
+                                                    const uint32_t [],
+                                                    pair_t []) = {
+  NULL,
+  NULL,
+  pace_batch,
+  wander_batch,
+  sentry_batch,
+  explore_batch,
+  NULL,
+  NULL,
+};
 
-  if (!n->defeated &&
-      world.cur_map->cmap[n->pos[dim_y] + n->dir[dim_y]]
-                         [n->pos[dim_x] + n->dir[dim_x]] ==
-      &world.pc) {
-      io_battle(c, &world.pc);
-      return;
-  }
+bool is_batched(movement_type_t m)
+{
+  return batch_func[m];
+}
 
-  if ((move_cost[char_other][world.cur_map->map[n->pos[dim_y] +
-                                                n->dir[dim_y]]
-                                               [n->pos[dim_x] +
-                                                n->dir[dim_x]]] >=
-       NO_NPCS) || (world.cur_map->cmap[n->pos[dim_y] + n->dir[dim_y]]
-                                       [n->pos[dim_x] + n->dir[dim_x]])) {
-    rand_dir(n->dir);
+void move_batch(uint32_t n, const uint32_t id[], pair_t dest[])
+{
+  static std::vector<uint32_t> member;
+  npc_store *s = &world.cur_map->npcs;
+  uint32_t i, count;
+  int m;
+
+  member.resize(n);
+  for (m = 0; m < num_movement_types; m++) {
+    if (!batch_func[m]) {
+      continue;
+    }
+    for (count = 0, i = 0; i < n; i++) {
+      if (s->mtype[id[i]] == m) {
+        member[count++] = i;
+      }
+    }
+    if (count) {
+      batch_func[m](count, member.data(), id, dest);
+    }
   }
+}
 
-  if ((move_cost[char_other][world.cur_map->map[n->pos[dim_y] +
-                                                n->dir[dim_y]]
-                                               [n->pos[dim_x] +
-                                                n->dir[dim_x]]] <
-       NO_NPCS) &&
-      !world.cur_map->cmap[n->pos[dim_y] + n->dir[dim_y]]
-                          [n->pos[dim_x] + n->dir[dim_x]]) {
-    dest[dim_x] = n->pos[dim_x] + n->dir[dim_x];
-    dest[dim_y] = n->pos[dim_y] + n->dir[dim_y];
-  }
+static void move_local_func(uint32_t id, pair_t dest)
+{
+  move_batch(1, &id, (pair_t *) dest);
 }
 
-static void move_swimmer_func(character *c, pair_t dest)
+static void move_swimmer_func(uint32_t id, pair_t dest)
 {
-  npc *n = (npc *) c;
+  npc_store *s = &world.cur_map->npcs;
   map *m = world.cur_map;
-  pair_t dir; 
-
-  dest[dim_x] = n->pos[dim_x];
-  dest[dim_y] = n->pos[dim_y];
-
-  if (!n->defeated &&
-      ((world.cur_map->cmap[dest[dim_y] - 1][dest[dim_x] - 1] == &world.pc) ||
-       (world.cur_map->cmap[dest[dim_y] - 1][dest[dim_x]    ] == &world.pc) ||
-       (world.cur_map->cmap[dest[dim_y] - 1][dest[dim_x] + 1] == &world.pc) ||
-       (world.cur_map->cmap[dest[dim_y]    ][dest[dim_x] - 1] == &world.pc) ||
-       (world.cur_map->cmap[dest[dim_y]    ][dest[dim_x] + 1] == &world.pc) ||
-       (world.cur_map->cmap[dest[dim_y] + 1][dest[dim_x] - 1] == &world.pc) ||
-       (world.cur_map->cmap[dest[dim_y] + 1][dest[dim_x]    ] == &world.pc) ||
-       (world.cur_map->cmap[dest[dim_y] + 1][dest[dim_x] + 1] == &world.pc))) {
-      io_battle(c, &world.pc);
+  pair_t pos, dir;
+
+  s->get_pos(id, pos);
+  dest[dim_x] = pos[dim_x];
+  dest[dim_y] = pos[dim_y];
+
+  if (!s->defeated[id] &&
+      abs(world.pc.pos[dim_x] - pos[dim_x]) <= 1 &&
+      abs(world.pc.pos[dim_y] - pos[dim_y]) <= 1) {
+      io_battle(s->party[id], &world.pc);
       return;
   }
 
-  if (is_adjacent(world.pc.pos, ter_water) &&
-      can_see(world.cur_map, c, &world.pc) &&
-      !n->defeated) {
+  if (near_water(world.pc.pos[dim_x], world.pc.pos[dim_y]) &&
+      can_see(world.cur_map, pos, world.pc.pos) &&
+      !s->defeated[id]) {
     /* PC is next to this body of water; swim to the PC */
 
-    dir[dim_x] = world.pc.pos[dim_x] - n->pos[dim_x];
+    dir[dim_x] = world.pc.pos[dim_x] - pos[dim_x];
     if (dir[dim_x]) {
       dir[dim_x] /= abs(dir[dim_x]);
     }
-    dir[dim_y] = world.pc.pos[dim_y] - n->pos[dim_y];
+    dir[dim_y] = world.pc.pos[dim_y] - pos[dim_y];
     if (dir[dim_y]) {
       dir[dim_y] /= abs(dir[dim_y]);
     }
 
-    if ((m->map[dest[dim_y] + dir[dim_y]]
-               [dest[dim_x] + dir[dim_x]] == ter_water) ||
-        ((m->map[dest[dim_y] + dir[dim_y]]
-                [dest[dim_x] + dir[dim_x]] == ter_path) &&
-         is_adjacent(((pair_t){ (int16_t) (dest[dim_x] + dir[dim_x]),
-                               (int16_t) (dest[dim_y] + dir[dim_y]) }),
-           ter_water))) {
+    if (m->swim.test(dest[dim_x] + dir[dim_x], dest[dim_y] + dir[dim_y])) {
       dest[dim_x] += dir[dim_x];
       dest[dim_y] += dir[dim_y];
-    } else if ((m->map[dest[dim_y]][dest[dim_x] + dir[dim_x]] == ter_water) ||
-               ((m->map[dest[dim_y]][dest[dim_x] + dir[dim_x]] == ter_path) &&
-                is_adjacent(((pair_t){ (int16_t) (dest[dim_x] + dir[dim_x]),
-                                       (int16_t) (dest[dim_y]) }),
-                  ter_water))) {
+    } else if (m->swim.test(dest[dim_x] + dir[dim_x], dest[dim_y])) {
       dest[dim_x] += dir[dim_x];
-    } else if ((m->map[dest[dim_y] + dir[dim_y]][dest[dim_x]] == ter_water) ||
-               ((m->map[dest[dim_y] + dir[dim_y]][dest[dim_x]] == ter_path) &&
-                is_adjacent(((pair_t){ (int16_t) (dest[dim_x]),
-                                       (int16_t) (dest[dim_y] + dir[dim_y]) }),
-                            ter_water))) {
+    } else if (m->swim.test(dest[dim_x], dest[dim_y] + dir[dim_y])) {
       dest[dim_y] += dir[dim_y];
     }
   } else {
     /* PC is elsewhere.  Keep doing laps. */
-    dir[dim_x] = n->dir[dim_x];
-    dir[dim_y] = n->dir[dim_y];
-    if ((m->map[dest[dim_y] + dir[dim_y]]
-                    [dest[dim_x] + dir[dim_x]] != ter_water) ||
-        !((m->map[dest[dim_y] + dir[dim_y]]
-                 [dest[dim_x] + dir[dim_x]] == ter_path) &&
-          is_adjacent(((pair_t) { (int16_t) (dest[dim_x] + dir[dim_x]),
-                                  (int16_t) (dest[dim_y] + dir[dim_y]) }),
-            ter_water))) {
-      rand_dir(dir);
+    s->get_dir(id, dir);
+    if (!m->water.test(dest[dim_x] + dir[dim_x], dest[dim_y] + dir[dim_y]) ||
+        !(m->path.test(dest[dim_x] + dir[dim_x], dest[dim_y] + dir[dim_y]) &&
+          near_water(dest[dim_x] + dir[dim_x], dest[dim_y] + dir[dim_y]))) {
+      rand_dir_r(dir, &s->seed[id]);
     }
 
-    if ((m->map[dest[dim_y] + dir[dim_y]]
-                    [dest[dim_x] + dir[dim_x]] == ter_water) ||
-        ((m->map[dest[dim_y] + dir[dim_y]]
-                [dest[dim_x] + dir[dim_x]] == ter_path) &&
-         is_adjacent(((pair_t) { (int16_t) (dest[dim_x] + dir[dim_x]),
-                                 (int16_t) (dest[dim_y] + dir[dim_y]) }),
-           ter_water))) {
+    if (m->swim.test(dest[dim_x] + dir[dim_x], dest[dim_y] + dir[dim_y])) {
       dest[dim_x] += dir[dim_x];
       dest[dim_y] += dir[dim_y];
     }
@@ -407,38 +497,35 @@ static void move_swimmer_func(character *c, pair_t dest)
 
   if (m->cmap[dest[dim_y]][dest[dim_x]]) {
     /* Occupied.  Just be patient. */
-    dest[dim_x] = n->pos[dim_x];
-    dest[dim_y] = n->pos[dim_y];
+    dest[dim_x] = pos[dim_x];
+    dest[dim_y] = pos[dim_y];
   }
 }
 
-static void move_pc_func(character *c, pair_t dest)
+static void move_pc_func(uint32_t id, pair_t dest)
 {
+  UNUSED(id);
+
+  if (world.headless) {
+    sim_pc_turn(dest);
+    return;
+  }
+
   io_display();
   io_handle_input(dest);
 }
 
-void (*move_func[num_movement_types])(character *, pair_t) = {
+void (*move_func[num_movement_types])(uint32_t, pair_t) = {
   move_hiker_func,
   move_rival_func,
-  move_pacer_func,
-  move_wanderer_func,
-  move_sentry_func,
-  move_explorer_func,
+  move_local_func,
+  move_local_func,
+  move_local_func,
+  move_local_func,
   move_swimmer_func,
   move_pc_func,
 };
 
-int32_t cmp_char_turns(const void *key, const void *with)
-{
-  return ((((character *) key)->next_turn ==
-           ((character *) with)->next_turn)  ?
-          (((character *) key)->seq_num -
-           ((character *) with)->seq_num)    :
-          (((character *) key)->next_turn -
-           ((character *) with)->next_turn));
-}
-
 character::~character()
 {
   int i;
@@ -478,238 +565,45 @@ void delete_character(void *v)
   }
 }
 
-#define ter_cost(x, y, c) move_cost[c][m->map[y][x]]
-
-static int32_t hiker_cmp(const void *key, const void *with) {
-  return (world.hiker_dist[((path_t *) key)->pos[dim_y]]
-                          [((path_t *) key)->pos[dim_x]] -
-          world.hiker_dist[((path_t *) with)->pos[dim_y]]
-                          [((path_t *) with)->pos[dim_x]]);
-}
-
-static int32_t rival_cmp(const void *key, const void *with) {
-  return (world.rival_dist[((path_t *) key)->pos[dim_y]]
-                          [((path_t *) key)->pos[dim_x]] -
-          world.rival_dist[((path_t *) with)->pos[dim_y]]
-                          [((path_t *) with)->pos[dim_x]]);
-}
-
-void pathfind(map *m)
+/* Moving the PC or changing maps only marks the distance maps stale.     *
+ * Anything about to read one calls pathfind_ensure() first, so a map     *
+ * with no hikers (or only defeated ones) never computes the hiker map,   *
+ * and a map read by many NPCs is computed once per PC move.  The source  *
+ * is captured here, not at compute time, so the result is the same as   *
+ * if it had been computed eagerly.                                       */
+void pathfind_invalidate()
 {
-  heap_t h;
-  uint32_t x, y;
-  static path_t p[MAP_Y][MAP_X], *c;
-  static uint32_t initialized = 0;
-
-  if (!initialized) {
-    initialized = 1;
-    for (y = 0; y < MAP_Y; y++) {
-      for (x = 0; x < MAP_X; x++) {
-        p[y][x].pos[dim_y] = y;
-        p[y][x].pos[dim_x] = x;
-      }
-    }
-  }
-
-  for (y = 0; y < MAP_Y; y++) {
-    for (x = 0; x < MAP_X; x++) {
-      world.hiker_dist[y][x] = world.rival_dist[y][x] = DIJKSTRA_PATH_MAX;
-    }
-  }
-  world.hiker_dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = 
-    world.rival_dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = 0;
-
-  heap_init(&h, hiker_cmp, NULL);
-
-  for (y = 1; y < MAP_Y - 1; y++) {
-    for (x = 1; x < MAP_X - 1; x++) {
-      if (ter_cost(x, y, char_hiker) != DIJKSTRA_PATH_MAX) {
-        p[y][x].hn = heap_insert(&h, &p[y][x]);
-      } else {
-        p[y][x].hn = NULL;
-      }
-    }
-  }
+  int i;
 
-  while ((c = (path_t *) heap_remove_min(&h))) {
-    c->hn = NULL;
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x] - 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x] - 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn) &&
-        (world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x]    ] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x]    ] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x] + 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x] + 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y]    ][c->pos[dim_x] - 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y]    ][c->pos[dim_x] - 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y]    ][c->pos[dim_x] + 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y]    ][c->pos[dim_x] + 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x] - 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x] - 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn) &&
-        (world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x]    ] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x]    ] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x] + 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x] + 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn);
-    }
+  pairCpy(world.dist_from, world.pc.pos);
+  for (i = 0; i < num_dist_maps; i++) {
+    world.dist_valid[i] = 0;
   }
-  heap_delete(&h);
-
-  heap_init(&h, rival_cmp, NULL);
+}
 
-  for (y = 1; y < MAP_Y - 1; y++) {
-    for (x = 1; x < MAP_X - 1; x++) {
-      if (ter_cost(x, y, char_rival) != DIJKSTRA_PATH_MAX) {
-        p[y][x].hn = heap_insert(&h, &p[y][x]);
-      } else {
-        p[y][x].hn = NULL;
-      }
-    }
+void pathfind_ensure(dist_map_t d)
+{
+  if (world.dist_valid[d]) {
+    return;
   }
 
-  while ((c = (path_t *) heap_remove_min(&h))) {
-    c->hn = NULL;
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn) &&
-        (world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x] - 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x] - 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn) &&
-        (world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x]    ] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x]    ] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn) &&
-        (world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x] + 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x] + 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn) &&
-        (world.rival_dist[c->pos[dim_y]    ][c->pos[dim_x] - 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y]    ][c->pos[dim_x] - 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn) &&
-        (world.rival_dist[c->pos[dim_y]    ][c->pos[dim_x] + 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y]    ][c->pos[dim_x] + 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn) &&
-        (world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x] - 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x] - 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn) &&
-        (world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x]    ] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x]    ] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn) &&
-        (world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x] + 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x] + 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn);
-    }
+  switch (d) {
+  case dist_hiker:
+    if (!dist_cache_lookup(world.cur_map, world.dist_from,
+                           d, world.hiker_dist)) {
+      dist_field(world.cur_map->cost[d], world.dist_from, world.hiker_dist);
+      dist_cache_store(world.cur_map, world.dist_from, d, world.hiker_dist);
+    }
+    break;
+  case dist_rival:
+    if (!dist_cache_lookup(world.cur_map, world.dist_from,
+                           d, world.rival_dist)) {
+      dist_field(world.cur_map->cost[d], world.dist_from, world.rival_dist);
+      dist_cache_store(world.cur_map, world.dist_from, d, world.rival_dist);
+    }
+    break;
+  default:
+    break;
   }
-  heap_delete(&h);
+  world.dist_valid[d] = 1;
 }
@@ -2,11 +2,17 @@
 # define CHARACTER_H
 
 # include <cstdint>
+# include <vector>
 
 # include "pair.h"
 
 #define DIJKSTRA_PATH_MAX (INT_MAX / 2)
 #define NO_NPCS 50
+/* Compact distance maps and cost grids saturate at these; widen a *
+ * distance before comparing it against DIJKSTRA_PATH_MAX.          */
+#define DIST_INF UINT16_MAX
+#define COST_INF UINT8_MAX
+#define dist_widen(d) ((d) == DIST_INF ? DIJKSTRA_PATH_MAX : (int32_t) (d))
 
 class pokemon;
 
@@ -40,10 +46,11 @@ typedef enum inv {
   inv_size
 } inv_t;
 
+/* What cmap and the turn queue hold.  next_turn and seq_num are the turn *
+ * queue's keys, so they live here, where the queue can reach them.       */
 class character {
  public:
   virtual ~character();
-  pair_t pos;
   char symbol;
   int next_turn;
   int seq_num;
@@ -53,17 +60,88 @@ class character {
   uint8_t num_buddies;
 };
 
+/* An NPC's state lives in its map's npc_store; the object itself is *
+ * just its party and a handle to its row there.                     */
 class npc : public character {
  public:
-  character_type_t ctype;
-  movement_type_t mtype;
-  int defeated;
-  pair_t dir;
+  uint32_t id;
   virtual ~npc() {}
 };
 
+/* The NPCs on one map, structure-of-arrays: row id of every column     *
+ * belongs to the NPC with that id, and party[id] is its npc object.    *
+ * The turn loop and the movement functions read and write these        *
+ * columns directly, so a turn never has to work out what kind of       *
+ * character it is holding, and a pass over every NPC touches only the  *
+ * columns it needs.  Rows are never removed; a beaten trainer stays    *
+ * on its map.                                                          */
+class npc_store {
+ public:
+  std::vector<int16_t> pos[num_dims];
+  std::vector<int16_t> dir[num_dims];
+  std::vector<character_type_t> ctype;
+  std::vector<movement_type_t> mtype;
+  std::vector<uint8_t> defeated;
+  /* Every NPC draws its moves from a stream of its own, with rand_r(), *
+   * so that one NPC's turn never depends on how many numbers another  *
+   * has drawn; see spec.h.                                            */
+  std::vector<unsigned> seed;
+  std::vector<npc *> party;
+
+  uint32_t size() const
+  {
+    return party.size();
+  }
+
+  void get_pos(uint32_t id, pair_t p) const
+  {
+    p[dim_x] = pos[dim_x][id];
+    p[dim_y] = pos[dim_y][id];
+  }
+
+  void set_pos(uint32_t id, const pair_t p)
+  {
+    pos[dim_x][id] = p[dim_x];
+    pos[dim_y][id] = p[dim_y];
+  }
+
+  void get_dir(uint32_t id, pair_t d) const
+  {
+    d[dim_x] = dir[dim_x][id];
+    d[dim_y] = dir[dim_y][id];
+  }
+
+  void set_dir(uint32_t id, const pair_t d)
+  {
+    dir[dim_x][id] = d[dim_x];
+    dir[dim_y][id] = d[dim_y];
+  }
+
+  /* Appends a row for a new, undefeated NPC facing nowhere, with *
+   * seed s, and returns its npc object, with id set and nothing   *
+   * else.                                                         */
+  npc *add(pair_t p, character_type_t c, movement_type_t m, unsigned s)
+  {
+    npc *n = new npc;
+
+    n->id = party.size();
+    pos[dim_x].push_back(p[dim_x]);
+    pos[dim_y].push_back(p[dim_y]);
+    dir[dim_x].push_back(0);
+    dir[dim_y].push_back(0);
+    ctype.push_back(c);
+    mtype.push_back(m);
+    defeated.push_back(0);
+    seed.push_back(s);
+    party.push_back(n);
+
+    return n;
+  }
+};
+
 class pc : public character {
  public:
+  pair_t pos;
   int bag[inv_size];
   // void use(inv_t item);
   virtual ~pc() {}
@@ -73,10 +151,33 @@ class pc : public character {
 /* character is defined in poke327.h to allow an instance of character
  * in world without including character.h in poke327.h                 */
 
-int32_t cmp_char_turns(const void *key, const void *with);
+/* Turn order: next_turn, then seq_num, so ties go first come, first served. *
+ * key() is the integer part, for pq_wheel.                                  */
+struct char_turn_less {
+  bool operator()(const character *key, const character *with) const
+  {
+    return (key->next_turn < with->next_turn ||
+            (key->next_turn == with->next_turn &&
+             key->seq_num < with->seq_num));
+  }
+
+  static int32_t key(const character *c)
+  {
+    return c->next_turn;
+  }
+};
+
 void delete_character(void *v);
 
-extern void (*move_func[num_movement_types])(character *, pair_t);
+/* id is the mover's row in the current map's npc_store; the PC's *
+ * entry ignores it.                                               */
+extern void (*move_func[num_movement_types])(uint32_t id, pair_t dest);
+
+/* NPCs of a batched movement type due on the same turn can be moved   *
+ * together: move_batch() decides where each of id[0..n) goes, without *
+ * moving anyone, and leaves it in dest.                               */
+bool is_batched(movement_type_t m);
+void move_batch(uint32_t n, const uint32_t id[], pair_t dest[]);
 
 int pc_move(char);
 bool is_pc(character *c);
@@ -14,11 +14,14 @@
 #include "io.h"
 #include "db_parse.h"
 #include "pokemon.h"
-
-typedef struct queue_node {
-  int x, y;
-  struct queue_node *next;
-} queue_node_t;
+#include "path.h"
+#include "mapgen.h"
+#include "sim.h"
+#include "replay.h"
+#include "encounter.h"
+#include "render.h"
+#include "atlas.h"
+#include "spec.h"
 
 char ter_symb[num_terrain_types] = { BOULDER_SYMBOL, TREE_SYMBOL, PATH_SYMBOL, HOUSE_SYMBOL,
                                       SHOP_SYMBOL, TALL_GRASS_SYMBOL, SHORT_GRASS_SYMBOL,
@@ -42,783 +45,177 @@ pair_t all_dirs[8] = {
   {  1,  1 },
 };
 
-static int32_t path_cmp(const void *key, const void *with) {
-  return ((path_t *) key)->cost - ((path_t *) with)->cost;
-}
-
-static int32_t edge_penalty(int8_t x, int8_t y)
+static void make_buddies(npc *c)
 {
-  return (x == 1 || y == 1 || x == MAP_X - 2 || y == MAP_Y - 2) ? 2 : 1;
-}
+  int i;
 
-static void dijkstra_path(map *m, pair_t from, pair_t to)
-{
-  static path_t path[MAP_Y][MAP_X], *p;
-  static uint32_t initialized = 0;
-  heap_t h;
-  int32_t x, y;
+  i = 0;
+  do {
+    c->buddy[i] = new class pokemon();
+    i++;
+  } while ((i < 6) && ((rand() % 100) < ADD_TRAINER_POK_PROB));
+  c->num_buddies = i;
+  for (; i < 6; i++) {
+    c->buddy[i] = NULL;
+  }
+}
 
-  if (!initialized) {
+/* The cells one kind of trainer may still be placed in.  cell[] holds *
+ * the set in no particular order and slot[] says where in cell[] each *
+ * cell is (or -1), so a random cell is one draw and a cell taken by   *
+ * anyone is dropped by moving the last one into its place.  Built     *
+ * once per map; when a set runs dry, placement fails at once instead  *
+ * of after thousands of random probes.                                */
+class spawn_set {
+  std::vector<uint16_t> cell;
+  int16_t slot[MAP_Y * MAP_X];
+
+ public:
+  void build(const map_bits_t &candidates)
+  {
+    int x, y, i;
+
+    cell.clear();
     for (y = 0; y < MAP_Y; y++) {
       for (x = 0; x < MAP_X; x++) {
-        path[y][x].pos[dim_y] = y;
-        path[y][x].pos[dim_x] = x;
-      }
-    }
-    initialized = 1;
-  }
-  
-  for (y = 0; y < MAP_Y; y++) {
-    for (x = 0; x < MAP_X; x++) {
-      path[y][x].cost = INT_MAX;
-    }
-  }
-
-  path[from[dim_y]][from[dim_x]].cost = 0;
-
-  heap_init(&h, path_cmp, NULL);
-
-  for (y = 1; y < MAP_Y - 1; y++) {
-    for (x = 1; x < MAP_X - 1; x++) {
-      path[y][x].hn = heap_insert(&h, &path[y][x]);
-    }
-  }
-
-  while ((p = (path_t *) heap_remove_min(&h))) {
-    p->hn = NULL;
-
-    if ((p->pos[dim_y] == to[dim_y]) && p->pos[dim_x] == to[dim_x]) {
-      for (x = to[dim_x], y = to[dim_y];
-           (x != from[dim_x]) || (y != from[dim_y]);
-           p = &path[y][x], x = p->from[dim_x], y = p->from[dim_y]) {
-        /* Don't overwrite the gate */
-        if (x != to[dim_x] || y != to[dim_y]) {
-          mapxy(x, y) = ter_path;
-          heightxy(x, y) = 0;
+        i = map_bits_t::index(x, y);
+        if (candidates.test(x, y)) {
+          slot[i] = cell.size();
+          cell.push_back(i);
+        } else {
+          slot[i] = -1;
         }
       }
-      heap_delete(&h);
-      return;
-    }
-
-    if ((path[p->pos[dim_y] - 1][p->pos[dim_x]    ].hn) &&
-        (path[p->pos[dim_y] - 1][p->pos[dim_x]    ].cost >
-         ((p->cost + heightpair(p->pos)) *
-          edge_penalty(p->pos[dim_x], p->pos[dim_y] - 1)))) {
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].cost =
-        ((p->cost + heightpair(p->pos)) *
-         edge_penalty(p->pos[dim_x], p->pos[dim_y] - 1));
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] - 1]
-                                           [p->pos[dim_x]    ].hn);
-    }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] - 1].hn) &&
-        (path[p->pos[dim_y]    ][p->pos[dim_x] - 1].cost >
-         ((p->cost + heightpair(p->pos)) *
-          edge_penalty(p->pos[dim_x] - 1, p->pos[dim_y])))) {
-      path[p->pos[dim_y]][p->pos[dim_x] - 1].cost =
-        ((p->cost + heightpair(p->pos)) *
-         edge_penalty(p->pos[dim_x] - 1, p->pos[dim_y]));
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] - 1].hn);
-    }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] + 1].hn) &&
-        (path[p->pos[dim_y]    ][p->pos[dim_x] + 1].cost >
-         ((p->cost + heightpair(p->pos)) *
-          edge_penalty(p->pos[dim_x] + 1, p->pos[dim_y])))) {
-      path[p->pos[dim_y]][p->pos[dim_x] + 1].cost =
-        ((p->cost + heightpair(p->pos)) *
-         edge_penalty(p->pos[dim_x] + 1, p->pos[dim_y]));
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] + 1].hn);
-    }
-    if ((path[p->pos[dim_y] + 1][p->pos[dim_x]    ].hn) &&
-        (path[p->pos[dim_y] + 1][p->pos[dim_x]    ].cost >
-         ((p->cost + heightpair(p->pos)) *
-          edge_penalty(p->pos[dim_x], p->pos[dim_y] + 1)))) {
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].cost =
-        ((p->cost + heightpair(p->pos)) *
-         edge_penalty(p->pos[dim_x], p->pos[dim_y] + 1));
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] + 1]
-                                           [p->pos[dim_x]    ].hn);
     }
   }
-}
-
-static int build_paths(map *m)
-{
-  pair_t from, to;
-
-  /*  printf("%d %d %d %d\n", m->n, m->s, m->e, m->w);*/
 
-  if (m->e != -1 && m->w != -1) {
-    from[dim_x] = 1;
-    to[dim_x] = MAP_X - 2;
-    from[dim_y] = m->w;
-    to[dim_y] = m->e;
-
-    dijkstra_path(m, from, to);
+  bool empty() const
+  {
+    return cell.empty();
   }
 
-  if (m->n != -1 && m->s != -1) {
-    from[dim_y] = 1;
-    to[dim_y] = MAP_Y - 2;
-    from[dim_x] = m->n;
-    to[dim_x] = m->s;
-
-    dijkstra_path(m, from, to);
-  }
+  /* Picks a cell uniformly, leaving it in the set.  Returns zero if *
+   * there are none.                                                 */
+  int pick(pair_t pos) const
+  {
+    int i;
 
-  if (m->e == -1) {
-    if (m->s == -1) {
-      from[dim_x] = 1;
-      from[dim_y] = m->w;
-      to[dim_x] = m->n;
-      to[dim_y] = 1;
-    } else {
-      from[dim_x] = 1;
-      from[dim_y] = m->w;
-      to[dim_x] = m->s;
-      to[dim_y] = MAP_Y - 2;
+    if (cell.empty()) {
+      return 0;
     }
+    i = cell[rand() % cell.size()];
+    pos[dim_x] = i % MAP_X;
+    pos[dim_y] = i / MAP_X;
 
-    dijkstra_path(m, from, to);
+    return 1;
   }
 
-  if (m->w == -1) {
-    if (m->s == -1) {
-      from[dim_x] = MAP_X - 2;
-      from[dim_y] = m->e;
-      to[dim_x] = m->n;
-      to[dim_y] = 1;
-    } else {
-      from[dim_x] = MAP_X - 2;
-      from[dim_y] = m->e;
-      to[dim_x] = m->s;
-      to[dim_y] = MAP_Y - 2;
-    }
+  void remove(const pair_t pos)
+  {
+    int i = map_bits_t::index(pos[dim_x], pos[dim_y]);
 
-    dijkstra_path(m, from, to);
-  }
-
-  if (m->n == -1) {
-    if (m->e == -1) {
-      from[dim_x] = 1;
-      from[dim_y] = m->w;
-      to[dim_x] = m->s;
-      to[dim_y] = MAP_Y - 2;
-    } else {
-      from[dim_x] = MAP_X - 2;
-      from[dim_y] = m->e;
-      to[dim_x] = m->s;
-      to[dim_y] = MAP_Y - 2;
-    }
-
-    dijkstra_path(m, from, to);
-  }
-
-  if (m->s == -1) {
-    if (m->e == -1) {
-      from[dim_x] = 1;
-      from[dim_y] = m->w;
-      to[dim_x] = m->n;
-      to[dim_y] = 1;
-    } else {
-      from[dim_x] = MAP_X - 2;
-      from[dim_y] = m->e;
-      to[dim_x] = m->n;
-      to[dim_y] = 1;
+    if (slot[i] < 0) {
+      return;
     }
-
-    dijkstra_path(m, from, to);
+    cell[slot[i]] = cell.back();
+    slot[cell.back()] = slot[i];
+    slot[i] = -1;
+    cell.pop_back();
   }
-
-  return 0;
-}
-
-static int gaussian[5][5] = {
-  {  1,  4,  7,  4,  1 },
-  {  4, 16, 26, 16,  4 },
-  {  7, 26, 41, 26,  7 },
-  {  4, 16, 26, 16,  4 },
-  {  1,  4,  7,  4,  1 }
 };
 
-static int smooth_height(map *m)
-{
-  int32_t i, x, y;
-  int32_t s, t, p, q;
-  queue_node_t *head, *tail, *tmp;
-  /*  FILE *out;*/
-  uint8_t height[MAP_Y][MAP_X];
-
-  memset(&height, 0, sizeof (height));
-
-  /* Seed with some values */
-  for (i = 1; i < 255; i += 20) {
-    do {
-      x = rand() % MAP_X;
-      y = rand() % MAP_Y;
-    } while (height[y][x]);
-    height[y][x] = i;
-    if (i == 1) {
-      head = tail = (queue_node_t *) malloc(sizeof (*tail));
-    } else {
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-    }
-    tail->next = NULL;
-    tail->x = x;
-    tail->y = y;
-  }
-
-  /*
-  out = fopen("seeded.pgm", "w");
-  fprintf(out, "P5\n%u %u\n255\n", MAP_X, MAP_Y);
-  fwrite(&height, sizeof (height), 1, out);
-  fclose(out);
-  */
-  
-  /* Diffuse the vaules to fill the space */
-  while (head) {
-    x = head->x;
-    y = head->y;
-    i = height[y][x];
+/* Hikers; rivals and everyone else on land; swimmers. */
+static spawn_set spawn_hiker, spawn_rival, spawn_water;
 
-    if (x - 1 >= 0 && y - 1 >= 0 && !height[y - 1][x - 1]) {
-      height[y - 1][x - 1] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x - 1;
-      tail->y = y - 1;
-    }
-    if (x - 1 >= 0 && !height[y][x - 1]) {
-      height[y][x - 1] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x - 1;
-      tail->y = y;
-    }
-    if (x - 1 >= 0 && y + 1 < MAP_Y && !height[y + 1][x - 1]) {
-      height[y + 1][x - 1] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x - 1;
-      tail->y = y + 1;
-    }
-    if (y - 1 >= 0 && !height[y - 1][x]) {
-      height[y - 1][x] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x;
-      tail->y = y - 1;
-    }
-    if (y + 1 < MAP_Y && !height[y + 1][x]) {
-      height[y + 1][x] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x;
-      tail->y = y + 1;
-    }
-    if (x + 1 < MAP_X && y - 1 >= 0 && !height[y - 1][x + 1]) {
-      height[y - 1][x + 1] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x + 1;
-      tail->y = y - 1;
-    }
-    if (x + 1 < MAP_X && !height[y][x + 1]) {
-      height[y][x + 1] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x + 1;
-      tail->y = y;
-    }
-    if (x + 1 < MAP_X && y + 1 < MAP_Y && !height[y + 1][x + 1]) {
-      height[y + 1][x + 1] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x + 1;
-      tail->y = y + 1;
-    }
-
-    tmp = head;
-    head = head->next;
-    free(tmp);
-  }
-
-  /* And smooth it a bit with a gaussian convolution */
-  for (y = 0; y < MAP_Y; y++) {
-    for (x = 0; x < MAP_X; x++) {
-      for (s = t = p = 0; p < 5; p++) {
-        for (q = 0; q < 5; q++) {
-          if (y + (p - 2) >= 0 && y + (p - 2) < MAP_Y &&
-              x + (q - 2) >= 0 && x + (q - 2) < MAP_X) {
-            s += gaussian[p][q];
-            t += height[y + (p - 2)][x + (q - 2)] * gaussian[p][q];
-          }
-        }
-      }
-      m->height[y][x] = t / s;
-    }
-  }
-  /* Let's do it again, until it's smooth like Kenny G. */
-  for (y = 0; y < MAP_Y; y++) {
-    for (x = 0; x < MAP_X; x++) {
-      for (s = t = p = 0; p < 5; p++) {
-        for (q = 0; q < 5; q++) {
-          if (y + (p - 2) >= 0 && y + (p - 2) < MAP_Y &&
-              x + (q - 2) >= 0 && x + (q - 2) < MAP_X) {
-            s += gaussian[p][q];
-            t += height[y + (p - 2)][x + (q - 2)] * gaussian[p][q];
-          }
+const map_bits_t &map_inner(int margin)
+{
+  static map_bits_t inner[4];
+  static int built;
+  int x, y, k;
+
+  if (!built) {
+    for (k = 0; k < 4; k++) {
+      inner[k].clear();
+      for (y = k; y < MAP_Y - k; y++) {
+        for (x = k; x < MAP_X - k; x++) {
+          inner[k].set(x, y);
         }
       }
-      m->height[y][x] = t / s;
     }
+    built = 1;
   }
 
-  /*
-  out = fopen("diffused.pgm", "w");
-  fprintf(out, "P5\n%u %u\n255\n", MAP_X, MAP_Y);
-  fwrite(&height, sizeof (height), 1, out);
-  fclose(out);
-
-  out = fopen("smoothed.pgm", "w");
-  fprintf(out, "P5\n%u %u\n255\n", MAP_X, MAP_Y);
-  fwrite(&m->height, sizeof (m->height), 1, out);
-  fclose(out);
-  */
-
-  return 0;
-}
-
-static void find_building_location(map *m, pair_t p)
-{
-  do {
-    p[dim_x] = rand() % (MAP_X - 3) + 1;
-    p[dim_y] = rand() % (MAP_Y - 3) + 1;
-
-    if ((((mapxy(p[dim_x] - 1, p[dim_y]    ) == ter_path)     &&
-          (mapxy(p[dim_x] - 1, p[dim_y] + 1) == ter_path))    ||
-         ((mapxy(p[dim_x] + 2, p[dim_y]    ) == ter_path)     &&
-          (mapxy(p[dim_x] + 2, p[dim_y] + 1) == ter_path))    ||
-         ((mapxy(p[dim_x]    , p[dim_y] - 1) == ter_path)     &&
-          (mapxy(p[dim_x] + 1, p[dim_y] - 1) == ter_path))    ||
-         ((mapxy(p[dim_x]    , p[dim_y] + 2) == ter_path)     &&
-          (mapxy(p[dim_x] + 1, p[dim_y] + 2) == ter_path)))   &&
-        (((mapxy(p[dim_x]    , p[dim_y]    ) != ter_mart)     &&
-          (mapxy(p[dim_x]    , p[dim_y]    ) != ter_center)   &&
-          (mapxy(p[dim_x] + 1, p[dim_y]    ) != ter_mart)     &&
-          (mapxy(p[dim_x] + 1, p[dim_y]    ) != ter_center)   &&
-          (mapxy(p[dim_x]    , p[dim_y] + 1) != ter_mart)     &&
-          (mapxy(p[dim_x]    , p[dim_y] + 1) != ter_center)   &&
-          (mapxy(p[dim_x] + 1, p[dim_y] + 1) != ter_mart)     &&
-          (mapxy(p[dim_x] + 1, p[dim_y] + 1) != ter_center))) &&
-        (((mapxy(p[dim_x]    , p[dim_y]    ) != ter_path)     &&
-          (mapxy(p[dim_x] + 1, p[dim_y]    ) != ter_path)     &&
-          (mapxy(p[dim_x]    , p[dim_y] + 1) != ter_path)     &&
-          (mapxy(p[dim_x] + 1, p[dim_y] + 1) != ter_path)))) {
-          break;
-    }
-  } while (1);
-}
-
-static int place_pokemart(map *m)
-{
-  pair_t p;
-
-  find_building_location(m, p);
-
-  mapxy(p[dim_x]    , p[dim_y]    ) = ter_mart;
-  mapxy(p[dim_x] + 1, p[dim_y]    ) = ter_mart;
-  mapxy(p[dim_x]    , p[dim_y] + 1) = ter_mart;
-  mapxy(p[dim_x] + 1, p[dim_y] + 1) = ter_mart;
-
-  return 0;
-}
-
-static int place_center(map *m)
-{  pair_t p;
-
-  find_building_location(m, p);
-
-  mapxy(p[dim_x]    , p[dim_y]    ) = ter_center;
-  mapxy(p[dim_x] + 1, p[dim_y]    ) = ter_center;
-  mapxy(p[dim_x]    , p[dim_y] + 1) = ter_center;
-  mapxy(p[dim_x] + 1, p[dim_y] + 1) = ter_center;
-
-  return 0;
+  return inner[margin];
 }
 
-/* Chooses tree or boulder for border cell.  Choice is biased by dominance *
- * of neighboring cells.                                                   */
-static terrain_type_t border_type(map *m, int32_t x, int32_t y)
+/* Clears the cells of b that dist does not reach, visiting set cells only. */
+static void spawn_reachable(map_bits_t *b, const uint16_t dist[MAP_Y][MAP_X])
 {
-  int32_t p, q;
-  int32_t r, t;
-  int32_t miny, minx, maxy, maxx;
-  
-  r = t = 0;
-  
-  miny = y - 1 >= 0 ? y - 1 : 0;
-  maxy = y + 1 <= MAP_Y ? y + 1: MAP_Y;
-  minx = x - 1 >= 0 ? x - 1 : 0;
-  maxx = x + 1 <= MAP_X ? x + 1: MAP_X;
-
-  for (q = miny; q < maxy; q++) {
-    for (p = minx; p < maxx; p++) {
-      if (q != y || p != x) {
-        if (m->map[q][p] == ter_mountain ||
-            m->map[q][p] == ter_boulder) {
-          r++;
-        } else if (m->map[q][p] == ter_forest ||
-                   m->map[q][p] == ter_tree) {
-          t++;
-        }
+  uint64_t v;
+  int i, n;
+
+  for (i = 0; i < map_bits_t::words; i++) {
+    for (v = b->w[i]; v; v &= v - 1) {
+      n = (i << 6) + __builtin_ctzll(v);
+      if (dist[n / MAP_X][n % MAP_X] == DIST_INF) {
+        b->reset(n % MAP_X, n / MAP_X);
       }
     }
   }
-  
-  if (t == r) {
-    return rand() & 1 ? ter_boulder : ter_tree;
-  } else if (t > r) {
-    if (rand() % 10) {
-      return ter_tree;
-    } else {
-      return ter_boulder;
-    }
-  } else {
-    if (rand() % 10) {
-      return ter_boulder;
-    } else {
-      return ter_tree;
-    }
-  }
 }
 
-static int map_terrain(map *m, int8_t n, int8_t s, int8_t e, int8_t w)
+/* Land trainers start at least three cells in from the edge, on free *
+ * cells their own kind can enter and reach the PC from.              */
+static void spawn_build()
 {
-  int32_t i, x, y;
-  queue_node_t *head, *tail, *tmp;
-  //  FILE *out;
-  int num_grass, num_clearing, num_mountain, num_forest, num_water, num_total;
-  terrain_type_t type;
-  int added_current = 0;
-  
-  switch (m->geotype) {
-   case geo_plain:
-    num_grass = rand() % 5 + 3;
-    num_clearing = rand() % 5 + 3;
-    num_mountain = 0;
-    num_forest = rand() % 2;
-    num_water = 0;
-    break;
-   case geo_wet:
-    num_grass = rand() % 3;
-    num_clearing = rand() % 3;
-    num_mountain = 0;
-    num_forest = 0;
-    num_water = rand() % 4 + 3;
-    break;
-   case geo_woods:
-    num_grass = rand() % 2 + 1;
-    num_clearing = rand() % 2;
-    num_mountain = 0;
-    num_forest = rand() % 4 + 2;
-    num_water = rand() % 2;
-    break;
-   case geo_cliffs:
-    num_grass = rand() % 3 + 1;
-    num_clearing = rand() % 3 + 1;
-    num_mountain = rand() % 4 + 2;
-    num_forest = rand() % 2;
-    num_water = rand() % 2;
-    break;
-   case geo_mountain:
-    num_grass = rand() % 2;
-    num_clearing = rand() % 2 + 1;
-    num_mountain = rand() % 5 + 3;
-    num_forest = 0;
-    num_water = rand() % 2;
-   default:
-    num_grass = rand() % 4 + 2;
-    num_clearing = rand() % 4 + 2;
-    num_mountain = rand() % 2 + 1;
-    num_forest = rand() % 2 + 1;
-    num_water = rand() % 2 + 1;
-    break;
-  }
-
-  num_total = num_grass + num_clearing + num_mountain + num_forest + num_water;
-
-  memset(&m->map, 0, sizeof (m->map));
-
-  /* Seed with some values */
-  for (i = 0; i < num_total; i++) {
-    do {
-      x = rand() % MAP_X;
-      y = rand() % MAP_Y;
-    } while (m->map[y][x]);
-    if (i == 0 && num_grass != 0) {
-      type = ter_grass;
-    } else if (i == num_grass && num_clearing != 0) {
-      type = ter_clearing;
-    } else if (i == num_grass + num_clearing && num_mountain != 0) {
-      type = ter_mountain;
-    } else if (i == num_grass + num_clearing + num_mountain && num_forest != 0) {
-      type = ter_forest;
-    } else if (i == num_grass + num_clearing + num_mountain + num_forest && num_water != 0) {
-      type = ter_water;
-    }
-    m->map[y][x] = type;
-    if (i == 0) {
-      head = tail = (queue_node_t *) malloc(sizeof (*tail));
-    } else {
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-    }
-    tail->next = NULL;
-    tail->x = x;
-    tail->y = y;
-  }
-
-  /*
-  out = fopen("seeded.pgm", "w");
-  fprintf(out, "P5\n%u %u\n255\n", MAP_X, MAP_Y);
-  fwrite(&m->map, sizeof (m->map), 1, out);
-  fclose(out);
-  */
-
-  /* Diffuse the vaules to fill the space */
-  while (head) {
-    x = head->x;
-    y = head->y;
-    type = m->map[y][x];
-    
-    if (x - 1 >= 0 && !m->map[y][x - 1]) {
-      if ((rand() % 100) < 80) {
-        m->map[y][x - 1] = type;
-        tail->next = (queue_node_t *) malloc(sizeof (*tail));
-        tail = tail->next;
-        tail->next = NULL;
-        tail->x = x - 1;
-        tail->y = y;
-      } else if (!added_current) {
-        added_current = 1;
-        m->map[y][x] = type;
-        tail->next = (queue_node_t *) malloc(sizeof (*tail));
-        tail = tail->next;
-        tail->next = NULL;
-        tail->x = x;
-        tail->y = y;
-      }
-    }
+  map_bits_t open, hiker, rival;
+  map *m = world.cur_map;
 
-    if (y - 1 >= 0 && !m->map[y - 1][x]) {
-      if ((rand() % 100) < 20) {
-        m->map[y - 1][x] = type;
-        tail->next = (queue_node_t *) malloc(sizeof (*tail));
-        tail = tail->next;
-        tail->next = NULL;
-        tail->x = x;
-        tail->y = y - 1;
-      } else if (!added_current) {
-        added_current = 1;
-        m->map[y][x] = type;
-        tail->next = (queue_node_t *) malloc(sizeof (*tail));
-        tail = tail->next;
-        tail->next = NULL;
-        tail->x = x;
-        tail->y = y;
-      }
-    }
+  pathfind_ensure(dist_hiker);
+  pathfind_ensure(dist_rival);
 
-    if (y + 1 < MAP_Y && !m->map[y + 1][x]) {
-      if ((rand() % 100) < 20) {
-        m->map[y + 1][x] = type;
-        tail->next = (queue_node_t *) malloc(sizeof (*tail));
-        tail = tail->next;
-        tail->next = NULL;
-        tail->x = x;
-        tail->y = y + 1;
-      } else if (!added_current) {
-        added_current = 1;
-        m->map[y][x] = type;
-        tail->next = (queue_node_t *) malloc(sizeof (*tail));
-        tail = tail->next;
-        tail->next = NULL;
-        tail->x = x;
-        tail->y = y;
-      }
-    }
+  open = map_inner(3).without(m->occupied);
+  hiker = open & m->passable[char_hiker];
+  rival = open & m->passable[char_rival];
+  spawn_reachable(&hiker, world.hiker_dist);
+  spawn_reachable(&rival, world.rival_dist);
 
-    if (x + 1 < MAP_X && !m->map[y][x + 1]) {
-      if ((rand() % 100) < 80) {
-        m->map[y][x + 1] = type;
-        tail->next = (queue_node_t *) malloc(sizeof (*tail));
-        tail = tail->next;
-        tail->next = NULL;
-        tail->x = x + 1;
-        tail->y = y;
-      } else if (!added_current) {
-        added_current = 1;
-        m->map[y][x] = type;
-        tail->next = (queue_node_t *) malloc(sizeof (*tail));
-        tail = tail->next;
-        tail->next = NULL;
-        tail->x = x;
-        tail->y = y;
-      }
-    }
-
-    added_current = 0;
-    tmp = head;
-    head = head->next;
-    free(tmp);
-  }
-
-  /*
-  out = fopen("diffused.pgm", "w");
-  fprintf(out, "P5\n%u %u\n255\n", MAP_X, MAP_Y);
-  fwrite(&m->map, sizeof (m->map), 1, out);
-  fclose(out);
-  */
-  
-  for (y = 0; y < MAP_Y; y++) {
-    for (x = 0; x < MAP_X; x++) {
-      if (y == 0 || y == MAP_Y - 1 ||
-          x == 0 || x == MAP_X - 1) {
-        mapxy(x, y) = border_type(m, x, y);
-      }
-    }
-  }
-
-  m->n = n;
-  m->s = s;
-  m->e = e;
-  m->w = w;
-
-  if (n != -1) {
-    mapxy(n,         0        ) = ter_gate;
-    mapxy(n,         1        ) = ter_bailey;
-  }
-  if (s != -1) {
-    mapxy(s,         MAP_Y - 1) = ter_gate;
-    mapxy(s,         MAP_Y - 2) = ter_bailey;
-  }
-  if (w != -1) {
-    mapxy(0,         w        ) = ter_gate;
-    mapxy(1,         w        ) = ter_bailey;
-  }
-  if (e != -1) {
-    mapxy(MAP_X - 1, e        ) = ter_gate;
-    mapxy(MAP_X - 2, e        ) = ter_bailey;
-  }
-
-  return 0;
+  spawn_hiker.build(hiker);
+  spawn_rival.build(rival);
+  spawn_water.build(m->water.without(m->occupied));
 }
 
-static int place_boulders(map *m)
+static int spawn_left()
 {
-  int i;
-  int x, y;
-
-  for (i = 0; i < MIN_BOULDERS || rand() % 100 < BOULDER_PROB; i++) {
-    y = rand() % (MAP_Y - 2) + 1;
-    x = rand() % (MAP_X - 2) + 1;
-    if (m->map[y][x] != ter_forest &&
-        m->map[y][x] != ter_path   &&
-        m->map[y][x] != ter_gate   &&
-        m->map[y][x] != ter_bailey) {
-      m->map[y][x] = ter_boulder;
-    }
-  }
-
-  return 0;
+  return !(spawn_hiker.empty() && spawn_rival.empty() && spawn_water.empty());
 }
 
-static int place_trees(map *m)
+/* Puts c down at pos and takes pos out of every set. */
+static void spawn_place(npc *c, const pair_t pos)
 {
-  int i;
-  int x, y;
-  
-  for (i = 0; i < MIN_TREES || rand() % 100 < TREE_PROB; i++) {
-    y = rand() % (MAP_Y - 2) + 1;
-    x = rand() % (MAP_X - 2) + 1;
-    if (m->map[y][x] != ter_mountain &&
-        m->map[y][x] != ter_path     &&
-        m->map[y][x] != ter_water    &&
-        m->map[y][x] != ter_gate     &&
-        m->map[y][x] != ter_bailey) {
-      m->map[y][x] = ter_tree;
-    }
-  }
-
-  return 0;
-}
-
-void rand_pos(pair_t pos)
-{
-  pos[dim_x] = (rand() % (MAP_X - 2)) + 1;
-  pos[dim_y] = (rand() % (MAP_Y - 2)) + 1;
-}
-
-static void make_buddies(npc *c)
-{
-  int i;
-
-  i = 0;
-  do {
-    c->buddy[i] = new class pokemon();
-    i++;
-  } while ((i < 6) && ((rand() % 100) < ADD_TRAINER_POK_PROB));
-  c->num_buddies = i;
-  for (; i < 6; i++) {
-    c->buddy[i] = NULL;
-  }
+  cmap_put(world.cur_map, pos[dim_y], pos[dim_x], c);
+  spawn_hiker.remove(pos);
+  spawn_rival.remove(pos);
+  spawn_water.remove(pos);
+  c->next_turn = 0;
+  c->seq_num = world.char_seq_num++;
+  world.cur_map->turn.push(c);
+  make_buddies(c);
 }
 
-void new_hiker()
+int new_hiker()
 {
   pair_t pos;
   npc *c;
 
-  do {
-    rand_pos(pos);
-  } while (world.hiker_dist[pos[dim_y]][pos[dim_x]] == DIJKSTRA_PATH_MAX ||
-           world.cur_map->cmap[pos[dim_y]][pos[dim_x]]                   ||
-           pos[dim_x] < 3 || pos[dim_x] > MAP_X - 4                      ||
-           pos[dim_y] < 3 || pos[dim_y] > MAP_Y - 4);
-
-  world.cur_map->cmap[pos[dim_y]][pos[dim_x]] = c = new npc;
-  c->pos[dim_y] = pos[dim_y];
-  c->pos[dim_x] = pos[dim_x];
-  c->ctype = char_hiker;
-  c->mtype = move_hiker;
-  c->dir[dim_x] = 0;
-  c->dir[dim_y] = 0;
-  c->defeated = 0;
+  if (!spawn_hiker.pick(pos)) {
+    return 0;
+  }
+
+  c = world.cur_map->npcs.add(pos, char_hiker, move_hiker, rand());
   c->symbol = HIKER_SYMBOL;
-  c->next_turn = 0;
-  c->seq_num = world.char_seq_num++;
-  heap_insert(&world.cur_map->turn, c);
-  make_buddies(c);
+  spawn_place(c, pos);
+  return 1;
 }
 
 int new_rival()
@@ -826,117 +223,84 @@ int new_rival()
   pair_t pos;
   npc *c;
 
-  int i = 0;
-  do {
-    rand_pos(pos);
+  // Fails in the rare case the PC flies into a small region near the edge.
+  if (!spawn_rival.pick(pos)) {
+    return 0;
+  }
 
-    if(i > TREE_PROB*BOULDER_PROB) //This number could be anything. I used two random definitions to avoid using a magic number.
-    {
-      return 0; // Failed to place a NPC within 9025 attempts.
-    }
-    i++;
-  } while (world.rival_dist[pos[dim_y]][pos[dim_x]] == DIJKSTRA_PATH_MAX ||
-           world.rival_dist[pos[dim_y]][pos[dim_x]] < 0                  ||
-           world.cur_map->cmap[pos[dim_y]][pos[dim_x]]                   ||
-           pos[dim_x] < 3 || pos[dim_x] > MAP_X - 4                      ||
-           pos[dim_y] < 3 || pos[dim_y] > MAP_Y - 4);
-
-  world.cur_map->cmap[pos[dim_y]][pos[dim_x]] = c = new npc;
-  c->pos[dim_y] = pos[dim_y];
-  c->pos[dim_x] = pos[dim_x];
-  c->ctype = char_rival;
-  c->mtype = move_rival;
-  c->dir[dim_x] = 0;
-  c->dir[dim_y] = 0;
-  c->defeated = 0;
+  c = world.cur_map->npcs.add(pos, char_rival, move_rival, rand());
   c->symbol = RIVAL_SYMBOL;
-  c->next_turn = 0;
-  c->seq_num = world.char_seq_num++;
-  heap_insert(&world.cur_map->turn, c);
-  make_buddies(c);
+  spawn_place(c, pos);
+  return 1;
+}
+
+int rand_cell(const map_bits_t &candidates, pair_t pos)
+{
+  uint32_t n;
+  int x, y;
+
+  if (!(n = candidates.count())) {
+    return 0;
+  }
+  candidates.select(rand() % n, &x, &y);
+  pos[dim_x] = x;
+  pos[dim_y] = y;
+
   return 1;
 }
 
 int new_swimmer()
 {
-  pair_t pos;
+  pair_t pos, dir;
   npc *c;
 
-  int i = 0;
-  do {
-    rand_pos(pos);
+  // Fails if every bit of water is taken.
+  if (!spawn_water.pick(pos)) {
+    return 0;
+  }
 
-    if(i > TREE_PROB*BOULDER_PROB) //These numbers happen to multiply to a reasonable value and look funny.
-    {
-      return 0; // Failed to place a swimmer within 9025 attempts.
-    }
-    i++;
-  } while (world.cur_map->map[pos[dim_y]][pos[dim_x]] != ter_water ||
-           world.cur_map->cmap[pos[dim_y]][pos[dim_x]]);
-
-  world.cur_map->cmap[pos[dim_y]][pos[dim_x]] = c = new npc;
-  c->pos[dim_y] = pos[dim_y];
-  c->pos[dim_x] = pos[dim_x];
-  c->ctype = char_swimmer;
-  c->mtype = move_swim;
-  rand_dir(c->dir);
-  c->defeated = 0;
+  c = world.cur_map->npcs.add(pos, char_swimmer, move_swim, rand());
+  rand_dir(dir);
+  world.cur_map->npcs.set_dir(c->id, dir);
   c->symbol = SWIMMER_SYMBOL;
-  c->next_turn = 0;
-  c->seq_num = world.char_seq_num++;
-  heap_insert(&world.cur_map->turn, c);
-  make_buddies(c);
+  spawn_place(c, pos);
   return 1;
 }
 
 int new_char_other()
 {
-  pair_t pos;
+  pair_t pos, dir;
+  movement_type_t mtype;
+  char symbol;
   npc *c;
 
-  int i = 0;
-  do {
-    rand_pos(pos);
+  if (!spawn_rival.pick(pos)) {
+    return 0;
+  }
 
-    if(i > TREE_PROB*BOULDER_PROB) //These numbers happen to multiply to a reasonable value and look funny.
-    {
-      return 0; // Failed to place a swimmer within 9025 attempts.
-    }
-    i++;
-  } while (world.rival_dist[pos[dim_y]][pos[dim_x]] == DIJKSTRA_PATH_MAX ||
-           world.rival_dist[pos[dim_y]][pos[dim_x]] < 0                  ||
-           world.cur_map->cmap[pos[dim_y]][pos[dim_x]]                   ||
-           pos[dim_x] < 3 || pos[dim_x] > MAP_X - 4                      ||
-           pos[dim_y] < 3 || pos[dim_y] > MAP_Y - 4);
-
-  world.cur_map->cmap[pos[dim_y]][pos[dim_x]] = c = new npc;
-  c->pos[dim_y] = pos[dim_y];
-  c->pos[dim_x] = pos[dim_x];
-  c->ctype = char_other;
   switch (rand() % 4) {
   case 0:
-    c->mtype = move_pace;
-    c->symbol = PACER_SYMBOL;
+    mtype = move_pace;
+    symbol = PACER_SYMBOL;
     break;
   case 1:
-    c->mtype = move_wander;
-    c->symbol = WANDERER_SYMBOL;
+    mtype = move_wander;
+    symbol = WANDERER_SYMBOL;
     break;
   case 2:
-    c->mtype = move_sentry;
-    c->symbol = SENTRY_SYMBOL;
+    mtype = move_sentry;
+    symbol = SENTRY_SYMBOL;
     break;
-  case 3:
-    c->mtype = move_explore;
-    c->symbol = EXPLORER_SYMBOL;
+  default:
+    mtype = move_explore;
+    symbol = EXPLORER_SYMBOL;
     break;
   }
-  rand_dir(c->dir);
-  c->defeated = 0;
-  c->next_turn = 0;
-  c->seq_num = world.char_seq_num++;
-  heap_insert(&world.cur_map->turn, c);
-  make_buddies(c);
+  c = world.cur_map->npcs.add(pos, char_other, mtype, rand());
+  c->symbol = symbol;
+  rand_dir(dir);
+  world.cur_map->npcs.set_dir(c->id, dir);
+  spawn_place(c, pos);
   return 1;
 }
 
@@ -944,64 +308,52 @@ void place_characters()
 {
   world.cur_map->num_trainers = 3;
 
-  //Always place a hiker and a rival, then place a random number of others
-  // new_hiker();
-  // new_rival();
-  // new_swimmer();
-  new_hiker(); //Hikers can always be placed
-
-  //Non-hiker placement can fail in the rare instance the pc flies into an small unconnected region near the edge of the map.
-  if(!new_rival()) {--world.cur_map->num_trainers;} 
+  spawn_build();
 
+  //Always place a hiker, a rival and a swimmer, then place a random number of others
+  if(!new_hiker()) {--world.cur_map->num_trainers;}
+  if(!new_rival()) {--world.cur_map->num_trainers;}
   //Swimmer placement can fail if the generated lake is too small to fit every swimmer. 
-  if(!new_swimmer()) {--world.cur_map->num_trainers;} //The first swimmer is guaranteed a lake.
+  if(!new_swimmer()) {--world.cur_map->num_trainers;}
 
-  do {
+  while (spawn_left()) {
     //higher probability of non- hikers and rivals
     switch(rand() % 10) {
     case 0:
-      new_hiker();
+      if(!new_hiker()) {--world.cur_map->num_trainers;}
       break;
     case 1:
-      // new_rival();
       if(!new_rival()) {--world.cur_map->num_trainers;}
       break;
     case 2:
-      // new_swimmer();
       if(!new_swimmer()) {--world.cur_map->num_trainers;} //Checks to see if swimmer was placed.
       break;
     default:
-      // new_char_other();
       if(!new_char_other()) {--world.cur_map->num_trainers;}
       break;
     }
-    /* Game attempts to continue to place trainers until the probability *
-     * roll fails, but if the map is full (or almost full), it's         *
-     * impossible (or very difficult) to continue to add, so we abort if *
-     * we've tried MAX_TRAINER_TRIES times.                              */
-  } while (++world.cur_map->num_trainers < MIN_TRAINERS ||
-           ((rand() % 100) < ADD_TRAINER_PROB));
+    /* Game continues to place trainers until the probability roll  *
+     * fails.  A full map stops it too: once every set is empty, no *
+     * placement can succeed.                                       */
+    if (++world.cur_map->num_trainers >= MIN_TRAINERS &&
+        (rand() % 100) >= ADD_TRAINER_PROB) {
+      break;
+    }
+  }
 }
 
 void init_pc()
 {
-  int x, y;
-
-  do {
-    x = rand() % (MAP_X - 2) + 1;
-    y = rand() % (MAP_Y - 2) + 1;
-  } while (world.cur_map->map[y][x] != ter_path);
-
-  world.pc.pos[dim_x] = x;
-  world.pc.pos[dim_y] = y;
+  rand_cell(world.cur_map->path, world.pc.pos);
   world.pc.symbol = PC_SYMBOL;
 
-  world.cur_map->cmap[y][x] = &world.pc;
+  cmap_put(world.cur_map, world.pc.pos[dim_y], world.pc.pos[dim_x],
+           &world.pc);
   world.pc.next_turn = 0;
 
   world.pc.seq_num = world.char_seq_num++;
 
-  heap_insert(&world.cur_map->turn, &world.pc);
+  world.cur_map->turn.push(&world.pc);
 
   world.pc.bag[inv_revive]		= 5;
   world.pc.bag[inv_potion]		= 5;
@@ -1014,19 +366,26 @@ void place_pc()
 {
   character *c;
 
+  /* Line up with the gate, too; a PC that stepped onto the gate *
+   * diagonally would otherwise land beside it, maybe in a tree. */
   if (world.pc.pos[dim_x] == 1) {
     world.pc.pos[dim_x] = MAP_X - 2;
+    world.pc.pos[dim_y] = world.cur_map->e;
   } else if (world.pc.pos[dim_x] == MAP_X - 2) {
     world.pc.pos[dim_x] = 1;
+    world.pc.pos[dim_y] = world.cur_map->w;
   } else if (world.pc.pos[dim_y] == 1) {
     world.pc.pos[dim_y] = MAP_Y - 2;
+    world.pc.pos[dim_x] = world.cur_map->s;
   } else if (world.pc.pos[dim_y] == MAP_Y - 2) {
     world.pc.pos[dim_y] = 1;
+    world.pc.pos[dim_x] = world.cur_map->n;
   }
 
-  world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = &world.pc;
+  cmap_put(world.cur_map, world.pc.pos[dim_y], world.pc.pos[dim_x],
+           &world.pc);
 
-  if ((c = (character *) heap_peek_min(&world.cur_map->turn))) {
+  if ((c = world.cur_map->turn.top())) {
     world.pc.next_turn = c->next_turn;
   } else {
     world.pc.next_turn = 0;
@@ -1041,13 +400,17 @@ int new_map(int teleport)
   int d, p;
   int e, w, n, s;
   int x, y;
+  phase_t old;
   
   if (world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x]]) {
     world.cur_map = world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x]];
     place_pc();
+    pathfind_invalidate();
+    encounter_map_changed();
 
     return 0;
   }
+  old = phase_enter(phase_mapgen);
 
   world.cur_map = new map;
   world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x]] = world.cur_map;
@@ -1101,14 +464,20 @@ int new_map(int teleport)
   if ((rand() % 100) < p || !d) {
     place_center(world.cur_map);
   }
+  world.cur_map->terrain_version = ++world.terrain_seq_num;
+  map_masks(world.cur_map);
+  atlas_add(world.cur_map, world.cur_idx[dim_x], world.cur_idx[dim_y]);
+  cost_grid(world.cur_map, move_cost[char_hiker],
+            world.cur_map->cost[dist_hiker]);
+  cost_grid(world.cur_map, move_cost[char_rival],
+            world.cur_map->cost[dist_rival]);
 
   for (y = 0; y < MAP_Y; y++) {
     for (x = 0; x < MAP_X; x++) {
       world.cur_map->cmap[y][x] = NULL;
     }
   }
-
-  heap_init(&world.cur_map->turn, cmp_char_turns, delete_character);
+  world.cur_map->occupied.clear();
 
   if ((world.cur_idx[dim_x] == WORLD_SIZE / 2) &&
       (world.cur_idx[dim_y] == WORLD_SIZE / 2)) {
@@ -1117,22 +486,19 @@ int new_map(int teleport)
     place_pc();
   }
 
-  pathfind(world.cur_map);
+  pathfind_invalidate();
   if (teleport) {
-    do {
-      world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = NULL;
-      world.pc.pos[dim_x] = rand_range(1, MAP_X - 2);
-      world.pc.pos[dim_y] = rand_range(1, MAP_Y - 2);
-    } while (world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] ||
-             (move_cost[char_pc][world.cur_map->map[world.pc.pos[dim_y]]
-                                                   [world.pc.pos[dim_x]]] ==
-              DIJKSTRA_PATH_MAX)                                           ||
-             world.rival_dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] < 0);
-    world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = &world.pc;
-    pathfind(world.cur_map);
+    cmap_put(world.cur_map, world.pc.pos[dim_y], world.pc.pos[dim_x], NULL);
+    rand_cell(world.cur_map->passable[char_pc] &
+              map_inner(1).without(world.cur_map->occupied), world.pc.pos);
+    cmap_put(world.cur_map, world.pc.pos[dim_y], world.pc.pos[dim_x],
+             &world.pc);
+    pathfind_invalidate();
   }
   
   place_characters();
+  encounter_map_changed();
+  phase_enter(old);
 
   return 0;
 }
@@ -1266,23 +632,28 @@ void init_world()
   world.quit = 0;
   world.cur_idx[dim_x] = world.cur_idx[dim_y] = WORLD_SIZE / 2;
   world.char_seq_num = 0;
+  atlas_init();
   world_gen();
   new_map(0);
 }
 
 void delete_world()
 {
+  character *c;
   int x, y;
 
   for (y = 0; y < WORLD_SIZE; y++) {
     for (x = 0; x < WORLD_SIZE; x++) {
       if (world.world[y][x]) {
-        heap_delete(&world.cur_map->turn);
+        while ((c = world.world[y][x]->turn.pop())) {
+          delete_character(c);
+        }
         delete world.world[y][x];
         world.world[y][x] = NULL;
       }
     }
   }
+  atlas_delete();
 }
 
 // void print_hiker_dist()
@@ -1332,67 +703,150 @@ void leave_map(pair_t d)
   new_map(0);
 }
 
+static void npc_commit(npc *c, pair_t d)
+{
+  npc_store *s = &world.cur_map->npcs;
+  uint32_t id = c->id;
+
+  cmap_put(world.cur_map, s->pos[dim_y][id], s->pos[dim_x][id], NULL);
+  cmap_put(world.cur_map, d[dim_y], d[dim_x], c);
+
+  c->next_turn += move_cost[s->ctype[id]]
+                           [world.cur_map->map[d[dim_y]][d[dim_x]]];
+
+  s->set_pos(id, d);
+}
+
+/* An NPC's turn runs entirely off its row in the map's npc_store,  *
+ * dispatched on the stored movement type; only the PC is special.  *
+ * A batched c takes every batched NPC queued right behind it for   *
+ * the same turn along with it, and moves them all at once.  Moves  *
+ * are committed in seq_num order, which is the order they came off *
+ * the queue; a mover whose cell was taken by one earlier in the    *
+ * batch stays where it is.                                         */
+int npc_turns(turn_queue_t *q, npc *c)
+{
+  static std::vector<npc *> batch;
+  static std::vector<uint32_t> id;
+  static std::vector<int16_t> dest_xy;
+  npc_store *s = &world.cur_map->npcs;
+  character *next;
+  uint32_t i;
+  pair_t *dest;
+
+  batch.clear();
+  batch.push_back(c);
+  while (is_batched(s->mtype[c->id]) &&
+         (next = q->top()) && !is_pc(next) &&
+         next->next_turn == c->next_turn &&
+         is_batched(s->mtype[((npc *) next)->id])) {
+    batch.push_back((npc *) q->pop());
+  }
+
+  id.resize(batch.size());
+  dest_xy.resize(batch.size() * num_dims);
+  dest = (pair_t *) dest_xy.data();
+  for (i = 0; i < batch.size(); i++) {
+    id[i] = batch[i]->id;
+  }
+
+  if (!spec_decide(batch.size(), id.data(), dest)) {
+    return 0;
+  }
+
+  for (i = 0; i < batch.size(); i++) {
+    if ((dest[i][dim_x] != s->pos[dim_x][id[i]] ||
+         dest[i][dim_y] != s->pos[dim_y][id[i]]) &&
+        world.cur_map->cmap[dest[i][dim_y]][dest[i][dim_x]]) {
+      s->get_pos(id[i], dest[i]);
+    }
+    npc_commit(batch[i], dest[i]);
+    q->push(batch[i]);
+  }
+
+  return 1;
+}
+
+static void pc_turn()
+{
+  pc *c = &world.pc;
+  pair_t d;
+
+  move_func[move_pc](0, d);
+
+  cmap_put(world.cur_map, c->pos[dim_y], c->pos[dim_x], NULL);
+  if (d[dim_x] == 0 || d[dim_x] == MAP_X - 1 ||
+      d[dim_y] == 0 || d[dim_y] == MAP_Y - 1) {
+    leave_map(d);
+    d[dim_x] = c->pos[dim_x];
+    d[dim_y] = c->pos[dim_y];
+  }
+  cmap_put(world.cur_map, d[dim_y], d[dim_x], c);
+
+  pathfind_invalidate();
+
+  c->next_turn += move_cost[char_pc][world.cur_map->map[d[dim_y]][d[dim_x]]];
+
+  if ((c->pos[dim_y] != d[dim_y] || c->pos[dim_x] != d[dim_x]) &&
+      (world.cur_map->map[d[dim_y]][d[dim_x]] == ter_grass) &&
+      (rand() % 100 < ENCOUNTER_PROB)) {
+    io_encounter_pokemon();
+  }
+
+  c->pos[dim_y] = d[dim_y];
+  c->pos[dim_x] = d[dim_x];
+}
+
 void game_loop()
 {
   character *c;
-  npc *n;
-  pc *p;
-  pair_t d;
   
   while (!world.quit) {
-    c = (character *) heap_remove_min(&world.cur_map->turn);
-    n = dynamic_cast<npc *> (c);
-    p = dynamic_cast<pc *> (c);
-
-    move_func[n ? n->mtype : move_pc](c, d);
-
-    world.cur_map->cmap[c->pos[dim_y]][c->pos[dim_x]] = NULL;
-    if (p && (d[dim_x] == 0 || d[dim_x] == MAP_X - 1 ||
-              d[dim_y] == 0 || d[dim_y] == MAP_Y - 1)) {
-      leave_map(d);
-      d[dim_x] = c->pos[dim_x];
-      d[dim_y] = c->pos[dim_y];
-    }
-    world.cur_map->cmap[d[dim_y]][d[dim_x]] = c;
+    c = world.cur_map->turn.pop();
 
-    if (p) {
-      pathfind(world.cur_map);
+    if (!is_pc(c)) {
+      npc_turns(&world.cur_map->turn, (npc *) c);
+      continue;
     }
 
-    c->next_turn += move_cost[n ? n->ctype : char_pc]
-                             [world.cur_map->map[d[dim_y]][d[dim_x]]];
-
-    if (p && (c->pos[dim_y] != d[dim_y] || c->pos[dim_x] != d[dim_x]) &&
-        (world.cur_map->map[d[dim_y]][d[dim_x]] == ter_grass) &&
-        (rand() % 100 < ENCOUNTER_PROB)) {
-      io_encounter_pokemon();
-    }
-
-    c->pos[dim_y] = d[dim_y];
-    c->pos[dim_x] = d[dim_x];
-
-    heap_insert(&world.cur_map->turn, c);
+    pc_turn();
+    world.cur_map->turn.push(c);
   }
 }
 
 void usage(char *s)
 {
-  fprintf(stderr, "Usage: %s [-s|--seed <seed>]\n", s);
+  fprintf(stderr, "Usage: %s [-s|--seed <seed>] "
+          "[-p|--pathfind <dijkstra|chamfer|binary|4ary|pairing>] "
+          "[-r|--roads <dijkstra|binary|4ary|pairing>]\n"
+          "       [-h|--headless [-t|--turns <n>] [-k|--keys <keys>]]\n"
+          "       [--record <log> | --replay <log>] [-f|--fast] [--speculate]\n"
+          "       [--render <curses|null|ansi> | -n|--no-render]\n", s);
 
   exit(1);
 }
 
 int main(int argc, char *argv[])
 {
-  struct timeval tv;
+  struct timeval tv, start;
   uint32_t seed;
   int long_arg;
   int do_seed;
+  uint64_t turns;
+  const char *keys;
+  const char *log;
+  replay_mode_t log_mode;
+  int status;
   //  char c;
   //  int x, y;
-  int i;
+  int i, j;
   
   do_seed = 1;
+  turns = SIM_DEFAULT_TURNS;
+  keys = NULL;
+  log = NULL;
+  log_mode = replay_off;
+  status = 0;
   
   if (argc > 1) {
     for (i = 1, long_arg = 0; i < argc; i++, long_arg = 0) {
@@ -1403,6 +857,10 @@ int main(int argc, char *argv[])
         }
         switch (argv[i][1]) {
         case 's':
+          if (long_arg && !strcmp(argv[i], "-speculate")) {
+            world.speculate = 1;
+            break;
+          }
           if ((!long_arg && argv[i][2]) ||
               (long_arg && strcmp(argv[i], "-seed")) ||
               argc < ++i + 1 /* No more arguments */ ||
@@ -1411,6 +869,100 @@ int main(int argc, char *argv[])
           }
           do_seed = 0;
           break;
+        case 'p':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-pathfind")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          for (j = 0; j < num_pathfind_backends; j++) {
+            if (!strcmp(argv[i], pathfind_backend_name[j])) {
+              pathfind_backend = (pathfind_backend_t) j;
+              break;
+            }
+          }
+          if (j == num_pathfind_backends) {
+            usage(argv[0]);
+          }
+          break;
+        case 'r':
+          if (long_arg && !strcmp(argv[i], "-render")) {
+            if (argc < ++i + 1 /* No more arguments */) {
+              usage(argv[0]);
+            }
+            for (j = 0; j < num_render_backends; j++) {
+              if (!strcmp(argv[i], render_backend_name[j])) {
+                render_backend = (render_backend_t) j;
+                break;
+              }
+            }
+            if (j == num_render_backends) {
+              usage(argv[0]);
+            }
+            break;
+          }
+          if (long_arg && (!strcmp(argv[i], "-record") ||
+                           !strcmp(argv[i], "-replay"))) {
+            log_mode = strcmp(argv[i], "-record") ? replay_play : replay_record;
+            if (argc < ++i + 1 /* No more arguments */) {
+              usage(argv[0]);
+            }
+            log = argv[i];
+            break;
+          }
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-roads")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          for (j = 0; j < num_road_backends; j++) {
+            if (!strcmp(argv[i], road_backend_name[j])) {
+              road_backend = (road_backend_t) j;
+              break;
+            }
+          }
+          if (j == num_road_backends) {
+            usage(argv[0]);
+          }
+          break;
+        case 'h':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-headless"))) {
+            usage(argv[0]);
+          }
+          world.headless = 1;
+          break;
+        case 't':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-turns")) ||
+              argc < ++i + 1 /* No more arguments */ ||
+              sscanf(argv[i], "%lu", &turns) != 1 || !turns) {
+            usage(argv[0]);
+          }
+          break;
+        case 'k':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-keys")) ||
+              argc < ++i + 1 /* No more arguments */ ||
+              !*argv[i]) {
+            usage(argv[0]);
+          }
+          keys = argv[i];
+          break;
+        case 'n':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-no-render"))) {
+            usage(argv[0]);
+          }
+          render_backend = render_null;
+          break;
+        case 'f':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-fast"))) {
+            usage(argv[0]);
+          }
+          world.fast_battle = 1;
+          break;
         default:
           usage(argv[0]);
         }
@@ -1420,6 +972,10 @@ int main(int argc, char *argv[])
     }
   }
 
+  if (log && world.headless) {
+    usage(argv[0]);
+  }
+
   if (do_seed) {
     /* Allows me to start the game more than once *
      * per second, as opposed to time().          */
@@ -1427,13 +983,29 @@ int main(int argc, char *argv[])
     seed = (tv.tv_usec ^ (tv.tv_sec << 20)) & 0xffffffff;
   }
 
+  /* A replay takes its seed from the log. */
+  if (log) {
+    replay_open(log, log_mode, &seed);
+  }
+
   printf("Using seed: %u\n", seed);
   srand(seed);
 
+  phase_enter(phase_load);
   db_parse(false);
-  
-  io_init_terminal();
-  
+  pokemon_init();
+  encounter_init();
+  encounter_start();
+
+  if (world.headless) {
+    sim_init(keys, turns);
+  } else {
+    io_init_terminal();
+  }
+
+  gettimeofday(&start, NULL);
+
+  phase_enter(phase_world);
   init_world();
 
   /* print_hiker_dist(); */
@@ -1500,11 +1072,30 @@ int main(int argc, char *argv[])
 
   */
 
+  if (world.speculate && !world.headless) {
+    spec_start();
+  }
+
+  phase_enter(phase_play);
   game_loop();
-  
-  delete_world();
+  phase_enter(phase_idle);
 
-  io_reset_terminal();
+  spec_stop();
+
+  if (world.headless) {
+    gettimeofday(&tv, NULL);
+    sim_report((tv.tv_sec - start.tv_sec) +
+               (tv.tv_usec - start.tv_usec) / 1000000.0);
+  } else {
+    io_reset_terminal();
+  }
+
+  if (log) {
+    status = replay_close();
+  }
+
+  encounter_stop();
+  delete_world();
   
-  return 0;
+  return status;
 }
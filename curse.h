@@ -8,6 +8,8 @@
 # include "heap.h"
 # include "character.h"
 # include "pair.h"
+# include "pqueue.h"
+# include "bitboard.h"
 
 #define malloc(size) ({                 \
   char *_tmp;                           \
@@ -126,12 +128,46 @@ typedef enum __attribute__ ((__packed__)) geography_type {
 
 extern char geo_symb[num_geo_types];
 
+typedef enum __attribute__ ((__packed__)) dist_map {
+  dist_hiker,
+  dist_rival,
+  num_dist_maps
+} dist_map_t;
+
+/* The turn queue can be any queue from pqueue.h, chosen at build time *
+ * with "make TURN_QUEUE=pq_pairing" and the like.  Turn times only    *
+ * move forward, by a move cost at a time, which suits pq_wheel.       */
+# ifndef TURN_QUEUE
+#  define TURN_QUEUE pq_wheel
+# endif
+typedef TURN_QUEUE<character *, char_turn_less> turn_queue_t;
+
+typedef bitboard<MAP_X, MAP_Y> map_bits_t;
+
 class map {
  public:
   terrain_type_t map[MAP_Y][MAP_X];
   uint8_t height[MAP_Y][MAP_X];
   character *cmap[MAP_Y][MAP_X];
-  heap_t turn;
+  /* Terrain masks, built with the terrain by map_masks(): sight is   *
+   * what swimmers see across (water and path), near_water the cells  *
+   * next to water, swim where swimmers go (water, and path next to   *
+   * it), and passable whatever each character type can enter.        *
+   * occupied mirrors cmap; write cmap with cmap_put().               */
+  map_bits_t water, path, sight, near_water, swim;
+  map_bits_t passable[num_character_types];
+  map_bits_t occupied;
+  /* Swimmers' line of sight, filled in a cell at a time by can_see(): *
+   * view[view_slot[y][x]] is every swimmable cell in sight of (x, y), *
+   * or view_slot[y][x] is -1 until a swimmer looks toward there.      */
+  std::vector<map_bits_t> view;
+  int16_t view_slot[MAP_Y][MAP_X];
+  turn_queue_t turn;
+  npc_store npcs;
+  /* Bumped whenever terrain changes; keys cached distance maps. */
+  uint32_t terrain_version;
+  /* Per-cell hiker and rival move costs, rebuilt with the terrain. */
+  uint8_t cost[num_dist_maps][MAP_Y][MAP_X];
   int32_t num_trainers;
   int8_t n, s, e, w;
 	geo_type_t geotype;
@@ -145,14 +181,31 @@ class world {
   map *cur_map;
   /* Please distance maps in world, not map, since *
    * we only need one pair at any given time.      */
-  int hiker_dist[MAP_Y][MAP_X];
-  int rival_dist[MAP_Y][MAP_X];
+  uint16_t hiker_dist[MAP_Y][MAP_X];
+  uint16_t rival_dist[MAP_Y][MAP_X];
+  /* Distance maps are computed on demand from the PC position at the *
+   * time they were invalidated; see pathfind_ensure().               */
+  int dist_valid[num_dist_maps];
+  pair_t dist_from;
   class pc pc;
   int quit;
+  /* No terminal; see sim.h. */
+  int headless;
+  /* No pauses for effect in battles or the bag. */
+  int fast_battle;
+  /* Work out NPC turns while waiting on keys; see spec.h. */
+  int speculate;
   int add_trainer_prob;
   int char_seq_num;
+  uint32_t terrain_seq_num;
 };
 
+static inline void cmap_put(map *m, int y, int x, character *c)
+{
+  m->cmap[y][x] = c;
+  m->occupied.put(x, y, c);
+}
+
 /* Even unallocated, a WORLD_SIZE x WORLD_SIZE array of pointers is a very *
  * large thing to put on the stack.  To avoid that, world is a global.     */
 extern class world world;
@@ -165,6 +218,13 @@ extern pair_t all_dirs[8];
   dir[1] = all_dirs[_i][1]; \
 }
 
+/* rand_dir(), drawing from *seed with rand_r(). */
+#define rand_dir_r(dir, seed) {   \
+  int _i = rand_r(seed) & 0x7;    \
+  dir[0] = all_dirs[_i][0];       \
+  dir[1] = all_dirs[_i][1];       \
+}
+
 typedef struct path {
   heap_node_t *hn;
   uint8_t pos[2];
@@ -173,6 +233,17 @@ typedef struct path {
 } path_t;
 
 int new_map(int teleport);
-void pathfind(map *m);
+/* The cells at least margin (at most 3) in from every edge. */
+const map_bits_t &map_inner(int margin);
+/* Picks one of the set cells in candidates, uniformly.  Returns zero if *
+ * there are none.                                                       */
+int rand_cell(const map_bits_t &candidates, pair_t pos);
+/* Plays the turn of c, just taken off q, and puts c and any NPCs that *
+ * moved with it back on q.  Returns zero, with nothing moved and none *
+ * of them back on q, if the turn can't be worked out ahead of time;   *
+ * that only happens while speculating (see spec.h).                  */
+int npc_turns(turn_queue_t *q, npc *c);
+void pathfind_invalidate();
+void pathfind_ensure(dist_map_t d);
 
 #endif
@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <vector>
+
+#include "encounter.h"
+#include "db_parse.h"
+#include "pokemon.h"
+
+static_assert(ENCOUNTER_SPECIES == sizeof (species) / sizeof (species[0]) - 1,
+              "ENCOUNTER_SPECIES must match the species table");
+
+/* Species the database gives no habitat (everything after the fourth *
+ * generation) are habitat 0.                                         */
+#define NUM_HABITATS 10
+
+/* How strongly each geotype favors each habitat: none, cave, forest, *
+ * grassland, mountain, rare, rough-terrain, sea, urban, waters-edge. *
+ * Nothing is ruled out anywhere.                                     */
+static const int habitat_weight[num_geo_types][NUM_HABITATS] = {
+  { 4, 2, 4, 4, 2, 1, 4, 1, 1, 3 }, /* geo_wild */
+  { 3, 1, 2, 8, 1, 1, 2, 1, 2, 3 }, /* geo_plain */
+  { 3, 1, 2, 2, 1, 1, 1, 8, 1, 8 }, /* geo_wet */
+  { 3, 2, 8, 3, 2, 1, 2, 1, 1, 2 }, /* geo_woods */
+  { 3, 6, 1, 1, 6, 1, 6, 1, 1, 1 }, /* geo_cliffs */
+  { 3, 6, 1, 1, 8, 1, 4, 1, 1, 1 }, /* geo_mountain */
+  { 3, 1, 2, 3, 1, 1, 1, 1, 8, 2 }, /* geo_town */
+};
+
+/* Added to every capture rate (3 to 255) per band out from the center, *
+ * so a species' odds go from its capture rate near the center toward  *
+ * even farther out.                                                   */
+#define CAPTURE_RATE_BAND_BONUS 85
+/* For species the database gives no capture rate. */
+#define CAPTURE_RATE_DEFAULT    45
+
+/* Entry i of a table is taken on a draw of i with probability         *
+ * cut[i] / (RAND_MAX + 1), otherwise alias[i] is; both are species    *
+ * indices less one.                                                   */
+typedef struct alias_table {
+  uint32_t cut[ENCOUNTER_SPECIES];
+  uint16_t alias[ENCOUNTER_SPECIES];
+} alias_table_t;
+
+static alias_table_t table[num_geo_types][ENCOUNTER_BANDS];
+
+/* Vose's alias method.  Scaled so they average one, weights below one  *
+ * are topped up from weights above one, each small entry taking the    *
+ * rest of its column from one large entry; a large entry drops into    *
+ * the small list once it has given enough away.  Whatever is left in   *
+ * either list at the end is one up to rounding.                        */
+static void alias_build(alias_table_t *t, const double weight[])
+{
+  std::vector<int> small, large;
+  double p[ENCOUNTER_SPECIES];
+  double total;
+  int i, s, l;
+
+  for (total = 0, i = 0; i < ENCOUNTER_SPECIES; i++) {
+    total += weight[i];
+  }
+  for (i = 0; i < ENCOUNTER_SPECIES; i++) {
+    p[i] = weight[i] * ENCOUNTER_SPECIES / total;
+    (p[i] < 1.0 ? small : large).push_back(i);
+  }
+
+  while (!small.empty() && !large.empty()) {
+    s = small.back();
+    small.pop_back();
+    l = large.back();
+    t->cut[s] = p[s] * ((double) RAND_MAX + 1);
+    t->alias[s] = l;
+    p[l] -= 1.0 - p[s];
+    if (p[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  for (i = 0; i < (int) small.size(); i++) {
+    t->cut[small[i]] = (uint32_t) RAND_MAX + 1;
+    t->alias[small[i]] = small[i];
+  }
+  for (i = 0; i < (int) large.size(); i++) {
+    t->cut[large[i]] = (uint32_t) RAND_MAX + 1;
+    t->alias[large[i]] = large[i];
+  }
+}
+
+void encounter_init()
+{
+  double weight[ENCOUNTER_SPECIES];
+  int g, b, i, h, c;
+
+  for (g = 0; g < num_geo_types; g++) {
+    for (b = 0; b < ENCOUNTER_BANDS; b++) {
+      for (i = 0; i < ENCOUNTER_SPECIES; i++) {
+        h = species[i + 1].habitat_id;
+        if (h < 0 || h >= NUM_HABITATS) {
+          h = 0;
+        }
+        c = species[i + 1].capture_rate;
+        if (c <= 0 || c == INT_MAX) {
+          c = CAPTURE_RATE_DEFAULT;
+        }
+        weight[i] = habitat_weight[g][h] * (c + b * CAPTURE_RATE_BAND_BONUS);
+      }
+      alias_build(&table[g][b], weight);
+    }
+  }
+}
+
+int encounter_band(int md)
+{
+  return (md / ENCOUNTER_BAND_WIDTH < ENCOUNTER_BANDS ?
+          md / ENCOUNTER_BAND_WIDTH : ENCOUNTER_BANDS - 1);
+}
+
+int encounter_species(geo_type_t g, int b, unsigned *seed)
+{
+  alias_table_t *t = &table[g][b];
+  int i;
+
+  i = rand_r(seed) % ENCOUNTER_SPECIES;
+
+  return 1 + ((uint32_t) rand_r(seed) < t->cut[i] ? i : t->alias[i]);
+}
+
+const char *encounter_species_name(int s)
+{
+  return species[s].identifier;
+}
+
+double encounter_chance(geo_type_t g, int b, int s)
+{
+  alias_table_t *t = &table[g][b];
+  double p;
+  int i;
+
+  p = t->cut[s - 1] / ((double) RAND_MAX + 1);
+  for (i = 0; i < ENCOUNTER_SPECIES; i++) {
+    if (t->alias[i] == s - 1 && i != s - 1) {
+      p += 1.0 - t->cut[i] / ((double) RAND_MAX + 1);
+    }
+  }
+
+  return p / ENCOUNTER_SPECIES;
+}
+
+/* The buffer is a ring of count pokemon from head, all rolled for *
+ * generation gen.  One lock and one condition cover both ends.    */
+static struct {
+  class pokemon *p[ENCOUNTER_BUFFER];
+  int head, count;
+  uint32_t gen;
+  geo_type_t geotype;
+  int md;
+  unsigned seed;
+  int running, stop;
+} buffer;
+
+static pthread_t producer;
+static pthread_mutex_t buffer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t buffer_changed = PTHREAD_COND_INITIALIZER;
+
+/* Rolls with the lock dropped.  A map change in the meantime bumps *
+ * gen and reseeds, and the roll in hand is thrown away.            */
+static void *encounter_produce(void *unused)
+{
+  class pokemon *p;
+  geo_type_t g;
+  uint32_t gen;
+  unsigned seed;
+  int md;
+
+  pthread_mutex_lock(&buffer_lock);
+  while (!buffer.stop) {
+    if (!buffer.gen || buffer.count == ENCOUNTER_BUFFER) {
+      pthread_cond_wait(&buffer_changed, &buffer_lock);
+      continue;
+    }
+    gen = buffer.gen;
+    g = buffer.geotype;
+    md = buffer.md;
+    seed = buffer.seed;
+    pthread_mutex_unlock(&buffer_lock);
+
+    p = wild_pokemon(g, md, &seed);
+
+    pthread_mutex_lock(&buffer_lock);
+    if (gen == buffer.gen) {
+      buffer.p[(buffer.head + buffer.count++) % ENCOUNTER_BUFFER] = p;
+      buffer.seed = seed;
+      pthread_cond_broadcast(&buffer_changed);
+    } else {
+      delete p;
+    }
+  }
+  pthread_mutex_unlock(&buffer_lock);
+
+  return unused;
+}
+
+/* Drops everything buffered; the lock must be held. */
+static void encounter_flush()
+{
+  for (; buffer.count; buffer.count--) {
+    delete buffer.p[buffer.head];
+    buffer.head = (buffer.head + 1) % ENCOUNTER_BUFFER;
+  }
+  buffer.head = 0;
+}
+
+void encounter_start()
+{
+  /* Without a producer, encounter_next() rolls for itself. */
+  buffer.running = !pthread_create(&producer, NULL, encounter_produce, NULL);
+}
+
+void encounter_stop()
+{
+  pthread_mutex_lock(&buffer_lock);
+  buffer.stop = 1;
+  pthread_cond_broadcast(&buffer_changed);
+  pthread_mutex_unlock(&buffer_lock);
+
+  if (buffer.running) {
+    pthread_join(producer, NULL);
+    buffer.running = 0;
+  }
+  encounter_flush();
+}
+
+void encounter_map_changed()
+{
+  pthread_mutex_lock(&buffer_lock);
+  encounter_flush();
+  buffer.gen++;
+  buffer.geotype = world.cur_map->geotype;
+  buffer.md = (abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)) +
+               abs(world.cur_idx[dim_y] - (WORLD_SIZE / 2)));
+  buffer.seed = rand();
+  pthread_cond_broadcast(&buffer_changed);
+  pthread_mutex_unlock(&buffer_lock);
+}
+
+class pokemon *encounter_next()
+{
+  class pokemon *p;
+
+  pthread_mutex_lock(&buffer_lock);
+  if (!buffer.running) {
+    p = wild_pokemon(buffer.geotype, buffer.md, &buffer.seed);
+  } else {
+    while (!buffer.count) {
+      pthread_cond_wait(&buffer_changed, &buffer_lock);
+    }
+    p = buffer.p[buffer.head];
+    buffer.head = (buffer.head + 1) % ENCOUNTER_BUFFER;
+    buffer.count--;
+    pthread_cond_broadcast(&buffer_changed);
+  }
+  pthread_mutex_unlock(&buffer_lock);
+
+  return p;
+}
@@ -0,0 +1,49 @@
+#ifndef ENCOUNTER_H
+# define ENCOUNTER_H
+
+# include <stdint.h>
+
+# include "curse.h"
+
+/* Wild encounter tables.  Which species turn up in the tall grass      *
+ * depends on the kind of map (each geotype favors some habitats over   *
+ * others) and on how far the map is from the center of the world      *
+ * (near the center, species that are easy to catch crowd out the rare *
+ * ones; farther out, the odds even out).  There is a table for every   *
+ * geotype and distance band, built once at load as a Walker/Vose      *
+ * alias table, so a draw is one index and one comparison whatever the *
+ * weights.                                                             */
+/* Species 1 through ENCOUNTER_SPECIES; species[0] is unused. */
+# define ENCOUNTER_SPECIES    898
+# define ENCOUNTER_BANDS      4
+# define ENCOUNTER_BAND_WIDTH 100
+
+/* Builds every table from the species database; call after db_parse(). */
+void encounter_init();
+/* The band for a map md maps from the center, by Manhattan distance. */
+int encounter_band(int md);
+/* Draws a species index for a map of type g in band b with rand_r(seed). */
+int encounter_species(geo_type_t g, int b, unsigned *seed);
+/* The chance, out of 1, that a draw from table (g, b) gives species s, *
+ * recovered from the alias table itself.                               */
+double encounter_chance(geo_type_t g, int b, int s);
+const char *encounter_species_name(int s);
+
+/* Wild pokemon for the current map are rolled ahead of time on a       *
+ * thread of their own, ENCOUNTER_BUFFER at a time, so an encounter     *
+ * has one ready.  Every map change throws out whatever was rolled and  *
+ * takes a new seed from rand() for the next run of rolls; the rolls    *
+ * come out of that seed in order, and encounter_next() hands them out  *
+ * in the same order, waiting for the next one if need be, so the game  *
+ * plays out the same however the threads are scheduled.               */
+# define ENCOUNTER_BUFFER     4
+
+/* Starts the producer; call after encounter_init(). */
+void encounter_start();
+void encounter_stop();
+/* Call whenever the current map changes. */
+void encounter_map_changed();
+/* The next wild pokemon for the current map, the caller's to delete. */
+class pokemon *encounter_next();
+
+#endif
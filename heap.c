@@ -15,6 +15,17 @@ struct heap_node {
   uint32_t mark;
 };
 
+/* Nodes come from slabs owned by the heap and go back onto the heap's *
+ * free list when removed, so once a heap has seen its peak size (or   *
+ * been sized with heap_reserve()) it never calls the allocator again. */
+struct heap_slab {
+  struct heap_slab *next;
+  uint32_t count;
+  heap_node_t node[];
+};
+
+#define HEAP_SLAB_MIN 64
+
 #define swap(a, b) ({    \
   typeof (a) _tmp = (a); \
   (a) = (b);             \
@@ -99,6 +110,63 @@ void heap_init(heap_t *h,
   h->size = 0;
   h->compare = compare;
   h->datum_delete = datum_delete;
+  h->free = NULL;
+  h->slabs = NULL;
+  h->capacity = 0;
+}
+
+static struct heap_slab *heap_new_slab(heap_t *h, uint32_t count)
+{
+  struct heap_slab *s;
+
+  assert((s = malloc(sizeof (*s) + count * sizeof (s->node[0]))));
+  s->count = count;
+  s->next = h->slabs;
+  h->slabs = s;
+  h->capacity += count;
+
+  return s;
+}
+
+static void heap_grow(heap_t *h, uint32_t count)
+{
+  struct heap_slab *s;
+  uint32_t i;
+
+  s = heap_new_slab(h, count);
+  for (i = 0; i < count; i++) {
+    s->node[i].next = h->free;
+    h->free = &s->node[i];
+  }
+}
+
+int heap_reserve(heap_t *h, uint32_t count)
+{
+  if (h->capacity < h->size + count) {
+    heap_grow(h, h->size + count - h->capacity);
+  }
+
+  return 0;
+}
+
+static heap_node_t *heap_node_alloc(heap_t *h)
+{
+  heap_node_t *n;
+
+  if (!h->free) {
+    heap_grow(h, h->capacity > HEAP_SLAB_MIN ? h->capacity : HEAP_SLAB_MIN);
+  }
+  n = h->free;
+  h->free = n->next;
+  memset(n, 0, sizeof (*n));
+
+  return n;
+}
+
+static void heap_node_free(heap_t *h, heap_node_t *n)
+{
+  n->next = h->free;
+  h->free = n;
 }
 
 void heap_node_delete(heap_t *h, heap_node_t *hn)
@@ -114,18 +182,31 @@ void heap_node_delete(heap_t *h, heap_node_t *hn)
     if (h->datum_delete) {
       h->datum_delete(hn->datum);
     }
-    free(hn);
+    heap_node_free(h, hn);
     hn = next;
   }
 }
 
-void heap_delete(heap_t *h)
+void heap_reset(heap_t *h)
 {
   if (h->min) {
     heap_node_delete(h, h->min);
   }
   h->min = NULL;
   h->size = 0;
+}
+
+void heap_delete(heap_t *h)
+{
+  struct heap_slab *s;
+
+  heap_reset(h);
+  while ((s = h->slabs)) {
+    h->slabs = s->next;
+    free(s);
+  }
+  h->free = NULL;
+  h->capacity = 0;
   h->compare = NULL;
   h->datum_delete = NULL;
 }
@@ -134,7 +215,7 @@ heap_node_t *heap_insert(heap_t *h, void *v)
 {
   heap_node_t *n;
 
-  assert((n = calloc(1, sizeof (*n))));
+  n = heap_node_alloc(h);
   n->datum = v;
 
   if (h->min) {
@@ -150,6 +231,75 @@ heap_node_t *heap_insert(heap_t *h, void *v)
   return n;
 }
 
+/* Finds count contiguous nodes for heap_build().  An empty heap owns *
+ * all of its nodes, so if one of its slabs is big enough, that slab  *
+ * is used and the free list rebuilt from everything else.            */
+static heap_node_t *heap_take_contiguous(heap_t *h, uint32_t count)
+{
+  struct heap_slab *s, *use;
+  uint32_t i;
+
+  use = NULL;
+  if (!h->size) {
+    for (s = h->slabs; s && !use; s = s->next) {
+      if (s->count >= count) {
+        use = s;
+      }
+    }
+  }
+  if (!use) {
+    return heap_new_slab(h, count)->node;
+  }
+
+  h->free = NULL;
+  for (s = h->slabs; s; s = s->next) {
+    for (i = (s == use) ? count : 0; i < s->count; i++) {
+      s->node[i].next = h->free;
+      h->free = &s->node[i];
+    }
+  }
+
+  return use->node;
+}
+
+/* Inserts count items at once.  The nodes are contiguous, and each is  *
+ * linked exactly as heap_insert() would link it, so the result is the  *
+ * same heap that count inserts would give, built in one linear pass    *
+ * with at most one allocation.  If handles is not NULL, it gets the    *
+ * node of each item, for heap_decrease_key_no_replace().               */
+int heap_build(heap_t *h, void *const items[], uint32_t count,
+               heap_node_t *handles[])
+{
+  heap_node_t *node, *n;
+  uint32_t i;
+
+  if (!count) {
+    return 0;
+  }
+
+  node = heap_take_contiguous(h, count);
+  memset(node, 0, count * sizeof (*node));
+
+  for (i = 0; i < count; i++) {
+    n = &node[i];
+    n->datum = items[i];
+    if (h->min) {
+      insert_heap_node_in_list(n, h->min);
+    } else {
+      n->next = n->prev = n;
+    }
+    if (!h->min || (h->compare(n->datum, h->min->datum) < 0)) {
+      h->min = n;
+    }
+    if (handles) {
+      handles[i] = n;
+    }
+  }
+  h->size += count;
+
+  return 0;
+}
+
 void *heap_peek_min(heap_t *h)
 {
   return h->min ? h->min->datum : NULL;
@@ -220,7 +370,7 @@ void *heap_remove_min(heap_t *h)
   if (h->min) {
     v = h->min->datum;
     if (h->size == 1) {
-      free(h->min);
+      heap_node_free(h, h->min);
       h->min = NULL;
     } else {
       if ((n = h->min->child)) {
@@ -234,7 +384,7 @@ void *heap_remove_min(heap_t *h)
       n = h->min;
       remove_heap_node_from_list(n);
       h->min = n->next;
-      free(n);
+      heap_node_free(h, n);
 
       heap_consolidate(h);
     }
@@ -247,6 +397,9 @@ void *heap_remove_min(heap_t *h)
 
 int heap_combine(heap_t *h, heap_t *h1, heap_t *h2)
 {
+  struct heap_slab *s;
+  heap_node_t *n;
+
   if (h1->compare != h2->compare ||
       h1->datum_delete != h2->datum_delete) {
     return 1;
@@ -255,6 +408,27 @@ int heap_combine(heap_t *h, heap_t *h1, heap_t *h2)
   h->compare = h1->compare;
   h->datum_delete = h1->datum_delete;
 
+  /* The combined heap owns both pools. */
+  if ((s = h1->slabs)) {
+    while (s->next) {
+      s = s->next;
+    }
+    s->next = h2->slabs;
+    h->slabs = h1->slabs;
+  } else {
+    h->slabs = h2->slabs;
+  }
+  if ((n = h1->free)) {
+    while (n->next) {
+      n = n->next;
+    }
+    n->next = h2->free;
+    h->free = h1->free;
+  } else {
+    h->free = h2->free;
+  }
+  h->capacity = h1->capacity + h2->capacity;
+
   if (!h1->min) {
     h->min = h2->min;
     h->size = h2->size;
@@ -265,6 +439,7 @@ int heap_combine(heap_t *h, heap_t *h1, heap_t *h2)
     h->min = ((h->compare(h1->min->datum, h2->min->datum) < 0) ?
               h1->min                                          :
               h2->min);
+    h->size = h1->size + h2->size;
     splice_heap_node_lists(h1->min, h2->min);
   }
 
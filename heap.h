@@ -10,18 +10,30 @@ extern "C" {
 struct heap_node;
 typedef struct heap_node heap_node_t;
 
+struct heap_slab;
+
 typedef struct heap {
   heap_node_t *min;
   uint32_t size;
   int32_t (*compare)(const void *key, const void *with);
   void (*datum_delete)(void *);
+  heap_node_t *free;
+  struct heap_slab *slabs;
+  uint32_t capacity;
 } heap_t;
 
 void heap_init(heap_t *h,
                int32_t (*compare)(const void *key, const void *with),
                void (*datum_delete)(void *));
 void heap_delete(heap_t *h);
+/* Empties the heap but keeps its nodes for reuse. */
+void heap_reset(heap_t *h);
+/* Ensures count more inserts can happen without allocating. */
+int heap_reserve(heap_t *h, uint32_t count);
 heap_node_t *heap_insert(heap_t *h, void *v);
+/* Inserts count items in one linear pass over contiguous nodes. */
+int heap_build(heap_t *h, void *const items[], uint32_t count,
+               heap_node_t *handles[]);
 void *heap_peek_min(heap_t *h);
 void *heap_remove_min(heap_t *h);
 int heap_combine(heap_t *h, heap_t *h1, heap_t *h2);
@@ -3,33 +3,150 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <string.h>
 #include <string>
+#include <atomic>
+#include <vector>
 
 #include "io.h"
 #include "pair.h"
 #include "character.h"
 #include "curse.h"
 #include "pokemon.h"
+#include "sim.h"
+#include "replay.h"
+#include "encounter.h"
+#include "render.h"
+#include "atlas.h"
+#include "spec.h"
 
 #define TRAINER_LIST_FIELD_WIDTH 46
 
 #define FLEE_CHANCE  50
 
+/* Messages wait in a ring of preformatted slots; nothing is allocated. *
+ * Each slot leaves room to print " --more-- " after it when another    *
+ * message follows.  A full ring makes room: a message repeating the    *
+ * newest one is counted against it and shown once as "(xN)", and any   *
+ * other takes the place of the oldest.                                 */
+#define IO_MESSAGE_SLOTS 32 /* Power of two */
+#define IO_MESSAGE_LEN   71
+
 typedef struct io_message {
-  /* Will print " --more-- " at end of line when another message follows. *
-   * Leave 10 extra spaces for that.                                      */
-  char msg[71];
-  struct io_message *next;
+  char msg[IO_MESSAGE_LEN];
+  uint16_t repeat;
 } io_message_t;
 
-static io_message_t *io_head, *io_tail;
+/* Slots head up to (not including) tail, counting up forever. */
+static io_message_t io_ring[IO_MESSAGE_SLOTS];
+static uint32_t io_head, io_tail;
+
+/* A second, single-producer single-consumer ring for one thread other *
+ * than the game's to post to without locking: only the poster writes *
+ * io_posted_tail, only the game io_posted_head, and each publishes    *
+ * the slots it is done with by storing its index last.  The poster    *
+ * cannot take slots back from the game, so when this ring is full a   *
+ * post is dropped and counted instead.                                */
+static char io_posted[IO_MESSAGE_SLOTS][IO_MESSAGE_LEN];
+static std::atomic<uint32_t> io_posted_head, io_posted_tail, io_posted_lost;
+
+/* A key pushed back by the game itself.  Kept here rather than with *
+ * ungetch() so it is neither recorded nor expected in a replay.     */
+static int io_pending = ERR;
+
+/* Blocking reads fail only once there is no more input, as when the *
+ * keys piped to the null or ansi backend run out.  The first read    *
+ * after that is answered with 'Q', which ends the game from the PC's *
+ * turn; a read after that is from something else still waiting on a *
+ * key, so the game stops right there, as a replay log ending early   *
+ * does.                                                              */
+static int io_input_gone()
+{
+  static int quit_sent;
+
+  if (!quit_sent++) {
+    world.quit = 1;
+    return 'Q';
+  }
+
+  io_reset_terminal();
+  fprintf(stderr, "input ended before the game did\n");
+
+  exit(1);
+}
+
+/* Every key the game reads comes through here, so that it can be   *
+ * recorded, or taken from the log when replaying.  Reads from w if *
+ * given, else from stdscr.                                         */
+static int io_getch(WINDOW *w)
+{
+  int key;
+
+  if (io_pending != ERR) {
+    key = io_pending;
+    io_pending = ERR;
+    return key;
+  }
+
+  if (replay_mode == replay_play) {
+    /* render_getch() would have refreshed the window first. */
+    render_refresh(w);
+    return replay_key();
+  }
+
+  if ((key = render_getch(w)) == ERR) {
+    key = io_input_gone();
+  }
+  if (replay_mode == replay_record) {
+    replay_record_key(key);
+  }
+
+  return key;
+}
+
+static void io_ungetch(int key)
+{
+  io_pending = key;
+}
+
+/* Reads the key for the PC's turn, playing ahead while we wait on it. *
+ * A key already in hand, or in the log, is not worth the bother.      */
+static int io_getch_turn()
+{
+  int key;
+
+  if (io_pending != ERR || replay_mode == replay_play) {
+    return io_getch(NULL);
+  }
+
+  spec_begin();
+  key = io_getch(NULL);
+  spec_end();
+
+  return key;
+}
+
+/* Pauses for effect, except in fast battles, when replaying as fast *
+ * as we can, or when nobody is watching.                            */
+static void io_delay(useconds_t usec)
+{
+  if (!world.fast_battle && replay_mode != replay_play &&
+      render_backend != render_null) {
+    usleep(usec);
+  }
+}
+
+/* Battles and the bag come up again and again.  Rather than a new *
+ * window every time, each keeps one, opened on first use and made *
+ * blank again on every use after; hide_popup() takes it down.     */
+static WINDOW *io_battle_win, *io_bag_win;
 
 void io_init_terminal(void)
 {
-  initscr();
+  render_init();
   cbreak();
   noecho();
-  curs_set(0);
+  render_cursor(0);
   keypad(stdscr, TRUE);
   start_color();
 		init_pair(COLOR_RED, COLOR_RED, COLOR_BLACK);
@@ -43,62 +160,139 @@ void io_init_terminal(void)
 
 void io_reset_terminal(void)
 {
-  endwin();
+  if (io_battle_win) {
+    delwin(io_battle_win);
+    io_battle_win = NULL;
+  }
+  if (io_bag_win) {
+    delwin(io_bag_win);
+    io_bag_win = NULL;
+  }
+  render_end();
 
-  while (io_head) {
-    io_tail = io_head;
-    io_head = io_head->next;
-    free(io_tail);
+  io_head = io_tail = 0;
+  io_posted_head.store(io_posted_tail.load(std::memory_order_acquire),
+                       std::memory_order_release);
+}
+
+static void io_ring_put(const char *msg)
+{
+  io_message_t *m;
+
+  if (io_tail - io_head == IO_MESSAGE_SLOTS) {
+    m = &io_ring[(io_tail - 1) % IO_MESSAGE_SLOTS];
+    if (!strcmp(m->msg, msg) && m->repeat < UINT16_MAX) {
+      m->repeat++;
+      return;
+    }
+    io_head++;
   }
-  io_tail = NULL;
+
+  m = &io_ring[io_tail++ % IO_MESSAGE_SLOTS];
+  strcpy(m->msg, msg);
+  m->repeat = 1;
 }
 
 void io_queue_message(const char *format, ...)
 {
-  io_message_t *tmp;
+  char msg[IO_MESSAGE_LEN];
   va_list ap;
 
-  if (!(tmp = (io_message_t *) malloc(sizeof (*tmp)))) {
-    perror("malloc");
-    exit(1);
+  if (world.headless) {
+    return;
   }
 
-  tmp->next = NULL;
+  va_start(ap, format);
+
+  vsnprintf(msg, sizeof (msg), format, ap);
+
+  va_end(ap);
+
+  io_ring_put(msg);
+}
+
+void io_post_message(const char *format, ...)
+{
+  uint32_t tail;
+  va_list ap;
+
+  if (world.headless) {
+    return;
+  }
+
+  tail = io_posted_tail.load(std::memory_order_relaxed);
+  if (tail - io_posted_head.load(std::memory_order_acquire) ==
+      IO_MESSAGE_SLOTS) {
+    io_posted_lost.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
 
   va_start(ap, format);
 
-  vsnprintf(tmp->msg, sizeof (tmp->msg), format, ap);
+  vsnprintf(io_posted[tail % IO_MESSAGE_SLOTS], IO_MESSAGE_LEN, format, ap);
 
   va_end(ap);
 
-  if (!io_head) {
-    io_head = io_tail = tmp;
-  } else {
-    io_tail->next = tmp;
-    io_tail = tmp;
+  io_posted_tail.store(tail + 1, std::memory_order_release);
+}
+
+/* Moves anything posted from other threads into the game's own ring. */
+static void io_take_posted()
+{
+  char msg[IO_MESSAGE_LEN];
+  uint32_t head, tail, lost;
+
+  head = io_posted_head.load(std::memory_order_relaxed);
+  tail = io_posted_tail.load(std::memory_order_acquire);
+  for (; head != tail; head++) {
+    io_ring_put(io_posted[head % IO_MESSAGE_SLOTS]);
+  }
+  io_posted_head.store(head, std::memory_order_release);
+
+  if ((lost = io_posted_lost.exchange(0, std::memory_order_relaxed))) {
+    snprintf(msg, sizeof (msg), "(%u more messages lost)", lost);
+    io_ring_put(msg);
   }
 }
 
 static void io_print_message_queue(uint32_t y, uint32_t x)
 {
-  while (io_head) {
-    io_tail = io_head;
+  io_message_t *m;
+  char msg[IO_MESSAGE_LEN], count[16];
+
+  io_take_posted();
+
+  while (io_head != io_tail) {
+    m = &io_ring[io_head++ % IO_MESSAGE_SLOTS];
+    if (m->repeat > 1) {
+      snprintf(count, sizeof (count), " (x%u)", m->repeat);
+      snprintf(msg, sizeof (msg), "%.*s%s",
+               (int) (sizeof (msg) - 1 - strlen(count)), m->msg, count);
+    } else {
+      strcpy(msg, m->msg);
+    }
     attron(COLOR_PAIR(COLOR_CYAN));
-    mvprintw(y, x, "%-80s", io_head->msg);
+    mvprintw(y, x, "%-80s", msg);
     attroff(COLOR_PAIR(COLOR_CYAN));
-    io_head = io_head->next;
-    if (io_head) {
+    if (io_head != io_tail) {
       attron(COLOR_PAIR(COLOR_CYAN));
       mvprintw(y, x + 70, "%10s", " --more-- ");
       attroff(COLOR_PAIR(COLOR_CYAN));
-      refresh();
-      getch();
+      render_refresh(NULL);
+      io_getch(NULL);
     }
-    free(io_tail);
   }
-  io_tail = NULL;
 }
 
+/* What io_display() last put on the screen: every map cell, and the two *
+ * HUD lines as the text that went into them.  Only what differs from   *
+ * this is drawn again.  Anything else that draws over stdscr, a popup  *
+ * or a list, sets io_stale so that the next display starts afresh.     */
+static chtype io_frame[MAP_Y][MAP_X];
+static char io_frame_hud[2][160];
+static map *io_frame_map;
+static int io_stale = 1;
+
 /* === Subwindow Management === */
 WINDOW *open_popup(int height, int width, int y, int x) {
   WINDOW *popup;
@@ -107,29 +301,92 @@ WINDOW *open_popup(int height, int width, int y, int x) {
   keypad(popup, TRUE);
   scrollok(popup, TRUE);
   idlok(popup, TRUE);
-	
-	start_color();
-		init_pair(COLOR_RED, COLOR_RED, COLOR_BLACK);
-		init_pair(COLOR_GREEN, COLOR_GREEN, COLOR_BLACK);
-		init_pair(COLOR_YELLOW, COLOR_YELLOW, COLOR_BLACK);
-		init_pair(COLOR_BLUE, COLOR_BLUE, COLOR_BLACK);
-		init_pair(COLOR_MAGENTA, COLOR_MAGENTA, COLOR_BLACK);
-		init_pair(COLOR_CYAN, COLOR_CYAN, COLOR_BLACK);
-		init_pair(COLOR_WHITE, COLOR_WHITE, COLOR_BLACK);
+  /* Colors were started once, in io_init_terminal(). */
 
   wsetscrreg(popup, 5, 16);
   box(popup, 0, 0);
-  wrefresh(popup);
+  render_refresh(popup);
 
   return popup;
 };
-void close_popup(WINDOW *popup) {
+/* Takes popup off the screen but keeps the window. */
+static void hide_popup(WINDOW *popup)
+{
   wborder(popup, ' ',' ',' ',' ',' ',' ',' ',' ');
   wclear(popup);
-  wrefresh(popup);
+  render_refresh(popup);
+  io_stale = 1;
+}
+void close_popup(WINDOW *popup) {
+  hide_popup(popup);
   delwin(popup);
 };
 
+static WINDOW *reopen_popup(WINDOW **popup, int height, int width,
+                            int y, int x)
+{
+  if (!*popup) {
+    return *popup = open_popup(height, width, y, x);
+  }
+
+  werase(*popup);
+  box(*popup, 0, 0);
+  render_refresh(*popup);
+
+  return *popup;
+}
+
+/* mvwprintw() with attributes a, except that nothing is written, and *
+ * so nothing marked for refresh, if w already shows exactly that.    *
+ * Battles redraw their whole stage every turn; this keeps the work   *
+ * to the lines that changed.                                         */
+static void io_print_changed(WINDOW *w, int y, int x, attr_t a,
+                             const char *format, ...)
+{
+  chtype cur[MAP_X + 1];
+  char s[MAP_X + 1];
+  va_list ap;
+  int i, n;
+
+  va_start(ap, format);
+  n = vsnprintf(s, sizeof (s), format, ap);
+  va_end(ap);
+
+  if (n > getmaxx(w) - x) {
+    n = getmaxx(w) - x;
+  }
+  if (n <= 0) {
+    return;
+  }
+  mvwinchnstr(w, y, x, cur, n);
+  for (i = 0; i < n && cur[i] == (((unsigned char) s[i]) | a); i++)
+    ;
+  if (i == n) {
+    return;
+  }
+
+  wattron(w, a);
+  mvwaddnstr(w, y, x, s, n);
+  wattroff(w, a);
+}
+
+/* "< @ @ >", with an @ in attributes a for each of lives. */
+static void io_print_lives(WINDOW *w, int y, int x, attr_t a, int lives)
+{
+  char s[MAP_X + 1];
+  int i;
+
+  for (i = 0; i < lives && 2 * i + 2 < (int) sizeof (s); i++) {
+    s[2 * i] = '@';
+    s[2 * i + 1] = ' ';
+  }
+  s[2 * i] = '\0';
+
+  io_print_changed(w, y, x, 0, "< ");
+  io_print_changed(w, y, x + 2, a, "%s", s);
+  io_print_changed(w, y, x + 2 + 2 * i, 0, ">  ");
+}
+
 
 /**************************************************************************
  * Compares trainer distances from the PC according to the rival distance *
@@ -139,178 +396,202 @@ void close_popup(WINDOW *popup) {
  *                                                                        *
  * Not a bug.                                                             *
  **************************************************************************/
-static int compare_trainer_distance(const void *v1, const void *v2)
+static int compare_trainer_distance(uint32_t a, uint32_t b)
 {
-  const character *const *c1 = (const character * const *) v1;
-  const character *const *c2 = (const character * const *) v2;
+  const npc_store *s = &world.cur_map->npcs;
 
-  return (world.rival_dist[(*c1)->pos[dim_y]][(*c1)->pos[dim_x]] -
-          world.rival_dist[(*c2)->pos[dim_y]][(*c2)->pos[dim_x]]);
+  return (world.rival_dist[s->pos[dim_y][a]][s->pos[dim_x][a]] -
+          world.rival_dist[s->pos[dim_y][b]][s->pos[dim_x][b]]);
 }
 
-static character *io_nearest_visible_trainer()
+/* Ties go to whoever comes first on the map, top to bottom, left to *
+ * right, as they did when trainers were listed by scanning cmap.    */
+static int compare_trainer(uint32_t a, uint32_t b)
 {
-  character **c, *n;
-  uint32_t x, y, count;
+  const npc_store *s = &world.cur_map->npcs;
+  int d;
 
-  c = (character **) malloc(world.cur_map->num_trainers * sizeof (*c));
+  if ((d = compare_trainer_distance(a, b))) {
+    return d;
+  }
+  if (s->pos[dim_y][a] != s->pos[dim_y][b]) {
+    return s->pos[dim_y][a] - s->pos[dim_y][b];
+  }
 
-  /* Get a linear list of trainers */
-  for (count = 0, y = 1; y < MAP_Y - 1; y++) {
-    for (x = 1; x < MAP_X - 1; x++) {
-      if (world.cur_map->cmap[y][x] && world.cur_map->cmap[y][x] !=
-          &world.pc) {
-        c[count++] = world.cur_map->cmap[y][x];
-      }
+  return s->pos[dim_x][a] - s->pos[dim_x][b];
+}
+
+static int compare_trainer_id(const void *v1, const void *v2)
+{
+  return compare_trainer(*(const uint32_t *) v1, *(const uint32_t *) v2);
+}
+
+/* The map's npc_store is the trainer index: one row per trainer, with *
+ * positions kept current as they move, so the nearest is one pass     *
+ * over it.                                                            */
+static npc *io_nearest_visible_trainer()
+{
+  npc_store *s = &world.cur_map->npcs;
+  uint32_t i, best;
+
+  if (!s->size()) {
+    return NULL;
+  }
+
+  pathfind_ensure(dist_rival);
+  for (best = 0, i = 1; i < s->size(); i++) {
+    if (compare_trainer(i, best) < 0) {
+      best = i;
     }
   }
 
-  /* Sort it by distance from PC */
-  qsort(c, count, sizeof (*c), compare_trainer_distance);
+  return s->party[best];
+}
 
-  n = c[0];
+static chtype io_terrain(terrain_type_t t)
+{
+  switch (t) {
+  case ter_boulder:
+    return BOULDER_SYMBOL | COLOR_PAIR(COLOR_MAGENTA);
+  case ter_mountain:
+    return MOUNTAIN_SYMBOL | COLOR_PAIR(COLOR_MAGENTA);
+  case ter_cliff:
+    return CLIFF_SYMBOL | COLOR_PAIR(COLOR_MAGENTA);
+  case ter_tree:
+    return TREE_SYMBOL | COLOR_PAIR(COLOR_GREEN);
+  case ter_forest:
+    return FOREST_SYMBOL | COLOR_PAIR(COLOR_GREEN);
+  case ter_path:
+  case ter_bailey:
+    return PATH_SYMBOL | COLOR_PAIR(COLOR_YELLOW);
+  case ter_gate:
+    return GATE_SYMBOL | COLOR_PAIR(COLOR_YELLOW);
+  case ter_mart:
+    return POKEMART_SYMBOL | COLOR_PAIR(COLOR_BLUE);
+  case ter_center:
+    return POKEMON_CENTER_SYMBOL | COLOR_PAIR(COLOR_RED);
+  case ter_grass:
+    return TALL_GRASS_SYMBOL | COLOR_PAIR(COLOR_GREEN);
+  case ter_clearing:
+    return SHORT_GRASS_SYMBOL | COLOR_PAIR(COLOR_GREEN);
+  case ter_water:
+    return WATER_SYMBOL | COLOR_PAIR(COLOR_CYAN);
+  default:
+    /* Use zero as an error symbol, since it stands out somewhat, and it's *
+     * not otherwise used.                                                 */
+    return ERROR_SYMBOL | COLOR_PAIR(COLOR_CYAN);
+  }
+}
 
-  free(c);
+static chtype io_cell(uint32_t y, uint32_t x)
+{
+  if (world.cur_map->cmap[y][x]) {
+    return world.cur_map->cmap[y][x]->symbol;
+  }
 
-  return n;
+  return io_terrain(world.cur_map->map[y][x]);
 }
 
 void io_display()
 {
   uint32_t y, x;
-  character *c;
+  pair_t pos;
+  npc *c;
+  char known[40], nearest[40], where[60];
+  char hud[sizeof (io_frame_hud[0])];
+  chtype ch;
+  int full;
+
+  full = io_stale || io_frame_map != world.cur_map;
+  if (full) {
+    /* Not clear(): that would resend every cell to the terminal. */
+    erase();
+    io_frame_hud[0][0] = io_frame_hud[1][0] = '\0';
+    io_frame_map = world.cur_map;
+    io_stale = 0;
+  }
 
-  clear();
   for (y = 0; y < MAP_Y; y++) {
     for (x = 0; x < MAP_X; x++) {
-      if (world.cur_map->cmap[y][x]) {
-        mvaddch(y + 1, x, world.cur_map->cmap[y][x]->symbol);
-      } else {
-        switch (world.cur_map->map[y][x]) {
-        case ter_boulder:
-          attron(COLOR_PAIR(COLOR_MAGENTA));
-          mvaddch(y + 1, x, BOULDER_SYMBOL);
-          attroff(COLOR_PAIR(COLOR_MAGENTA));
-          break;
-        case ter_mountain:
-          attron(COLOR_PAIR(COLOR_MAGENTA));
-          mvaddch(y + 1, x, MOUNTAIN_SYMBOL);
-          attroff(COLOR_PAIR(COLOR_MAGENTA));
-          break;
-				case ter_cliff:
-					attron(COLOR_PAIR(COLOR_MAGENTA));
-					mvaddch(y + 1, x, CLIFF_SYMBOL);
-					attroff(COLOR_PAIR(COLOR_MAGENTA));
-					break;
-        case ter_tree:
-          attron(COLOR_PAIR(COLOR_GREEN));
-          mvaddch(y + 1, x, TREE_SYMBOL);
-          attroff(COLOR_PAIR(COLOR_GREEN));
-          break;
-        case ter_forest:
-          attron(COLOR_PAIR(COLOR_GREEN));
-          mvaddch(y + 1, x, FOREST_SYMBOL);
-          attroff(COLOR_PAIR(COLOR_GREEN));
-          break;
-        case ter_path:
-        case ter_bailey:
-          attron(COLOR_PAIR(COLOR_YELLOW));
-          mvaddch(y + 1, x, PATH_SYMBOL);
-          attroff(COLOR_PAIR(COLOR_YELLOW));
-          break;
-        case ter_gate:
-          attron(COLOR_PAIR(COLOR_YELLOW));
-          mvaddch(y + 1, x, GATE_SYMBOL);
-          attroff(COLOR_PAIR(COLOR_YELLOW));
-          break;
-        case ter_mart:
-          attron(COLOR_PAIR(COLOR_BLUE));
-          mvaddch(y + 1, x, POKEMART_SYMBOL);
-          attroff(COLOR_PAIR(COLOR_BLUE));
-          break;
-        case ter_center:
-          attron(COLOR_PAIR(COLOR_RED));
-          mvaddch(y + 1, x, POKEMON_CENTER_SYMBOL);
-          attroff(COLOR_PAIR(COLOR_RED));
-          break;
-        case ter_grass:
-          attron(COLOR_PAIR(COLOR_GREEN));
-          mvaddch(y + 1, x, TALL_GRASS_SYMBOL);
-          attroff(COLOR_PAIR(COLOR_GREEN));
-          break;
-        case ter_clearing:
-          attron(COLOR_PAIR(COLOR_GREEN));
-          mvaddch(y + 1, x, SHORT_GRASS_SYMBOL);
-          attroff(COLOR_PAIR(COLOR_GREEN));
-          break;
-        case ter_water:
-          attron(COLOR_PAIR(COLOR_CYAN));
-          mvaddch(y + 1, x, WATER_SYMBOL);
-          attroff(COLOR_PAIR(COLOR_CYAN));
-          break;
-        default:
- /* Use zero as an error symbol, since it stands out somewhat, and it's *
-  * not otherwise used.                                                 */
-          attron(COLOR_PAIR(COLOR_CYAN));
-          mvaddch(y + 1, x, ERROR_SYMBOL);
-          attroff(COLOR_PAIR(COLOR_CYAN)); 
-       }
+      ch = io_cell(y, x);
+      if (full || io_frame[y][x] != ch) {
+        mvaddch(y + 1, x, ch);
+        io_frame[y][x] = ch;
       }
     }
   }
 
-  mvprintw(23, 1, "PC position is (%2d,%2d) on map %d%cx%d%c [%c]",
-           world.pc.pos[dim_x],
-           world.pc.pos[dim_y],
-           abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)),
-           world.cur_idx[dim_x] - (WORLD_SIZE / 2) >= 0 ? 'E' : 'W',
-           abs(world.cur_idx[dim_y] - (WORLD_SIZE / 2)),
-           world.cur_idx[dim_y] - (WORLD_SIZE / 2) <= 0 ? 'N' : 'S',
-           geo_symb[world.cur_map->geotype]);
-  mvprintw(22, 1, "%d known %s.", world.cur_map->num_trainers,
+  snprintf(known, sizeof (known), "%d known %s.", world.cur_map->num_trainers,
            world.cur_map->num_trainers > 1 ? "trainers" : "trainer");
-  mvprintw(22, 30, "Nearest visible trainer: ");
   if ((c = io_nearest_visible_trainer())) {
-    attron(COLOR_PAIR(COLOR_RED));
-    mvprintw(22, 55, "%c at vector %d%cx%d%c.",
+    world.cur_map->npcs.get_pos(c->id, pos);
+    snprintf(nearest, sizeof (nearest), "%c at vector %d%cx%d%c.",
              c->symbol,
-             abs(c->pos[dim_y] - world.pc.pos[dim_y]),
-             ((c->pos[dim_y] - world.pc.pos[dim_y]) <= 0 ?
+             abs(pos[dim_y] - world.pc.pos[dim_y]),
+             ((pos[dim_y] - world.pc.pos[dim_y]) <= 0 ?
               'N' : 'S'),
-             abs(c->pos[dim_x] - world.pc.pos[dim_x]),
-             ((c->pos[dim_x] - world.pc.pos[dim_x]) <= 0 ?
+             abs(pos[dim_x] - world.pc.pos[dim_x]),
+             ((pos[dim_x] - world.pc.pos[dim_x]) <= 0 ?
               'W' : 'E'));
-    attroff(COLOR_PAIR(COLOR_RED));
   } else {
-    attron(COLOR_PAIR(COLOR_BLUE));
-    mvprintw(22, 55, "NONE.");
-    attroff(COLOR_PAIR(COLOR_BLUE));
+    snprintf(nearest, sizeof (nearest), "NONE.");
+  }
+  snprintf(hud, sizeof (hud), "%s|%s", known, nearest);
+  if (strcmp(hud, io_frame_hud[0])) {
+    strcpy(io_frame_hud[0], hud);
+    move(22, 0);
+    clrtoeol();
+    mvprintw(22, 1, "%s", known);
+    mvprintw(22, 30, "Nearest visible trainer: ");
+    attron(COLOR_PAIR(c ? COLOR_RED : COLOR_BLUE));
+    mvprintw(22, 55, "%s", nearest);
+    attroff(COLOR_PAIR(c ? COLOR_RED : COLOR_BLUE));
   }
 
+  snprintf(where, sizeof (where), "PC position is (%2d,%2d) on map %d%cx%d%c [%c]",
+           world.pc.pos[dim_x],
+           world.pc.pos[dim_y],
+           abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)),
+           world.cur_idx[dim_x] - (WORLD_SIZE / 2) >= 0 ? 'E' : 'W',
+           abs(world.cur_idx[dim_y] - (WORLD_SIZE / 2)),
+           world.cur_idx[dim_y] - (WORLD_SIZE / 2) <= 0 ? 'N' : 'S',
+           geo_symb[world.cur_map->geotype]);
   std::string buddies_hud = "Buddies: [" + std::to_string(world.pc.num_buddies) 
                 + "/6] | @: " + world.pc.buddy[0]->get_species() 
 								+ " L:" + std::to_string(world.pc.buddy[0]->get_lvl())
 								+ "(" + std::to_string(world.pc.buddy[0]->get_chp()) 
 											+ "/" + std::to_string(world.pc.buddy[0]->get_hp()) + ")";
-  mvprintw(23, 40, "%40s", buddies_hud.c_str());
+  snprintf(hud, sizeof (hud), "%s|%s", where, buddies_hud.c_str());
+  if (strcmp(hud, io_frame_hud[1])) {
+    strcpy(io_frame_hud[1], hud);
+    move(23, 0);
+    clrtoeol();
+    mvprintw(23, 1, "%s", where);
+    mvprintw(23, 40, "%40s", buddies_hud.c_str());
+  }
 
+  /* The message row is anybody's; blank it, and curses will only send *
+   * the difference.                                                   */
+  move(0, 0);
+  clrtoeol();
   io_print_message_queue(0, 0);
 
-  refresh();
+  render_refresh(NULL);
+}
+
+/* After drawing over the map with something that isn't a popup. */
+static void io_redraw()
+{
+  io_stale = 1;
+  io_display();
 }
 
 uint32_t io_teleport_pc(pair_t dest)
 {
   /* Just for fun. And debugging.  Mostly debugging. */
 
-  do {
-    dest[dim_x] = rand_range(1, MAP_X - 2);
-    dest[dim_y] = rand_range(1, MAP_Y - 2);
-  } while (world.cur_map->cmap[dest[dim_y]][dest[dim_x]]                  ||
-           move_cost[char_pc][world.cur_map->map[dest[dim_y]]
-                                                [dest[dim_x]]] ==
-             DIJKSTRA_PATH_MAX                                            ||
-           world.rival_dist[dest[dim_y]][dest[dim_x]] < 0);
+  rand_cell(world.cur_map->passable[char_pc] &
+            map_inner(1).without(world.cur_map->occupied), dest);
 
   return 0;
 }
@@ -327,7 +608,7 @@ static void io_scroll_trainer_list(char (*s)[TRAINER_LIST_FIELD_WIDTH],
     for (i = 0; i < 13; i++) {
       mvprintw(i + 6, 19, " %-40s ", s[i + offset]);
     }
-    switch (getch()) {
+    switch (io_getch(NULL)) {
     case KEY_UP:
       if (offset) {
         offset--;
@@ -345,9 +626,11 @@ static void io_scroll_trainer_list(char (*s)[TRAINER_LIST_FIELD_WIDTH],
   }
 }
 
-static void io_list_trainers_display(npc **c, uint32_t count)
+static void io_list_trainers_display(const uint32_t *id, uint32_t count)
 {
+  npc_store *n = &world.cur_map->npcs;
   uint32_t i;
+  pair_t pos;
   char (*s)[TRAINER_LIST_FIELD_WIDTH]; /* pointer to array of 40 char */
 
   s = (char (*)[TRAINER_LIST_FIELD_WIDTH]) malloc(count * sizeof (*s));
@@ -359,14 +642,15 @@ static void io_list_trainers_display(npc **c, uint32_t count)
   mvprintw(5, 19, " %-40s ", "");
 
   for (i = 0; i < count; i++) {
+    n->get_pos(id[i], pos);
     snprintf(s[i], TRAINER_LIST_FIELD_WIDTH, "%16s %c: %2d %s by %2d %s",
-             char_type_name[c[i]->ctype],
-             c[i]->symbol,
-             abs(c[i]->pos[dim_y] - world.pc.pos[dim_y]),
-             ((c[i]->pos[dim_y] - world.pc.pos[dim_y]) <= 0 ?
+             char_type_name[n->ctype[id[i]]],
+             n->party[id[i]]->symbol,
+             abs(pos[dim_y] - world.pc.pos[dim_y]),
+             ((pos[dim_y] - world.pc.pos[dim_y]) <= 0 ?
               "North" : "South"),
-             abs(c[i]->pos[dim_x] - world.pc.pos[dim_x]),
-             ((c[i]->pos[dim_x] - world.pc.pos[dim_x]) <= 0 ?
+             abs(pos[dim_x] - world.pc.pos[dim_x]),
+             ((pos[dim_x] - world.pc.pos[dim_x]) <= 0 ?
               "West" : "East"));
     if (count <= 13) {
       /* Handle the non-scrolling case right here. *
@@ -378,7 +662,7 @@ static void io_list_trainers_display(npc **c, uint32_t count)
   if (count <= 13) {
     mvprintw(count + 6, 19, " %-40s ", "");
     mvprintw(count + 7, 19, " %-40s ", "Hit escape to continue.");
-    while (getch() != 27 /* escape */)
+    while (io_getch(NULL) != 27 /* escape */)
       ;
   } else {
     mvprintw(19, 19, " %-40s ", "");
@@ -392,30 +676,81 @@ static void io_list_trainers_display(npc **c, uint32_t count)
 
 static void io_list_trainers()
 {
-  npc **c;
-  uint32_t x, y, count;
-
-  c = (npc **) malloc(world.cur_map->num_trainers * sizeof (*c));
+  std::vector<uint32_t> id(world.cur_map->npcs.size());
+  uint32_t i;
 
-  /* Get a linear list of trainers */
-  for (count = 0, y = 1; y < MAP_Y - 1; y++) {
-    for (x = 1; x < MAP_X - 1; x++) {
-      if (world.cur_map->cmap[y][x] && world.cur_map->cmap[y][x] !=
-          &world.pc) {
-        c[count++] = dynamic_cast <npc *> (world.cur_map->cmap[y][x]);
-      }
-    }
+  for (i = 0; i < id.size(); i++) {
+    id[i] = i;
   }
 
   /* Sort it by distance from PC */
-  qsort(c, count, sizeof (*c), compare_trainer_distance);
+  pathfind_ensure(dist_rival);
+  qsort(id.data(), id.size(), sizeof (id[0]), compare_trainer_id);
 
   /* Display it */
-  io_list_trainers_display(c, count);
-  free(c);
+  io_list_trainers_display(id.data(), id.size());
 
   /* And redraw the map */
-  io_display();
+  io_redraw();
+}
+
+typedef struct encounter_entry {
+  double chance;
+  int species;
+} encounter_entry_t;
+
+static int compare_encounter_chance(const void *v1, const void *v2)
+{
+  const encounter_entry_t *e1 = (const encounter_entry_t *) v1;
+  const encounter_entry_t *e2 = (const encounter_entry_t *) v2;
+
+  return (e1->chance < e2->chance) - (e1->chance > e2->chance);
+}
+
+/* Debugging aid: the encounter table for this map, likeliest first, *
+ * with the odds read back out of the alias table.                   */
+static void io_list_encounters()
+{
+  static const char *geo_name[num_geo_types] = {
+    "wild", "plain", "wet", "woods", "cliffs", "mountain", "town"
+  };
+  encounter_entry_t *e;
+  char (*s)[TRAINER_LIST_FIELD_WIDTH];
+  uint32_t i, count;
+  int band;
+
+  count = ENCOUNTER_SPECIES;
+  band = encounter_band(abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)) +
+                        abs(world.cur_idx[dim_y] - (WORLD_SIZE / 2)));
+  e = (encounter_entry_t *) malloc(count * sizeof (*e));
+  s = (char (*)[TRAINER_LIST_FIELD_WIDTH]) malloc(count * sizeof (*s));
+
+  for (i = 0; i < count; i++) {
+    e[i].species = i + 1;
+    e[i].chance = encounter_chance(world.cur_map->geotype, band, i + 1);
+  }
+  qsort(e, count, sizeof (*e), compare_encounter_chance);
+
+  mvprintw(3, 19, " %-40s ", "");
+  snprintf(s[0], TRAINER_LIST_FIELD_WIDTH, "Encounters here (%s, band %d of %d):",
+           geo_name[world.cur_map->geotype], band + 1, ENCOUNTER_BANDS);
+  mvprintw(4, 19, " %-40s ", *s);
+  mvprintw(5, 19, " %-40s ", "");
+
+  for (i = 0; i < count; i++) {
+    snprintf(s[i], TRAINER_LIST_FIELD_WIDTH, "%4d %-25s %7.3f%%",
+             e[i].species, encounter_species_name(e[i].species),
+             e[i].chance * 100);
+  }
+
+  mvprintw(19, 19, " %-40s ", "");
+  mvprintw(20, 19, " %-40s ", "Arrows to scroll, escape to continue.");
+  io_scroll_trainer_list(s, count);
+
+  free(s);
+  free(e);
+
+  io_redraw();
 }
 
 void mvwgeoch(WINDOW* win, int y, int x, geo_type_t type) {
@@ -449,80 +784,274 @@ void mvwgeoch(WINDOW* win, int y, int x, geo_type_t type) {
 	}
 }
 
-void io_wmap() {
-  WINDOW *world_map;
-  uint8_t close_map = 0;
-  world_map = open_popup(SCALED_WORLD + 2, SCALED_WORLD + 2, 1, 4);
+/* The world map zooms from whole regions, one cell for each geotype in *
+ * world.wmap, through the atlas levels from the coarsest down, to a    *
+ * thumbnail of every map.  Blocks with nothing generated in them yet   *
+ * show the geotype of their region, uncolored.                         */
+#define WMAP_Y           20
+#define WMAP_X           60
+#define WMAP_ZOOM_REGION 0
+#define WMAP_ZOOM_THUMB  (ATLAS_LEVELS + 1)
 
-  do {
-    for (int y = 0; y < SCALED_WORLD; y++) {
-      for (int x = 0; x < SCALED_WORLD; x++) {
-				if (	 world.cur_idx[dim_x] / 20 == x
-						&& world.cur_idx[dim_y] / 20 == y) {
-					wattron(world_map, A_STANDOUT);
-					mvwgeoch(world_map, y+1, x+1, world.wmap[y][x]);
-					wattroff(world_map, A_STANDOUT);
-				} else {
-					mvwgeoch(world_map, y+1, x+1, world.wmap[y][x]);
-				}
+static geo_type_t io_region(int x, int y)
+{
+  x /= WORLD_SCALE;
+  y /= WORLD_SCALE;
+
+  return world.wmap[y < SCALED_WORLD ? y : SCALED_WORLD - 1]
+                   [x < SCALED_WORLD ? x : SCALED_WORLD - 1];
+}
+
+/* The first of n blocks to show out of side, keeping block c in view *
+ * and centered as far as the edges of the world allow, or all of     *
+ * them centered if they fit.                                         */
+static int io_wmap_origin(int c, int side, int n)
+{
+  if (side <= n) {
+    return -(n - side) / 2;
+  }
+  c -= n / 2;
+
+  return c < 0 ? 0 : (c > side - n ? side - n : c);
+}
+
+static void io_wmap_thumbs(WINDOW *w, int cx, int cy)
+{
+  const atlas_thumb_t *t;
+  int ox, oy, px, py, x, y, tx, ty;
+  chtype c;
+
+  ox = io_wmap_origin(cx, WORLD_SIZE, WMAP_X / ATLAS_THUMB_X);
+  oy = io_wmap_origin(cy, WORLD_SIZE, WMAP_Y / ATLAS_THUMB_Y);
+  px = 1 + (WMAP_X % ATLAS_THUMB_X) / 2;
+  py = 1 + (WMAP_Y % ATLAS_THUMB_Y) / 2;
+  for (y = 0; y < WMAP_Y / ATLAS_THUMB_Y; y++) {
+    for (x = 0; x < WMAP_X / ATLAS_THUMB_X; x++) {
+      t = atlas_thumb(ox + x, oy + y);
+      for (ty = 0; ty < ATLAS_THUMB_Y; ty++) {
+        for (tx = 0; tx < ATLAS_THUMB_X; tx++) {
+          if (!t) {
+            c = geo_symb[io_region(ox + x, oy + y)];
+          } else if (ox + x == world.cur_idx[dim_x] &&
+                     oy + y == world.cur_idx[dim_y] &&
+                     world.pc.pos[dim_x] / (MAP_X / ATLAS_THUMB_X) == tx &&
+                     world.pc.pos[dim_y] / (MAP_Y / ATLAS_THUMB_Y) == ty) {
+            c = PC_SYMBOL;
+          } else {
+            c = io_terrain(t->t[ty][tx]);
+          }
+          mvwaddch(w, py + y * ATLAS_THUMB_Y + ty, px + x * ATLAS_THUMB_X + tx,
+                   c);
+        }
+      }
+    }
+  }
+}
+
+static void io_wmap_draw(WINDOW *w, int zoom, int cx, int cy)
+{
+  terrain_type_t top;
+  uint8_t flags;
+  int k, side, ox, oy, x, y, bx, by;
+  chtype c;
+
+  werase(w);
+  box(w, 0, 0);
+
+  if (zoom == WMAP_ZOOM_THUMB) {
+    io_wmap_thumbs(w, cx, cy);
+    mvwprintw(w, 0, 2, " World map: every map ");
+  } else if (zoom == WMAP_ZOOM_REGION) {
+    ox = io_wmap_origin(cx / WORLD_SCALE, SCALED_WORLD, WMAP_X);
+    oy = io_wmap_origin(cy / WORLD_SCALE, SCALED_WORLD, WMAP_Y);
+    for (y = 0; y < WMAP_Y; y++) {
+      for (x = 0; x < WMAP_X; x++) {
+        bx = ox + x;
+        by = oy + y;
+        if (bx < 0 || by < 0 || bx >= SCALED_WORLD || by >= SCALED_WORLD) {
+          continue;
+        }
+        if (world.cur_idx[dim_x] / WORLD_SCALE == bx &&
+            world.cur_idx[dim_y] / WORLD_SCALE == by) {
+          wattron(w, A_STANDOUT);
+          mvwgeoch(w, y + 1, x + 1, world.wmap[by][bx]);
+          wattroff(w, A_STANDOUT);
+        } else {
+          mvwgeoch(w, y + 1, x + 1, world.wmap[by][bx]);
+        }
       }
     }
-		wrefresh(world_map);
-    switch(wgetch(world_map)) {
+    mvwprintw(w, 0, 2, " World map: regions ");
+  } else {
+    k = ATLAS_LEVELS - zoom;
+    side = atlas_side(k);
+    ox = io_wmap_origin(cx >> k, side, WMAP_X);
+    oy = io_wmap_origin(cy >> k, side, WMAP_Y);
+    for (y = 0; y < WMAP_Y; y++) {
+      for (x = 0; x < WMAP_X; x++) {
+        bx = ox + x;
+        by = oy + y;
+        if (bx < 0 || by < 0 || bx >= side || by >= side) {
+          continue;
+        }
+        if (!atlas_block(k, bx, by, &top, &flags)) {
+          c = geo_symb[io_region(bx << k, by << k)];
+        } else if (!k && (flags & ATLAS_MART)) {
+          c = io_terrain(ter_mart);
+        } else if (!k && (flags & ATLAS_CENTER)) {
+          c = io_terrain(ter_center);
+        } else {
+          c = io_terrain(top);
+        }
+        if (world.cur_idx[dim_x] >> k == bx &&
+            world.cur_idx[dim_y] >> k == by) {
+          c |= A_STANDOUT;
+        }
+        mvwaddch(w, y + 1, x + 1, c);
+      }
+    }
+    if (k) {
+      mvwprintw(w, 0, 2, " World map: %dx%d maps ", 1 << k, 1 << k);
+    } else {
+      mvwprintw(w, 0, 2, " World map: maps ");
+    }
+  }
+  mvwprintw(w, WMAP_Y + 1, 2, " +/- zoom, direction keys pan, escape exits ");
+}
+
+void io_wmap()
+{
+  WINDOW *w;
+  int zoom, cx, cy, step;
+
+  w = open_popup(WMAP_Y + 2, WMAP_X + 2, 1, (80 - (WMAP_X + 2)) / 2);
+  zoom = WMAP_ZOOM_REGION;
+  cx = world.cur_idx[dim_x];
+  cy = world.cur_idx[dim_y];
+
+  for (;;) {
+    io_wmap_draw(w, zoom, cx, cy);
+    if (zoom == WMAP_ZOOM_THUMB) {
+      step = 1;
+    } else if (zoom == WMAP_ZOOM_REGION) {
+      step = WORLD_SCALE;
+    } else {
+      step = 1 << (ATLAS_LEVELS - zoom);
+    }
+    switch (io_getch(w)) {
     case 27:
-		case 'm':
-		case 'q':
-			close_map = 1;
+    case 'm':
+    case 'q':
+      close_popup(w);
       return;
-		default:
-			break;
+    case '+':
+    case '=':
+    case '>':
+      zoom += zoom < WMAP_ZOOM_THUMB;
+      break;
+    case '-':
+    case '<':
+      zoom -= zoom > WMAP_ZOOM_REGION;
+      break;
+    case '7':
+    case 'y':
+    case KEY_HOME:
+      cx -= step;
+      cy -= step;
+      break;
+    case '8':
+    case 'k':
+    case KEY_UP:
+      cy -= step;
+      break;
+    case '9':
+    case 'u':
+    case KEY_PPAGE:
+      cx += step;
+      cy -= step;
+      break;
+    case '6':
+    case 'l':
+    case KEY_RIGHT:
+      cx += step;
+      break;
+    case '3':
+    case 'n':
+    case KEY_NPAGE:
+      cx += step;
+      cy += step;
+      break;
+    case '2':
+    case 'j':
+    case KEY_DOWN:
+      cy += step;
+      break;
+    case '1':
+    case 'b':
+    case KEY_END:
+      cx -= step;
+      cy += step;
+      break;
+    case '4':
+    case 'h':
+    case KEY_LEFT:
+      cx -= step;
+      break;
+    default:
+      break;
     }
-  } while (!close_map);
-
-	close_popup(world_map);
+    cx = cx < 0 ? 0 : (cx >= WORLD_SIZE ? WORLD_SIZE - 1 : cx);
+    cy = cy < 0 ? 0 : (cy >= WORLD_SIZE ? WORLD_SIZE - 1 : cy);
+  }
 }
 
 void io_pokemart()
 {
-  mvprintw(0, 0, "Welcome to the Pokemart.  Could I interest you in some Pokeballs?");
 	world.pc.bag[inv_revive] += 2;
 	world.pc.bag[inv_potion] += 2;
 	world.pc.bag[inv_pokeball] += 2;
-  refresh();
-  getch();
+  if (world.headless) {
+    return;
+  }
+  mvprintw(0, 0, "Welcome to the Pokemart.  Could I interest you in some Pokeballs?");
+  render_refresh(NULL);
+  io_getch(NULL);
 }
 
 void io_pokemon_center()
 {
-  mvprintw(0, 0, "Welcome to the Pokemon Center.  How can Nurse Joy assist you?");
 	for (int i = 0; i < 6 && world.pc.buddy[i]; i++) {
 		world.pc.buddy[i]->heal(world.pc.buddy[i]->get_hp());
 	}
-  refresh();
-  getch();
+  if (world.headless) {
+    return;
+  }
+  mvprintw(0, 0, "Welcome to the Pokemon Center.  How can Nurse Joy assist you?");
+  render_refresh(NULL);
+  io_getch(NULL);
 }
 
 int io_inventory(int in_battle) {
 	WINDOW *inventory;
-	inventory = open_popup(MAP_Y - 6, 22, 3, 3);
+	inventory = reopen_popup(&io_bag_win, MAP_Y - 6, 22, 3, 3);
 	uint8_t close_bag = 0;
+	char menu[14][21];
 
 	int y, i, j, r;
 
 	do {
-		/* Clear Menu */
+		/* Draw Menu over whatever the last pass left */
+		memset(menu, 0, sizeof (menu));
+		snprintf(menu[2], sizeof (menu[2]), " Inventory:");
+		snprintf(menu[3], sizeof (menu[3]), "  1|  Revives x%d", world.pc.bag[inv_revive]);
+		snprintf(menu[4], sizeof (menu[4]), "  2|  Potions x%d", world.pc.bag[inv_potion]);
+		snprintf(menu[5], sizeof (menu[5]), "  3|Pokeballs x%d", world.pc.bag[inv_pokeball]);
+		snprintf(menu[9], sizeof (menu[9]), " [1|2|3]/[0]");
 		for (j = 1; j < 14; j++) {
-			mvwprintw(inventory, j, 1, "%20s", "");
+			io_print_changed(inventory, j, 1, 0, "%-20s", menu[j]);
 		}
 
-		mvwprintw(inventory, 2, 2, "Inventory:");
-		mvwprintw(inventory, 3, 3, "1|  Revives x%d", world.pc.bag[inv_revive]);
-		mvwprintw(inventory, 4, 3, "2|  Potions x%d", world.pc.bag[inv_potion]);
-		mvwprintw(inventory, 5, 3, "3|Pokeballs x%d", world.pc.bag[inv_pokeball]);
-
-		mvwprintw(inventory, 9, 2, "[1|2|3]/[0]");
-
-		switch(wgetch(inventory)) {
+		switch(io_getch(inventory)) {
 		case '1':
 			if (world.pc.bag[inv_revive] <= 0) {
 				mvwprintw(inventory, 7, 2, "No Revives Left");
@@ -573,7 +1102,7 @@ int io_inventory(int in_battle) {
 				break;
 			}
 
-			switch(wgetch(inventory)) {
+			switch(io_getch(inventory)) {
 			case '1':
 				j = 0;
 				r = j + 5;
@@ -657,7 +1186,7 @@ int io_inventory(int in_battle) {
 				break;
 			}
 
-			switch(wgetch(inventory)) {
+			switch(io_getch(inventory)) {
 			case '1':
 				j = 0;
 				r = j + 11;
@@ -714,11 +1243,11 @@ int io_inventory(int in_battle) {
 		default:
 			break;
 		}
-		wrefresh(inventory);
-		usleep(250000);
+		render_refresh(inventory);
+		io_delay(250000);
 	} while (!close_bag);
 
-	close_popup(inventory);
+	hide_popup(inventory);
 
 	return r;
 }
@@ -828,7 +1357,7 @@ int pc_turn(WINDOW* battle_menu, int& ry,
 int32_t battle_menu(int mode, npc* n = NULL, pokemon* w = NULL) {
   WINDOW *battle_menu;
   uint8_t end_battle = 0;
-  battle_menu = open_popup(MAP_Y - 2, MAP_X - 4, 2, 2);
+  battle_menu = reopen_popup(&io_battle_win, MAP_Y - 2, MAP_X - 4, 2, 2);
 
   pokemon& a = *(world.pc.buddy[0]);
   int pc_lives = world.pc.num_buddies;
@@ -849,63 +1378,42 @@ int32_t battle_menu(int mode, npc* n = NULL, pokemon* w = NULL) {
   int i, j, y;
 
   do {
-		box(battle_menu, 0, 0);
 		/* Clear Right Side */
     ry = 2;
     for (j = 2; j < 15; j++) {
-      mvwprintw(battle_menu, j, 56, "%19s", "");
+      io_print_changed(battle_menu, j, 56, 0, "%19s", "");
     }
 		for (ly = 15; ly > 1; ly--) {
-			mvwprintw(battle_menu, ly, 1, "%20s", "");
+			io_print_changed(battle_menu, ly, 1, 0, "%20s", "");
 		}
 		
 
 		/* ###### Center Battle Stage ###### */
 		if (!mode) {
-			wattron(battle_menu, COLOR_PAIR(COLOR_MAGENTA));
-			mvwprintw(battle_menu, 1, 31, "Enemy: %8s", char_type_name[n->ctype]);
-			wattroff(battle_menu, COLOR_PAIR(COLOR_MAGENTA));
+			io_print_changed(battle_menu, 1, 31, COLOR_PAIR(COLOR_MAGENTA),
+											 "Enemy: %8s", char_type_name[world.cur_map->npcs.ctype[n->id]]);
 		} else {
-			wattron(battle_menu, COLOR_PAIR(COLOR_GREEN));
-			mvwprintw(battle_menu, 1, 28, "Enemy: Wild %8s", f.get_species());
-			wattroff(battle_menu, COLOR_PAIR(COLOR_GREEN));
+			io_print_changed(battle_menu, 1, 28, COLOR_PAIR(COLOR_GREEN),
+											 "Enemy: Wild %8s", f.get_species());
 		}
     mvwprintw(battle_menu, ry++, 62, "Turn #%d", ++turns);
 
-		wattron(battle_menu, COLOR_PAIR(COLOR_YELLOW));
-    mvwprintw(battle_menu, 4, 34, "%15s (%c)",
+    io_print_changed(battle_menu, 4, 34, COLOR_PAIR(COLOR_YELLOW), "%15s (%c)",
                                     f.get_species(),
                                     f.get_gender_string()[0]);
-		wattroff(battle_menu, COLOR_PAIR(COLOR_YELLOW));
-    mvwprintw(battle_menu, 5, 40, "L:%d | %3d/%3d", f.get_lvl(), f.get_chp(), f.get_hp());
-		mvwprintw(battle_menu, 6, 40, "< ");
-		wattron(battle_menu, COLOR_PAIR(COLOR_RED));
-		for (i = 0; i < n_lives; i++) {
-			wprintw(battle_menu, "@ ");
-		}
-		wattroff(battle_menu, COLOR_PAIR(COLOR_RED));
-		wprintw(battle_menu, ">");
-		wprintw(battle_menu, "  ");
+    io_print_changed(battle_menu, 5, 40, 0, "L:%d | %3d/%3d", f.get_lvl(), f.get_chp(), f.get_hp());
+		io_print_lives(battle_menu, 6, 40, COLOR_PAIR(COLOR_RED), n_lives);
 
-		wattron(battle_menu, COLOR_PAIR(COLOR_CYAN));
-    mvwprintw(battle_menu, 10, 18, "%15s (%c)",
+    io_print_changed(battle_menu, 10, 18, COLOR_PAIR(COLOR_CYAN), "%15s (%c)",
                                       a.get_species(),
                                       a.get_gender_string()[0]);
-		wattroff(battle_menu, COLOR_PAIR(COLOR_CYAN));
-    mvwprintw(battle_menu, 11, 26, "L:%d | %3d/%3d ", a.get_lvl(), a.get_chp(), a.get_hp());
-		mvwprintw(battle_menu, 12, 26, "< ");
-		wattron(battle_menu, COLOR_PAIR(COLOR_BLUE));
-		for (i = 0; i < pc_lives; i++) {
-			wprintw(battle_menu, "@ ");
-		}
-		wattroff(battle_menu, COLOR_PAIR(COLOR_BLUE));
-		wprintw(battle_menu, ">");
-		wprintw(battle_menu, "  ");
+    io_print_changed(battle_menu, 11, 26, 0, "L:%d | %3d/%3d ", a.get_lvl(), a.get_chp(), a.get_hp());
+		io_print_lives(battle_menu, 12, 26, COLOR_PAIR(COLOR_BLUE), pc_lives);
 
 		if (!mode) {
-			mvwprintw(battle_menu, 16, 18, "Options: [Z] Fight | [X] Bag | [V] Switch");
+			io_print_changed(battle_menu, 16, 18, 0, "Options: [Z] Fight | [X] Bag | [V] Switch");
 		} else {
-			mvwprintw(battle_menu, 16, 13, "Options: [Z] Fight | [X] Bag | [C] Run | [V] Switch");
+			io_print_changed(battle_menu, 16, 13, 0, "Options: [Z] Fight | [X] Bag | [C] Run | [V] Switch");
 		}
     // mvwprintw(battle_menu, 17, 29, "Press [Esc] To Exit");
 
@@ -915,19 +1423,19 @@ int32_t battle_menu(int mode, npc* n = NULL, pokemon* w = NULL) {
 			ly = 4;
 			if (a.get_chp() <= 0) {
 				if (pc_lives > 0) {
-					ungetch('V');
+					io_ungetch('V');
 				} else {
 					end_battle = 1;
 					pc_move = 100;
 					break;
 				}
 			}
-			switch(wgetch(battle_menu)) {
+			switch(io_getch(battle_menu)) {
 			case 27:
 				end_battle = 1;
 				pc_move = 100;
-				ungetch('>');
-				if (!mode)	{ n->defeated = 1; }
+				io_ungetch('>');
+				if (!mode)	{ world.cur_map->npcs.defeated[n->id] = 1; }
 				else {
 					if (world.pc.num_buddies < 6) {
 						world.pc.buddy[world.pc.num_buddies++] = &f;
@@ -953,7 +1461,7 @@ int32_t battle_menu(int mode, npc* n = NULL, pokemon* w = NULL) {
 				}
 				if (i == 1) {
 					mvwprintw(battle_menu, (++ly)++, 3, "[1]      /[0]");
-					switch(wgetch(battle_menu)) {
+					switch(io_getch(battle_menu)) {
 					 case '1':
 						pc_priority = a.move_priority(0);
 						pc_move = 0;
@@ -966,7 +1474,7 @@ int32_t battle_menu(int mode, npc* n = NULL, pokemon* w = NULL) {
 					}
 				} else if (i == 2) {
 					mvwprintw(battle_menu, (++ly)++, 3, "[1|2]    /[0]");
-					switch(wgetch(battle_menu)) {
+					switch(io_getch(battle_menu)) {
 					case '1':
 						pc_priority = a.move_priority(0);
 						pc_move = 0;
@@ -981,7 +1489,7 @@ int32_t battle_menu(int mode, npc* n = NULL, pokemon* w = NULL) {
 					}
 				} else if (i == 3) {
 					mvwprintw(battle_menu, (++ly)++, 3, "[1|2|3]  /[0]");
-					switch(wgetch(battle_menu)) {
+					switch(io_getch(battle_menu)) {
 					case '1':
 						pc_priority = a.move_priority(0);
 						pc_move = 0;
@@ -1011,6 +1519,8 @@ int32_t battle_menu(int mode, npc* n = NULL, pokemon* w = NULL) {
 				mvwprintw(battle_menu, ry++, 56, "Your action: Bag  ");
 
 				pc_move = io_inventory(mode + 1);
+				/* The bag was drawn over us */
+				touchwin(battle_menu);
 				if (pc_move < 0) {
 					mvwprintw(battle_menu, --ry, 56, "%18s", "");
 				}
@@ -1069,7 +1579,7 @@ int32_t battle_menu(int mode, npc* n = NULL, pokemon* w = NULL) {
             break;
           }
 
-				switch(wgetch(battle_menu)) {
+				switch(io_getch(battle_menu)) {
 				case '1':
 					j = 1;
 					pc_move += j;
@@ -1111,7 +1621,7 @@ int32_t battle_menu(int mode, npc* n = NULL, pokemon* w = NULL) {
 			n_priority = INT_MAX;
 			n_move = 30;
 		} else {
-			if (!mode) 	{ n->defeated = 1; }
+			if (!mode) 	{ world.cur_map->npcs.defeated[n->id] = 1; }
 			else				{ delete w; }
 			end_battle = 1;
 			break;
@@ -1130,8 +1640,8 @@ int32_t battle_menu(int mode, npc* n = NULL, pokemon* w = NULL) {
       mvwprintw(battle_menu, (++ry)++, 58, "Opp. Acts First");
 
 			end_battle = enemy_turn(battle_menu, ry, n_move, n_lives, f, a, n);
-			wrefresh(battle_menu);
-			usleep(250000);
+			render_refresh(battle_menu);
+			io_delay(250000);
 			end_battle = end_battle ? 1 : pc_turn(battle_menu, ry, pc_move, pc_lives, a, &f);
 
 			// if (n_move < 5) {
@@ -1219,8 +1729,8 @@ int32_t battle_menu(int mode, npc* n = NULL, pokemon* w = NULL) {
       mvwprintw(battle_menu, (++ry)++, 61, "You Act First");
 
 			end_battle = pc_turn(battle_menu, ry, pc_move, pc_lives, a, &f);
-			wrefresh(battle_menu);
-			usleep(125000);
+			render_refresh(battle_menu);
+			io_delay(125000);
 			end_battle = end_battle ? 1 : enemy_turn(battle_menu, ry, n_move, n_lives, f, a, n);
 
 			// if (pc_move < 5) {
@@ -1310,28 +1820,32 @@ int32_t battle_menu(int mode, npc* n = NULL, pokemon* w = NULL) {
       end_battle = 1;
     }
     if (n_lives == 0) {
-      if (!mode) { n->defeated = 1; }
+      if (!mode) { world.cur_map->npcs.defeated[n->id] = 1; }
 			else			 { delete w; }
       end_battle = 1;
     }
     mvwprintw(battle_menu, ++ry, 64, "[ ] Cont");
-    while (wgetch(battle_menu) != ' ') 
-			{ box(battle_menu, 0, 0 );
-				wrefresh(battle_menu);		}
+    while (io_getch(battle_menu) != ' ')
+      ;
     // wrefresh(battle_menu);
   } while (!end_battle);
 
-  close_popup(battle_menu);
+  hide_popup(battle_menu);
 
 	victor = pc_lives;
   return victor;
 }
 
-void io_battle(character *aggressor, character *defender)
+static void io_trainer_battle(character *aggressor, character *defender)
 {
   std::string s;
   npc *n = (npc *) ((aggressor == &world.pc) ? defender : aggressor);
   // int i;
+
+  if (world.headless) {
+    sim_battle(n);
+    return;
+  }
   if (aggressor == &world.pc) {
     io_queue_message("You ask Trainer %c to Battle!", n->symbol);
   } else {
@@ -1365,8 +1879,9 @@ void io_battle(character *aggressor, character *defender)
   io_print_message_queue(0, 0);
 
   if (battle_menu(0, n)) {
-		if (n->ctype == char_hiker || n->ctype == char_rival) {
-			n->mtype = move_wander;
+		if (world.cur_map->npcs.ctype[n->id] == char_hiker ||
+		    world.cur_map->npcs.ctype[n->id] == char_rival) {
+			world.cur_map->npcs.mtype[n->id] = move_wander;
 		}
 	}
 
@@ -1375,6 +1890,8 @@ void io_battle(character *aggressor, character *defender)
 
 uint32_t move_pc_dir(uint32_t input, pair_t dest)
 {
+  character *n;
+
   dest[dim_y] = world.pc.pos[dim_y];
   dest[dim_x] = world.pc.pos[dim_x];
 
@@ -1421,14 +1938,12 @@ uint32_t move_pc_dir(uint32_t input, pair_t dest)
     break;
   }
 
-  if (world.cur_map->cmap[dest[dim_y]][dest[dim_x]]) {
-    if (dynamic_cast<npc *> (world.cur_map->cmap[dest[dim_y]][dest[dim_x]]) &&
-        ((npc *) world.cur_map->cmap[dest[dim_y]][dest[dim_x]])->defeated) {
+  if ((n = world.cur_map->cmap[dest[dim_y]][dest[dim_x]]) && !is_pc(n)) {
+    if (world.cur_map->npcs.defeated[((npc *) n)->id]) {
       // Some kind of greeting here would be nice
       return 1;
-    } else if ((dynamic_cast<npc *>
-                (world.cur_map->cmap[dest[dim_y]][dest[dim_x]]))) {
-      io_battle(&world.pc, world.cur_map->cmap[dest[dim_y]][dest[dim_x]]);
+    } else {
+      io_battle(&world.pc, n);
       // Not actually moving, so set dest back to PC position
       dest[dim_x] = world.pc.pos[dim_x];
       dest[dim_y] = world.pc.pos[dim_y];
@@ -1443,32 +1958,70 @@ uint32_t move_pc_dir(uint32_t input, pair_t dest)
   return 0;
 }
 
+/* mvscanw(y, x, "%d", v), echoing as it goes, but with keys from    *
+ * render_getch() so that it works with any backend.  Leaves *v alone *
+ * unless a number was typed.  Takes digits, a leading minus sign,    *
+ * and backspace, up to enter.                                        */
+static void io_scan_int(int y, int x, int *v)
+{
+  char buf[12];
+  int key, n;
+
+  move(y, x);
+  n = 0;
+  while ((key = render_getch(NULL)) != '\n' && key != '\r' &&
+         key != KEY_ENTER) {
+    if (key == ERR) {
+      io_input_gone();
+      continue;
+    }
+    if (key == KEY_BACKSPACE || key == 127 || key == '\b') {
+      if (n) {
+        mvaddch(y, x + --n, ' ');
+        move(y, x + n);
+      }
+    } else if (n < (int) sizeof (buf) - 1 &&
+               (isdigit(key) || (key == '-' && !n))) {
+      buf[n++] = key;
+      addch(key);
+    }
+  }
+  buf[n] = '\0';
+
+  sscanf(buf, "%d", v);
+}
+
 void io_teleport_world(pair_t dest)
 {
-  /* mvscanw documentation is unclear about return values.  I believe *
-   * that the return value works the same way as scanf, but instead   *
-   * of counting on that, we'll initialize x and y to out of bounds   *
-   * values and accept their updates only if in range.                */
+  /* Initialize x and y to out of bounds values and accept their *
+   * updates only if in range.                                   */
   int x = INT_MAX, y = INT_MAX;
   
-  world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = NULL;
+  cmap_put(world.cur_map, world.pc.pos[dim_y], world.pc.pos[dim_x], NULL);
 
-  echo();
-  curs_set(1);
-  do {
-    mvprintw(0, 0, "Enter x [-200, 200]:           ");
-    refresh();
-    mvscanw(0, 21, (char *) "%d", &x);
-  } while (x < -200 || x > 200);
-  do {
-    mvprintw(0, 0, "Enter y [-200, 200]:          ");
-    refresh();
-    mvscanw(0, 21, (char *) "%d", &y);
-  } while (y < -200 || y > 200);
-
-  refresh();
-  noecho();
-  curs_set(0);
+  if (replay_mode == replay_play) {
+    x = replay_int();
+    y = replay_int();
+  } else {
+    render_cursor(1);
+    do {
+      mvprintw(0, 0, "Enter x [-200, 200]:           ");
+      io_scan_int(0, 21, &x);
+    } while (x < -200 || x > 200);
+    do {
+      mvprintw(0, 0, "Enter y [-200, 200]:          ");
+      io_scan_int(0, 21, &y);
+    } while (y < -200 || y > 200);
+
+    render_refresh(NULL);
+    render_cursor(0);
+
+    /* Typed, not read a key at a time; record the numbers instead. */
+    if (replay_mode == replay_record) {
+      replay_record_int(x);
+      replay_record_int(y);
+    }
+  }
 
   x += 200;
   y += 200;
@@ -1486,7 +2039,7 @@ void io_handle_input(pair_t dest)
   int key;
 
   do {
-    switch (key = getch()) {
+    switch (key = io_getch_turn()) {
     case '7':
     case 'y':
     case KEY_HOME:
@@ -1548,11 +2101,15 @@ void io_handle_input(pair_t dest)
     case 't':
       io_list_trainers();
       turn_not_consumed = 1;
+      break;
+    case 'E':
+      io_list_encounters();
+      turn_not_consumed = 1;
       break;
 		case 'B':
 			io_inventory(0);
 			turn_not_consumed = 1;
-			io_display();
+			io_redraw();
 			break;
     case 'p':
       /* Teleport the PC to a random place in the map.              */
@@ -1568,7 +2125,7 @@ void io_handle_input(pair_t dest)
 		case 'M':
 			io_wmap();
       turn_not_consumed = 1;
-			io_display();
+			io_redraw();
       break;
     case 'q':
       /* Demonstrate use of the message queue.  You can use this for *
@@ -1608,15 +2165,20 @@ void io_handle_input(pair_t dest)
       mvprintw(0, 0, "Unbound key: %#o ", key);
       turn_not_consumed = 1;
     }
-    refresh();
+    render_refresh(NULL);
   } while (turn_not_consumed);
 }
 
-void io_encounter_pokemon()
+static void io_wild_battle()
 {
   pokemon *p;
 
-  p = new pokemon();
+  if (world.headless) {
+    sim_encounter();
+    return;
+  }
+
+  p = encounter_next();
 
   io_queue_message("%s%s%s: HP:%d ATK:%d DEF:%d SPATK:%d SPDEF:%d SPEED:%d %s",
                    p->is_shiny() ? "*" : "", p->get_species(),
@@ -1632,18 +2194,42 @@ void io_encounter_pokemon()
   // delete p;
 }
 
+/* Battles are timed apart from the rest of play. */
+void io_battle(character *aggressor, character *defender)
+{
+  phase_t old;
+
+  old = phase_enter(phase_battle);
+  io_trainer_battle(aggressor, defender);
+  phase_enter(old);
+}
+
+void io_encounter_pokemon()
+{
+  phase_t old;
+
+  old = phase_enter(phase_battle);
+  io_wild_battle();
+  phase_enter(old);
+}
+
 void io_choose_starter()
 {
   class pokemon *choice[3];
   int i;
   bool again = true;
+
+  if (world.headless) {
+    sim_choose_starter();
+    return;
+  }
   
   choice[0] = new class pokemon();
   choice[1] = new class pokemon();
   choice[2] = new class pokemon();
 
   echo();
-  curs_set(1);
+  render_cursor(1);
   do {
     mvprintw( 4, 20, "Before you are three Pokemon, each of");
     mvprintw( 5, 20, "which wants absolutely nothing more");
@@ -1655,8 +2241,8 @@ void io_choose_starter()
     mvprintw(13, 20, "   3) %s", choice[2]->get_species());
     mvprintw(15, 20, "Enter 1, 2, or 3: ");
 
-    refresh();
-    i = getch();
+    render_refresh(NULL);
+    i = io_getch(NULL);
 
     if (i == '1' || i == '2' || i == '3') {
       world.pc.buddy[0] = choice[(i - '0') - 1];
@@ -1667,5 +2253,5 @@ void io_choose_starter()
     }
   } while (again);
   noecho();
-  curs_set(0);
+  render_cursor(0);
 }
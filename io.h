@@ -10,9 +10,14 @@ void io_reset_terminal(void);
 void io_display(void);
 void io_handle_input(pair_t dest);
 void io_queue_message(const char *format, ...);
+/* io_queue_message() for one thread besides the game's own; lock-free, *
+ * and shown at the game's next display.                                */
+void io_post_message(const char *format, ...);
 void io_battle(character *aggressor, character *defender);
 void io_encounter_pokemon();
 void io_choose_starter();
+uint32_t move_pc_dir(uint32_t input, pair_t dest);
+uint32_t io_teleport_pc(pair_t dest);
 
 
 
@@ -0,0 +1,787 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "heap.h"
+#include "pqueue.h"
+#include "curse.h"
+#include "mapgen.h"
+#include "path.h"
+
+const char *road_backend_name[num_road_backends] = {
+  "dijkstra",
+  "binary",
+  "4ary",
+  "pairing",
+};
+
+road_backend_t road_backend = road_dijkstra;
+
+struct path_less {
+  bool operator()(const path_t *key, const path_t *with) const
+  {
+    return key->cost < with->cost;
+  }
+};
+
+static int32_t edge_penalty(int8_t x, int8_t y)
+{
+  return (x == 1 || y == 1 || x == MAP_X - 2 || y == MAP_Y - 2) ? 2 : 1;
+}
+
+/* Relaxes the edge from p to its neighbor at offset (dx, dy). */
+#define road_relax(dx, dy) ({                                              \
+  int32_t _x = p->pos[dim_x] + (dx), _y = p->pos[dim_y] + (dy);            \
+  if (queued[_y][_x] &&                                                    \
+      (path[_y][_x].cost >                                                 \
+       ((p->cost + heightpair(p->pos)) * edge_penalty(_x, _y)))) {         \
+    path[_y][_x].cost =                                                    \
+      ((p->cost + heightpair(p->pos)) * edge_penalty(_x, _y));             \
+    path[_y][_x].from[dim_y] = p->pos[dim_y];                              \
+    path[_y][_x].from[dim_x] = p->pos[dim_x];                              \
+    q.decrease(hn[_y][_x]);                                                \
+    path_stats.heap_ops++;                                                 \
+  }                                                                        \
+})
+
+template <class Q>
+static void route(map *m, pair_t from, pair_t to)
+{
+  static Q q;
+  static path_t path[MAP_Y][MAP_X], *p;
+  static path_t *items[MAP_Y * MAP_X];
+  static typename Q::handle_t hn[MAP_Y][MAP_X], handles[MAP_Y * MAP_X];
+  static uint8_t queued[MAP_Y][MAP_X];
+  static uint32_t initialized = 0;
+  int32_t x, y, i, n;
+
+  if (!initialized) {
+    q.reserve(MAP_X * MAP_Y);
+    for (y = 0; y < MAP_Y; y++) {
+      for (x = 0; x < MAP_X; x++) {
+        path[y][x].pos[dim_y] = y;
+        path[y][x].pos[dim_x] = x;
+      }
+    }
+    initialized = 1;
+  }
+  
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      path[y][x].cost = INT_MAX;
+    }
+  }
+
+  path[from[dim_y]][from[dim_x]].cost = 0;
+
+  memset(queued, 0, sizeof (queued));
+  for (n = 0, y = 1; y < MAP_Y - 1; y++) {
+    for (x = 1; x < MAP_X - 1; x++) {
+      items[n++] = &path[y][x];
+      queued[y][x] = 1;
+    }
+  }
+  q.build(items, n, handles);
+  for (i = 0; i < n; i++) {
+    hn[items[i]->pos[dim_y]][items[i]->pos[dim_x]] = handles[i];
+  }
+  path_stats.heap_ops++;
+
+  while ((p = q.pop())) {
+    queued[p->pos[dim_y]][p->pos[dim_x]] = 0;
+    path_stats.expanded++;
+    path_stats.heap_ops++;
+
+    if ((p->pos[dim_y] == to[dim_y]) && p->pos[dim_x] == to[dim_x]) {
+      for (x = to[dim_x], y = to[dim_y];
+           (x != from[dim_x]) || (y != from[dim_y]);
+           p = &path[y][x], x = p->from[dim_x], y = p->from[dim_y]) {
+        /* Don't overwrite the gate */
+        if (x != to[dim_x] || y != to[dim_y]) {
+          mapxy(x, y) = ter_path;
+          heightxy(x, y) = 0;
+        }
+      }
+      q.clear();
+      return;
+    }
+
+    road_relax( 0, -1);
+    road_relax(-1,  0);
+    road_relax( 1,  0);
+    road_relax( 0,  1);
+  }
+}
+
+#undef road_relax
+
+void dijkstra_path(map *m, pair_t from, pair_t to)
+{
+  switch (road_backend) {
+  case road_binary:
+    route<pq_binary<path_t *, path_less> >(m, from, to);
+    break;
+  case road_dary:
+    route<pq_4ary<path_t *, path_less> >(m, from, to);
+    break;
+  case road_pairing:
+    route<pq_pairing<path_t *, path_less> >(m, from, to);
+    break;
+  default:
+    route<pq_fibonacci<path_t *, path_less> >(m, from, to);
+    break;
+  }
+}
+
+int build_paths(map *m)
+{
+  pair_t from, to;
+
+  /*  printf("%d %d %d %d\n", m->n, m->s, m->e, m->w);*/
+
+  if (m->e != -1 && m->w != -1) {
+    from[dim_x] = 1;
+    to[dim_x] = MAP_X - 2;
+    from[dim_y] = m->w;
+    to[dim_y] = m->e;
+
+    dijkstra_path(m, from, to);
+  }
+
+  if (m->n != -1 && m->s != -1) {
+    from[dim_y] = 1;
+    to[dim_y] = MAP_Y - 2;
+    from[dim_x] = m->n;
+    to[dim_x] = m->s;
+
+    dijkstra_path(m, from, to);
+  }
+
+  if (m->e == -1) {
+    if (m->s == -1) {
+      from[dim_x] = 1;
+      from[dim_y] = m->w;
+      to[dim_x] = m->n;
+      to[dim_y] = 1;
+    } else {
+      from[dim_x] = 1;
+      from[dim_y] = m->w;
+      to[dim_x] = m->s;
+      to[dim_y] = MAP_Y - 2;
+    }
+
+    dijkstra_path(m, from, to);
+  }
+
+  if (m->w == -1) {
+    if (m->s == -1) {
+      from[dim_x] = MAP_X - 2;
+      from[dim_y] = m->e;
+      to[dim_x] = m->n;
+      to[dim_y] = 1;
+    } else {
+      from[dim_x] = MAP_X - 2;
+      from[dim_y] = m->e;
+      to[dim_x] = m->s;
+      to[dim_y] = MAP_Y - 2;
+    }
+
+    dijkstra_path(m, from, to);
+  }
+
+  if (m->n == -1) {
+    if (m->e == -1) {
+      from[dim_x] = 1;
+      from[dim_y] = m->w;
+      to[dim_x] = m->s;
+      to[dim_y] = MAP_Y - 2;
+    } else {
+      from[dim_x] = MAP_X - 2;
+      from[dim_y] = m->e;
+      to[dim_x] = m->s;
+      to[dim_y] = MAP_Y - 2;
+    }
+
+    dijkstra_path(m, from, to);
+  }
+
+  if (m->s == -1) {
+    if (m->e == -1) {
+      from[dim_x] = 1;
+      from[dim_y] = m->w;
+      to[dim_x] = m->n;
+      to[dim_y] = 1;
+    } else {
+      from[dim_x] = MAP_X - 2;
+      from[dim_y] = m->e;
+      to[dim_x] = m->n;
+      to[dim_y] = 1;
+    }
+
+    dijkstra_path(m, from, to);
+  }
+
+  return 0;
+}
+
+static int gaussian[5][5] = {
+  {  1,  4,  7,  4,  1 },
+  {  4, 16, 26, 16,  4 },
+  {  7, 26, 41, 26,  7 },
+  {  4, 16, 26, 16,  4 },
+  {  1,  4,  7,  4,  1 }
+};
+
+int smooth_height(map *m)
+{
+  int32_t i, x, y;
+  int32_t s, t, p, q;
+  queue_node_t *head, *tail, *tmp;
+  /*  FILE *out;*/
+  uint8_t height[MAP_Y][MAP_X];
+
+  memset(&height, 0, sizeof (height));
+
+  /* Seed with some values */
+  for (i = 1; i < 255; i += 20) {
+    do {
+      x = rand() % MAP_X;
+      y = rand() % MAP_Y;
+    } while (height[y][x]);
+    height[y][x] = i;
+    if (i == 1) {
+      head = tail = (queue_node_t *) malloc(sizeof (*tail));
+    } else {
+      tail->next = (queue_node_t *) malloc(sizeof (*tail));
+      tail = tail->next;
+    }
+    tail->next = NULL;
+    tail->x = x;
+    tail->y = y;
+  }
+
+  /*
+  out = fopen("seeded.pgm", "w");
+  fprintf(out, "P5\n%u %u\n255\n", MAP_X, MAP_Y);
+  fwrite(&height, sizeof (height), 1, out);
+  fclose(out);
+  */
+  
+  /* Diffuse the vaules to fill the space */
+  while (head) {
+    x = head->x;
+    y = head->y;
+    i = height[y][x];
+
+    if (x - 1 >= 0 && y - 1 >= 0 && !height[y - 1][x - 1]) {
+      height[y - 1][x - 1] = i;
+      tail->next = (queue_node_t *) malloc(sizeof (*tail));
+      tail = tail->next;
+      tail->next = NULL;
+      tail->x = x - 1;
+      tail->y = y - 1;
+    }
+    if (x - 1 >= 0 && !height[y][x - 1]) {
+      height[y][x - 1] = i;
+      tail->next = (queue_node_t *) malloc(sizeof (*tail));
+      tail = tail->next;
+      tail->next = NULL;
+      tail->x = x - 1;
+      tail->y = y;
+    }
+    if (x - 1 >= 0 && y + 1 < MAP_Y && !height[y + 1][x - 1]) {
+      height[y + 1][x - 1] = i;
+      tail->next = (queue_node_t *) malloc(sizeof (*tail));
+      tail = tail->next;
+      tail->next = NULL;
+      tail->x = x - 1;
+      tail->y = y + 1;
+    }
+    if (y - 1 >= 0 && !height[y - 1][x]) {
+      height[y - 1][x] = i;
+      tail->next = (queue_node_t *) malloc(sizeof (*tail));
+      tail = tail->next;
+      tail->next = NULL;
+      tail->x = x;
+      tail->y = y - 1;
+    }
+    if (y + 1 < MAP_Y && !height[y + 1][x]) {
+      height[y + 1][x] = i;
+      tail->next = (queue_node_t *) malloc(sizeof (*tail));
+      tail = tail->next;
+      tail->next = NULL;
+      tail->x = x;
+      tail->y = y + 1;
+    }
+    if (x + 1 < MAP_X && y - 1 >= 0 && !height[y - 1][x + 1]) {
+      height[y - 1][x + 1] = i;
+      tail->next = (queue_node_t *) malloc(sizeof (*tail));
+      tail = tail->next;
+      tail->next = NULL;
+      tail->x = x + 1;
+      tail->y = y - 1;
+    }
+    if (x + 1 < MAP_X && !height[y][x + 1]) {
+      height[y][x + 1] = i;
+      tail->next = (queue_node_t *) malloc(sizeof (*tail));
+      tail = tail->next;
+      tail->next = NULL;
+      tail->x = x + 1;
+      tail->y = y;
+    }
+    if (x + 1 < MAP_X && y + 1 < MAP_Y && !height[y + 1][x + 1]) {
+      height[y + 1][x + 1] = i;
+      tail->next = (queue_node_t *) malloc(sizeof (*tail));
+      tail = tail->next;
+      tail->next = NULL;
+      tail->x = x + 1;
+      tail->y = y + 1;
+    }
+
+    tmp = head;
+    head = head->next;
+    free(tmp);
+  }
+
+  /* And smooth it a bit with a gaussian convolution */
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      for (s = t = p = 0; p < 5; p++) {
+        for (q = 0; q < 5; q++) {
+          if (y + (p - 2) >= 0 && y + (p - 2) < MAP_Y &&
+              x + (q - 2) >= 0 && x + (q - 2) < MAP_X) {
+            s += gaussian[p][q];
+            t += height[y + (p - 2)][x + (q - 2)] * gaussian[p][q];
+          }
+        }
+      }
+      m->height[y][x] = t / s;
+    }
+  }
+  /* Let's do it again, until it's smooth like Kenny G. */
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      for (s = t = p = 0; p < 5; p++) {
+        for (q = 0; q < 5; q++) {
+          if (y + (p - 2) >= 0 && y + (p - 2) < MAP_Y &&
+              x + (q - 2) >= 0 && x + (q - 2) < MAP_X) {
+            s += gaussian[p][q];
+            t += height[y + (p - 2)][x + (q - 2)] * gaussian[p][q];
+          }
+        }
+      }
+      m->height[y][x] = t / s;
+    }
+  }
+
+  /*
+  out = fopen("diffused.pgm", "w");
+  fprintf(out, "P5\n%u %u\n255\n", MAP_X, MAP_Y);
+  fwrite(&height, sizeof (height), 1, out);
+  fclose(out);
+
+  out = fopen("smoothed.pgm", "w");
+  fprintf(out, "P5\n%u %u\n255\n", MAP_X, MAP_Y);
+  fwrite(&m->height, sizeof (m->height), 1, out);
+  fclose(out);
+  */
+
+  return 0;
+}
+
+static void find_building_location(map *m, pair_t p)
+{
+  do {
+    p[dim_x] = rand() % (MAP_X - 3) + 1;
+    p[dim_y] = rand() % (MAP_Y - 3) + 1;
+
+    if ((((mapxy(p[dim_x] - 1, p[dim_y]    ) == ter_path)     &&
+          (mapxy(p[dim_x] - 1, p[dim_y] + 1) == ter_path))    ||
+         ((mapxy(p[dim_x] + 2, p[dim_y]    ) == ter_path)     &&
+          (mapxy(p[dim_x] + 2, p[dim_y] + 1) == ter_path))    ||
+         ((mapxy(p[dim_x]    , p[dim_y] - 1) == ter_path)     &&
+          (mapxy(p[dim_x] + 1, p[dim_y] - 1) == ter_path))    ||
+         ((mapxy(p[dim_x]    , p[dim_y] + 2) == ter_path)     &&
+          (mapxy(p[dim_x] + 1, p[dim_y] + 2) == ter_path)))   &&
+        (((mapxy(p[dim_x]    , p[dim_y]    ) != ter_mart)     &&
+          (mapxy(p[dim_x]    , p[dim_y]    ) != ter_center)   &&
+          (mapxy(p[dim_x] + 1, p[dim_y]    ) != ter_mart)     &&
+          (mapxy(p[dim_x] + 1, p[dim_y]    ) != ter_center)   &&
+          (mapxy(p[dim_x]    , p[dim_y] + 1) != ter_mart)     &&
+          (mapxy(p[dim_x]    , p[dim_y] + 1) != ter_center)   &&
+          (mapxy(p[dim_x] + 1, p[dim_y] + 1) != ter_mart)     &&
+          (mapxy(p[dim_x] + 1, p[dim_y] + 1) != ter_center))) &&
+        (((mapxy(p[dim_x]    , p[dim_y]    ) != ter_path)     &&
+          (mapxy(p[dim_x] + 1, p[dim_y]    ) != ter_path)     &&
+          (mapxy(p[dim_x]    , p[dim_y] + 1) != ter_path)     &&
+          (mapxy(p[dim_x] + 1, p[dim_y] + 1) != ter_path)))) {
+          break;
+    }
+  } while (1);
+}
+
+int place_pokemart(map *m)
+{
+  pair_t p;
+
+  find_building_location(m, p);
+
+  mapxy(p[dim_x]    , p[dim_y]    ) = ter_mart;
+  mapxy(p[dim_x] + 1, p[dim_y]    ) = ter_mart;
+  mapxy(p[dim_x]    , p[dim_y] + 1) = ter_mart;
+  mapxy(p[dim_x] + 1, p[dim_y] + 1) = ter_mart;
+
+  return 0;
+}
+
+int place_center(map *m)
+{  pair_t p;
+
+  find_building_location(m, p);
+
+  mapxy(p[dim_x]    , p[dim_y]    ) = ter_center;
+  mapxy(p[dim_x] + 1, p[dim_y]    ) = ter_center;
+  mapxy(p[dim_x]    , p[dim_y] + 1) = ter_center;
+  mapxy(p[dim_x] + 1, p[dim_y] + 1) = ter_center;
+
+  return 0;
+}
+
+void map_masks(map *m)
+{
+  int x, y, c;
+
+  m->water.clear();
+  m->path.clear();
+  for (c = 0; c < num_character_types; c++) {
+    m->passable[c].clear();
+  }
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      if (m->map[y][x] == ter_water) {
+        m->water.set(x, y);
+      } else if (m->map[y][x] == ter_path) {
+        m->path.set(x, y);
+      }
+      for (c = 0; c < num_character_types; c++) {
+        if (move_cost[c][m->map[y][x]] < NO_NPCS) {
+          m->passable[c].set(x, y);
+        }
+      }
+    }
+  }
+  m->sight = m->water | m->path;
+  m->near_water = m->water.neighbors();
+  m->swim = m->water | (m->path & m->near_water);
+  m->view.clear();
+  memset(m->view_slot, 0xff, sizeof (m->view_slot));
+}
+
+/* Chooses tree or boulder for border cell.  Choice is biased by dominance *
+ * of neighboring cells.                                                   */
+static terrain_type_t border_type(map *m, int32_t x, int32_t y)
+{
+  int32_t p, q;
+  int32_t r, t;
+  int32_t miny, minx, maxy, maxx;
+  
+  r = t = 0;
+  
+  miny = y - 1 >= 0 ? y - 1 : 0;
+  maxy = y + 1 <= MAP_Y ? y + 1: MAP_Y;
+  minx = x - 1 >= 0 ? x - 1 : 0;
+  maxx = x + 1 <= MAP_X ? x + 1: MAP_X;
+
+  for (q = miny; q < maxy; q++) {
+    for (p = minx; p < maxx; p++) {
+      if (q != y || p != x) {
+        if (m->map[q][p] == ter_mountain ||
+            m->map[q][p] == ter_boulder) {
+          r++;
+        } else if (m->map[q][p] == ter_forest ||
+                   m->map[q][p] == ter_tree) {
+          t++;
+        }
+      }
+    }
+  }
+  
+  if (t == r) {
+    return rand() & 1 ? ter_boulder : ter_tree;
+  } else if (t > r) {
+    if (rand() % 10) {
+      return ter_tree;
+    } else {
+      return ter_boulder;
+    }
+  } else {
+    if (rand() % 10) {
+      return ter_boulder;
+    } else {
+      return ter_tree;
+    }
+  }
+}
+
+int map_terrain(map *m, int8_t n, int8_t s, int8_t e, int8_t w)
+{
+  int32_t i, x, y;
+  queue_node_t *head, *tail, *tmp;
+  //  FILE *out;
+  int num_grass, num_clearing, num_mountain, num_forest, num_water, num_total;
+  terrain_type_t type;
+  int added_current = 0;
+  
+  switch (m->geotype) {
+   case geo_plain:
+    num_grass = rand() % 5 + 3;
+    num_clearing = rand() % 5 + 3;
+    num_mountain = 0;
+    num_forest = rand() % 2;
+    num_water = 0;
+    break;
+   case geo_wet:
+    num_grass = rand() % 3;
+    num_clearing = rand() % 3;
+    num_mountain = 0;
+    num_forest = 0;
+    num_water = rand() % 4 + 3;
+    break;
+   case geo_woods:
+    num_grass = rand() % 2 + 1;
+    num_clearing = rand() % 2;
+    num_mountain = 0;
+    num_forest = rand() % 4 + 2;
+    num_water = rand() % 2;
+    break;
+   case geo_cliffs:
+    num_grass = rand() % 3 + 1;
+    num_clearing = rand() % 3 + 1;
+    num_mountain = rand() % 4 + 2;
+    num_forest = rand() % 2;
+    num_water = rand() % 2;
+    break;
+   case geo_mountain:
+    num_grass = rand() % 2;
+    num_clearing = rand() % 2 + 1;
+    num_mountain = rand() % 5 + 3;
+    num_forest = 0;
+    num_water = rand() % 2;
+   default:
+    num_grass = rand() % 4 + 2;
+    num_clearing = rand() % 4 + 2;
+    num_mountain = rand() % 2 + 1;
+    num_forest = rand() % 2 + 1;
+    num_water = rand() % 2 + 1;
+    break;
+  }
+
+  num_total = num_grass + num_clearing + num_mountain + num_forest + num_water;
+
+  memset(&m->map, 0, sizeof (m->map));
+
+  /* Seed with some values */
+  for (i = 0; i < num_total; i++) {
+    do {
+      x = rand() % MAP_X;
+      y = rand() % MAP_Y;
+    } while (m->map[y][x]);
+    if (i == 0 && num_grass != 0) {
+      type = ter_grass;
+    } else if (i == num_grass && num_clearing != 0) {
+      type = ter_clearing;
+    } else if (i == num_grass + num_clearing && num_mountain != 0) {
+      type = ter_mountain;
+    } else if (i == num_grass + num_clearing + num_mountain && num_forest != 0) {
+      type = ter_forest;
+    } else if (i == num_grass + num_clearing + num_mountain + num_forest && num_water != 0) {
+      type = ter_water;
+    }
+    m->map[y][x] = type;
+    if (i == 0) {
+      head = tail = (queue_node_t *) malloc(sizeof (*tail));
+    } else {
+      tail->next = (queue_node_t *) malloc(sizeof (*tail));
+      tail = tail->next;
+    }
+    tail->next = NULL;
+    tail->x = x;
+    tail->y = y;
+  }
+
+  /*
+  out = fopen("seeded.pgm", "w");
+  fprintf(out, "P5\n%u %u\n255\n", MAP_X, MAP_Y);
+  fwrite(&m->map, sizeof (m->map), 1, out);
+  fclose(out);
+  */
+
+  /* Diffuse the vaules to fill the space */
+  while (head) {
+    x = head->x;
+    y = head->y;
+    type = m->map[y][x];
+    
+    if (x - 1 >= 0 && !m->map[y][x - 1]) {
+      if ((rand() % 100) < 80) {
+        m->map[y][x - 1] = type;
+        tail->next = (queue_node_t *) malloc(sizeof (*tail));
+        tail = tail->next;
+        tail->next = NULL;
+        tail->x = x - 1;
+        tail->y = y;
+      } else if (!added_current) {
+        added_current = 1;
+        m->map[y][x] = type;
+        tail->next = (queue_node_t *) malloc(sizeof (*tail));
+        tail = tail->next;
+        tail->next = NULL;
+        tail->x = x;
+        tail->y = y;
+      }
+    }
+
+    if (y - 1 >= 0 && !m->map[y - 1][x]) {
+      if ((rand() % 100) < 20) {
+        m->map[y - 1][x] = type;
+        tail->next = (queue_node_t *) malloc(sizeof (*tail));
+        tail = tail->next;
+        tail->next = NULL;
+        tail->x = x;
+        tail->y = y - 1;
+      } else if (!added_current) {
+        added_current = 1;
+        m->map[y][x] = type;
+        tail->next = (queue_node_t *) malloc(sizeof (*tail));
+        tail = tail->next;
+        tail->next = NULL;
+        tail->x = x;
+        tail->y = y;
+      }
+    }
+
+    if (y + 1 < MAP_Y && !m->map[y + 1][x]) {
+      if ((rand() % 100) < 20) {
+        m->map[y + 1][x] = type;
+        tail->next = (queue_node_t *) malloc(sizeof (*tail));
+        tail = tail->next;
+        tail->next = NULL;
+        tail->x = x;
+        tail->y = y + 1;
+      } else if (!added_current) {
+        added_current = 1;
+        m->map[y][x] = type;
+        tail->next = (queue_node_t *) malloc(sizeof (*tail));
+        tail = tail->next;
+        tail->next = NULL;
+        tail->x = x;
+        tail->y = y;
+      }
+    }
+
+    if (x + 1 < MAP_X && !m->map[y][x + 1]) {
+      if ((rand() % 100) < 80) {
+        m->map[y][x + 1] = type;
+        tail->next = (queue_node_t *) malloc(sizeof (*tail));
+        tail = tail->next;
+        tail->next = NULL;
+        tail->x = x + 1;
+        tail->y = y;
+      } else if (!added_current) {
+        added_current = 1;
+        m->map[y][x] = type;
+        tail->next = (queue_node_t *) malloc(sizeof (*tail));
+        tail = tail->next;
+        tail->next = NULL;
+        tail->x = x;
+        tail->y = y;
+      }
+    }
+
+    added_current = 0;
+    tmp = head;
+    head = head->next;
+    free(tmp);
+  }
+
+  /*
+  out = fopen("diffused.pgm", "w");
+  fprintf(out, "P5\n%u %u\n255\n", MAP_X, MAP_Y);
+  fwrite(&m->map, sizeof (m->map), 1, out);
+  fclose(out);
+  */
+  
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      if (y == 0 || y == MAP_Y - 1 ||
+          x == 0 || x == MAP_X - 1) {
+        mapxy(x, y) = border_type(m, x, y);
+      }
+    }
+  }
+
+  m->n = n;
+  m->s = s;
+  m->e = e;
+  m->w = w;
+
+  if (n != -1) {
+    mapxy(n,         0        ) = ter_gate;
+    mapxy(n,         1        ) = ter_bailey;
+  }
+  if (s != -1) {
+    mapxy(s,         MAP_Y - 1) = ter_gate;
+    mapxy(s,         MAP_Y - 2) = ter_bailey;
+  }
+  if (w != -1) {
+    mapxy(0,         w        ) = ter_gate;
+    mapxy(1,         w        ) = ter_bailey;
+  }
+  if (e != -1) {
+    mapxy(MAP_X - 1, e        ) = ter_gate;
+    mapxy(MAP_X - 2, e        ) = ter_bailey;
+  }
+
+  return 0;
+}
+
+int place_boulders(map *m)
+{
+  int i;
+  int x, y;
+
+  for (i = 0; i < MIN_BOULDERS || rand() % 100 < BOULDER_PROB; i++) {
+    y = rand() % (MAP_Y - 2) + 1;
+    x = rand() % (MAP_X - 2) + 1;
+    if (m->map[y][x] != ter_forest &&
+        m->map[y][x] != ter_path   &&
+        m->map[y][x] != ter_gate   &&
+        m->map[y][x] != ter_bailey) {
+      m->map[y][x] = ter_boulder;
+    }
+  }
+
+  return 0;
+}
+
+int place_trees(map *m)
+{
+  int i;
+  int x, y;
+  
+  for (i = 0; i < MIN_TREES || rand() % 100 < TREE_PROB; i++) {
+    y = rand() % (MAP_Y - 2) + 1;
+    x = rand() % (MAP_X - 2) + 1;
+    if (m->map[y][x] != ter_mountain &&
+        m->map[y][x] != ter_path     &&
+        m->map[y][x] != ter_water    &&
+        m->map[y][x] != ter_gate     &&
+        m->map[y][x] != ter_bailey) {
+      m->map[y][x] = ter_tree;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef MAPGEN_H
+# define MAPGEN_H
+
+# include <stdint.h>
+
+# include "pair.h"
+
+class map;
+
+/* Work list for the flood fills in terrain and world generation. */
+typedef struct queue_node {
+  int x, y;
+  struct queue_node *next;
+} queue_node_t;
+
+/* Terrain generation.  None of this touches the world or the terminal, *
+ * so it can be driven on its own; new_map() calls these in order:      *
+ * smooth_height, map_terrain, place_boulders, place_trees,             *
+ * build_paths, then optionally place_pokemart and place_center.        */
+int smooth_height(map *m);
+int map_terrain(map *m, int8_t n, int8_t s, int8_t e, int8_t w);
+int place_boulders(map *m);
+int place_trees(map *m);
+int build_paths(map *m);
+int place_pokemart(map *m);
+int place_center(map *m);
+/* Builds the terrain masks in m from the finished terrain. */
+void map_masks(map *m);
+
+/* Lays a road from one gate to another along the cheapest route over *
+ * the height map, using the queue selected by road_backend.  Queues   *
+ * break ties differently, so the choice can change which of several   *
+ * equally cheap roads is laid.                                        */
+typedef enum road_backend {
+  road_dijkstra, /* Fibonacci heap from heap.c */
+  road_binary,
+  road_dary,
+  road_pairing,
+  num_road_backends
+} road_backend_t;
+
+extern const char *road_backend_name[num_road_backends];
+extern road_backend_t road_backend;
+
+void dijkstra_path(map *m, pair_t from, pair_t to);
+
+#endif
@@ -0,0 +1,565 @@
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+
+#include "heap.h"
+#include "pqueue.h"
+#include "path.h"
+
+const char *pathfind_backend_name[num_pathfind_backends] = {
+  "dijkstra",
+  "chamfer",
+  "binary",
+  "4ary",
+  "pairing",
+};
+
+pathfind_backend_t pathfind_backend = pathfind_dijkstra;
+
+path_stats_t path_stats;
+
+/* Just to make the following table fit in 80 columns */
+#define PM DIJKSTRA_PATH_MAX
+#define NN NO_NPCS
+/* Swimmers are not allowed to move onto paths in general, and this *
+ * is governed by the swimmer movement code.  However, paths over   *
+ * or adjacent to water are bridges.  They can't have inifinite     *
+ * movement cost, or it throws a wrench into the turn queue.        */
+int32_t move_cost[num_character_types][num_terrain_types] = {
+//  boulder,tree,path,mart,center,grass,clearing,mountain,forest,water,gate,bly
+  { PM, PM, 10, 10, 10, 20, 10, PM, PM, PM, 10, 10, PM },
+  { PM, PM, 10, NN, NN, 15, 10, 15, 15, PM, PM, NN, 15 },
+  { PM, PM, 10, NN, NN, 20, 10, PM, PM, PM, PM, NN, PM },
+  { PM, PM,  7, PM, PM, PM, PM, PM, PM,  7, PM, PM, PM },
+  { PM, PM, 10, NN, NN, 20, 10, PM, PM, PM, PM, PM, PM },
+};
+#undef PM
+#undef NN
+
+static int32_t path_cmp(const void *key, const void *with) {
+  return ((path_t *) key)->cost - ((path_t *) with)->cost;
+}
+
+/* Flattens a move_cost row into a per-cell grid, so that the backends  *
+ * read one byte per cell instead of chasing the terrain through a      *
+ * 32-bit table.  Impassable cells, and costs too large to hold, become *
+ * COST_INF.                                                            */
+void cost_grid(map *m, const int32_t cost[], uint8_t grid[MAP_Y][MAP_X])
+{
+  int32_t x, y;
+
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      grid[y][x] = ((cost[m->map[y][x]] < 0 ||
+                     cost[m->map[y][x]] >= COST_INF) ?
+                    COST_INF : cost[m->map[y][x]]);
+    }
+  }
+}
+
+/* Relaxes the edge leaving c toward the neighbor at offset (dx, dy). */
+#define relax(dx, dy) ({                                                   \
+  path_t *_n = &p[c->pos[dim_y] + (dy)][c->pos[dim_x] + (dx)];             \
+  if (_n->hn &&                                                            \
+      _n->cost > c->cost + cost[c->pos[dim_y]][c->pos[dim_x]]) {           \
+    _n->cost = c->cost + cost[c->pos[dim_y]][c->pos[dim_x]];               \
+    heap_decrease_key_no_replace(&h, _n->hn);                              \
+    path_stats.heap_ops++;                                                 \
+  }                                                                        \
+})
+
+void dijkstra_field(const uint8_t cost[MAP_Y][MAP_X], pair_t from,
+                    uint16_t dist[MAP_Y][MAP_X])
+{
+  static heap_t h;
+  uint32_t x, y, i, n;
+  static path_t p[MAP_Y][MAP_X], *c;
+  static path_t *items[MAP_Y * MAP_X];
+  static heap_node_t *handles[MAP_Y * MAP_X];
+  static uint32_t initialized = 0;
+
+  if (!initialized) {
+    initialized = 1;
+    heap_init(&h, path_cmp, NULL);
+    heap_reserve(&h, MAP_X * MAP_Y);
+    for (y = 0; y < MAP_Y; y++) {
+      for (x = 0; x < MAP_X; x++) {
+        p[y][x].pos[dim_y] = y;
+        p[y][x].pos[dim_x] = x;
+      }
+    }
+  }
+
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      p[y][x].cost = DIJKSTRA_PATH_MAX;
+    }
+  }
+  p[from[dim_y]][from[dim_x]].cost = 0;
+
+  for (n = 0, y = 1; y < MAP_Y - 1; y++) {
+    for (x = 1; x < MAP_X - 1; x++) {
+      if (cost[y][x] != COST_INF) {
+        items[n++] = &p[y][x];
+      } else {
+        p[y][x].hn = NULL;
+      }
+    }
+  }
+  heap_build(&h, (void *const *) items, n, handles);
+  for (i = 0; i < n; i++) {
+    items[i]->hn = handles[i];
+  }
+  path_stats.heap_ops++;
+
+  while ((c = (path_t *) heap_remove_min(&h))) {
+    c->hn = NULL;
+    path_stats.expanded++;
+    path_stats.heap_ops++;
+    relax(-1, -1);
+    relax( 0, -1);
+    relax( 1, -1);
+    relax(-1,  0);
+    relax( 1,  0);
+    relax(-1,  1);
+    relax( 0,  1);
+    relax( 1,  1);
+  }
+  heap_reset(&h);
+
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      dist[y][x] = p[y][x].cost >= DIST_INF ? DIST_INF : p[y][x].cost;
+    }
+  }
+}
+
+#undef relax
+
+struct path_less {
+  bool operator()(const path_t *key, const path_t *with) const
+  {
+    return key->cost < with->cost;
+  }
+};
+
+/* dijkstra_field() over any queue from pqueue.h.  Membership is kept in *
+ * queued[] and the queue's handles in hn[], leaving path_t's hn unused. */
+#define pq_relax(dx, dy) ({                                                \
+  int32_t _x = c->pos[dim_x] + (dx), _y = c->pos[dim_y] + (dy);            \
+  if (queued[_y][_x] &&                                                    \
+      p[_y][_x].cost > c->cost + cost[c->pos[dim_y]][c->pos[dim_x]]) {     \
+    p[_y][_x].cost = c->cost + cost[c->pos[dim_y]][c->pos[dim_x]];         \
+    q.decrease(hn[_y][_x]);                                                \
+    path_stats.heap_ops++;                                                 \
+  }                                                                        \
+})
+
+template <class Q>
+static void pq_field(const uint8_t cost[MAP_Y][MAP_X], pair_t from,
+                     uint16_t dist[MAP_Y][MAP_X])
+{
+  static Q q;
+  static path_t p[MAP_Y][MAP_X];
+  static path_t *items[MAP_Y * MAP_X];
+  static typename Q::handle_t hn[MAP_Y][MAP_X], handles[MAP_Y * MAP_X];
+  static uint8_t queued[MAP_Y][MAP_X];
+  static uint32_t initialized = 0;
+  uint32_t x, y, i, n;
+  path_t *c;
+
+  if (!initialized) {
+    initialized = 1;
+    q.reserve(MAP_X * MAP_Y);
+    for (y = 0; y < MAP_Y; y++) {
+      for (x = 0; x < MAP_X; x++) {
+        p[y][x].pos[dim_y] = y;
+        p[y][x].pos[dim_x] = x;
+      }
+    }
+  }
+
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      p[y][x].cost = DIJKSTRA_PATH_MAX;
+    }
+  }
+  p[from[dim_y]][from[dim_x]].cost = 0;
+
+  memset(queued, 0, sizeof (queued));
+  for (n = 0, y = 1; y < MAP_Y - 1; y++) {
+    for (x = 1; x < MAP_X - 1; x++) {
+      if (cost[y][x] != COST_INF) {
+        items[n++] = &p[y][x];
+        queued[y][x] = 1;
+      }
+    }
+  }
+  q.build(items, n, handles);
+  for (i = 0; i < n; i++) {
+    hn[items[i]->pos[dim_y]][items[i]->pos[dim_x]] = handles[i];
+  }
+  path_stats.heap_ops++;
+
+  while ((c = q.pop())) {
+    queued[c->pos[dim_y]][c->pos[dim_x]] = 0;
+    path_stats.expanded++;
+    path_stats.heap_ops++;
+    pq_relax(-1, -1);
+    pq_relax( 0, -1);
+    pq_relax( 1, -1);
+    pq_relax(-1,  0);
+    pq_relax( 1,  0);
+    pq_relax(-1,  1);
+    pq_relax( 0,  1);
+    pq_relax( 1,  1);
+  }
+
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      dist[y][x] = p[y][x].cost >= DIST_INF ? DIST_INF : p[y][x].cost;
+    }
+  }
+}
+
+#undef pq_relax
+
+/* Chamfer sweeps compute the same field as Dijkstra by alternating       *
+ * forward (top-left to bottom-right) and backward raster passes until    *
+ * nothing changes.  Each pass relaxes a row first against the three      *
+ * cells of the row it came from, which has no dependencies within the    *
+ * row and is done eight cells at a time, then against its horizontal     *
+ * neighbor, which is an inherently sequential scan.                      *
+ *                                                                        *
+ * Per cell we keep the distance d, the cost w of leaving it (infinite if *
+ * it's not in the graph), the outgoing value o = d + w that neighbors    *
+ * relax against, and a block value, 0 for cells in the graph and         *
+ * infinite for cells not in it, so that max(candidate, block) leaves     *
+ * border and impassable cells alone without a branch.  Rows are padded   *
+ * on both sides so that the diagonal loads never leave the array.        *
+ *                                                                        *
+ * Everything is 16 bits wide, which halves the working set and doubles  *
+ * the lanes per vector; o saturates at DIST_INF instead of wrapping.     */
+
+#define SWEEP_PAD 8
+#define SWEEP_X   (MAP_X + 2 * SWEEP_PAD)
+
+typedef uint16_t sweep_vec_t
+  __attribute__ ((vector_size (16), aligned (2), __may_alias__));
+
+#define SWEEP_LANES ((int32_t) (sizeof (sweep_vec_t) / sizeof (uint16_t)))
+#define vec(a) (*(sweep_vec_t *) &(a))
+#define vmin(a, b) ((a) < (b) ? (a) : (b))
+#define vmax(a, b) ((a) > (b) ? (a) : (b))
+#define sat_add(a, b) ((a) + (b) > DIST_INF ? DIST_INF : (a) + (b))
+
+typedef struct sweep {
+  uint16_t d[MAP_Y][SWEEP_X];
+  uint16_t w[MAP_Y][SWEEP_X];
+  uint16_t o[MAP_Y][SWEEP_X];
+  uint16_t block[MAP_Y][SWEEP_X];
+} sweep_t;
+
+/* Relaxes row y against row r (y - 1 going forward, y + 1 going back), *
+ * then along the row in direction dx.  Returns non-zero on any change. */
+static int32_t sweep_row(sweep_t *s, int32_t y, int32_t r, int32_t dx)
+{
+  sweep_vec_t c, d, o, changed;
+  int32_t x, t, first, last;
+
+  changed = (sweep_vec_t) { 0 };
+  for (x = SWEEP_PAD; x < SWEEP_PAD + MAP_X; x += SWEEP_LANES) {
+    c = vmin(vmin(vec(s->o[r][x - 1]), vec(s->o[r][x])), vec(s->o[r][x + 1]));
+    c = vmax(c, vec(s->block[y][x]));
+    d = vec(s->d[y][x]);
+    changed |= (sweep_vec_t) (c < d);
+    d = vmin(d, c);
+    vec(s->d[y][x]) = d;
+    o = d + vec(s->w[y][x]);
+    vec(s->o[y][x]) = o | (sweep_vec_t) (o < d);
+  }
+
+  for (t = 0; t < SWEEP_LANES; t++) {
+    if (changed[t]) {
+      break;
+    }
+  }
+  t = t < SWEEP_LANES;
+  path_stats.expanded += MAP_X - 2;
+
+  if (dx > 0) {
+    first = SWEEP_PAD + 1;
+    last = SWEEP_PAD + MAP_X - 1;
+  } else {
+    first = SWEEP_PAD + MAP_X - 2;
+    last = SWEEP_PAD;
+  }
+  for (x = first; x != last; x += dx) {
+    if (s->o[y][x - dx] < s->d[y][x] && !s->block[y][x]) {
+      s->d[y][x] = s->o[y][x - dx];
+      s->o[y][x] = sat_add(s->d[y][x], s->w[y][x]);
+      t = 1;
+    }
+  }
+
+  return t;
+}
+
+void chamfer_field(const uint8_t cost[MAP_Y][MAP_X], pair_t from,
+                   uint16_t dist[MAP_Y][MAP_X])
+{
+  static sweep_t s;
+  int32_t x, y, changed;
+
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < SWEEP_X; x++) {
+      s.d[y][x] = DIST_INF;
+      s.w[y][x] = DIST_INF;
+      s.block[y][x] = DIST_INF;
+    }
+  }
+  for (y = 1; y < MAP_Y - 1; y++) {
+    for (x = 1; x < MAP_X - 1; x++) {
+      if (cost[y][x] != COST_INF) {
+        s.w[y][x + SWEEP_PAD] = cost[y][x];
+        s.block[y][x + SWEEP_PAD] = 0;
+      }
+    }
+  }
+  s.d[from[dim_y]][from[dim_x] + SWEEP_PAD] = 0;
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < SWEEP_X; x++) {
+      s.o[y][x] = sat_add(s.d[y][x], s.w[y][x]);
+    }
+  }
+
+  do {
+    changed = 0;
+    for (y = 1; y < MAP_Y - 1; y++) {
+      changed |= sweep_row(&s, y, y - 1, 1);
+    }
+    for (y = MAP_Y - 2; y > 0; y--) {
+      changed |= sweep_row(&s, y, y + 1, -1);
+    }
+  } while (changed);
+
+  for (y = 0; y < MAP_Y; y++) {
+    memcpy(dist[y], &s.d[y][SWEEP_PAD], sizeof (dist[y]));
+  }
+}
+
+#undef vec
+#undef vmin
+#undef vmax
+#undef sat_add
+
+void dist_field(const uint8_t cost[MAP_Y][MAP_X], pair_t from,
+                uint16_t dist[MAP_Y][MAP_X])
+{
+  switch (pathfind_backend) {
+  case pathfind_chamfer:
+    chamfer_field(cost, from, dist);
+    break;
+  case pathfind_binary:
+    pq_field<pq_binary<path_t *, path_less> >(cost, from, dist);
+    break;
+  case pathfind_dary:
+    pq_field<pq_4ary<path_t *, path_less> >(cost, from, dist);
+    break;
+  case pathfind_pairing:
+    pq_field<pq_pairing<path_t *, path_less> >(cost, from, dist);
+    break;
+  default:
+    dijkstra_field(cost, from, dist);
+    break;
+  }
+}
+
+/* Entries live in a fixed array and are threaded onto two index-linked  *
+ * lists: a hash chain, which finds an entry in O(1), and the LRU list,  *
+ * most recently used at the head.  -1 terminates both.  A hit still     *
+ * copies the whole field out, which is cheap next to recomputing it.   */
+#define DIST_CACHE_BUCKETS 64
+
+typedef struct dist_cache_entry {
+  map *m;
+  uint32_t version;
+  uint32_t kind;
+  pair_t from;
+  int16_t hash_prev, hash_next;
+  int16_t lru_prev, lru_next;
+  uint16_t dist[MAP_Y][MAP_X];
+} dist_cache_entry_t;
+
+static struct {
+  dist_cache_entry_t entry[DIST_CACHE_SIZE];
+  int16_t bucket[DIST_CACHE_BUCKETS];
+  int16_t lru_head, lru_tail;
+  int16_t used;
+  int initialized;
+  dist_cache_stats_t stats;
+} dist_cache;
+
+static void dist_cache_init()
+{
+  int i;
+
+  for (i = 0; i < DIST_CACHE_BUCKETS; i++) {
+    dist_cache.bucket[i] = -1;
+  }
+  dist_cache.lru_head = dist_cache.lru_tail = -1;
+  dist_cache.used = 0;
+  dist_cache.stats.bytes = sizeof (dist_cache);
+  dist_cache.initialized = 1;
+}
+
+static uint32_t dist_cache_hash(map *m, uint32_t version,
+                                pair_t from, uint32_t kind)
+{
+  uint32_t h;
+
+  h = (uint32_t) (uintptr_t) m;
+  h ^= h >> 16;
+  h = h * 0x45d9f3b + version;
+  h = h * 0x45d9f3b + ((from[dim_y] * MAP_X + from[dim_x]) << 1) + kind;
+  h ^= h >> 16;
+
+  return h & (DIST_CACHE_BUCKETS - 1);
+}
+
+static void dist_cache_lru_unlink(int16_t i)
+{
+  dist_cache_entry_t *e = &dist_cache.entry[i];
+
+  if (e->lru_prev >= 0) {
+    dist_cache.entry[e->lru_prev].lru_next = e->lru_next;
+  } else {
+    dist_cache.lru_head = e->lru_next;
+  }
+  if (e->lru_next >= 0) {
+    dist_cache.entry[e->lru_next].lru_prev = e->lru_prev;
+  } else {
+    dist_cache.lru_tail = e->lru_prev;
+  }
+}
+
+static void dist_cache_lru_push(int16_t i)
+{
+  dist_cache_entry_t *e = &dist_cache.entry[i];
+
+  e->lru_prev = -1;
+  e->lru_next = dist_cache.lru_head;
+  if (dist_cache.lru_head >= 0) {
+    dist_cache.entry[dist_cache.lru_head].lru_prev = i;
+  } else {
+    dist_cache.lru_tail = i;
+  }
+  dist_cache.lru_head = i;
+}
+
+static void dist_cache_hash_unlink(int16_t i)
+{
+  dist_cache_entry_t *e = &dist_cache.entry[i];
+
+  if (e->hash_prev >= 0) {
+    dist_cache.entry[e->hash_prev].hash_next = e->hash_next;
+  } else {
+    dist_cache.bucket[dist_cache_hash(e->m, e->version,
+                                      e->from, e->kind)] = e->hash_next;
+  }
+  if (e->hash_next >= 0) {
+    dist_cache.entry[e->hash_next].hash_prev = e->hash_prev;
+  }
+}
+
+static int16_t dist_cache_find(map *m, pair_t from, uint32_t kind)
+{
+  int16_t i;
+
+  for (i = dist_cache.bucket[dist_cache_hash(m, m->terrain_version,
+                                             from, kind)];
+       i >= 0;
+       i = dist_cache.entry[i].hash_next) {
+    if (dist_cache.entry[i].m == m                            &&
+        dist_cache.entry[i].version == m->terrain_version     &&
+        dist_cache.entry[i].kind == kind                      &&
+        dist_cache.entry[i].from[dim_x] == from[dim_x]        &&
+        dist_cache.entry[i].from[dim_y] == from[dim_y]) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+int dist_cache_lookup(map *m, pair_t from, uint32_t kind,
+                      uint16_t dist[MAP_Y][MAP_X])
+{
+  int16_t i;
+
+  if (!dist_cache.initialized) {
+    dist_cache_init();
+  }
+
+  dist_cache.stats.lookups++;
+
+  if ((i = dist_cache_find(m, from, kind)) >= 0) {
+    dist_cache.stats.hits++;
+    dist_cache_lru_unlink(i);
+    dist_cache_lru_push(i);
+    memcpy(dist, dist_cache.entry[i].dist, sizeof (dist_cache.entry[i].dist));
+  }
+
+  return i >= 0;
+}
+
+void dist_cache_store(map *m, pair_t from, uint32_t kind,
+                      uint16_t dist[MAP_Y][MAP_X])
+{
+  dist_cache_entry_t *e;
+  int16_t i, b;
+
+  if (!dist_cache.initialized) {
+    dist_cache_init();
+  }
+
+  if ((i = dist_cache_find(m, from, kind)) >= 0) {
+    dist_cache_lru_unlink(i);
+  } else {
+    if (dist_cache.used < DIST_CACHE_SIZE) {
+      i = dist_cache.used++;
+    } else {
+      i = dist_cache.lru_tail;
+      dist_cache_lru_unlink(i);
+      dist_cache_hash_unlink(i);
+      dist_cache.stats.evictions++;
+    }
+    e = &dist_cache.entry[i];
+    e->m = m;
+    e->version = m->terrain_version;
+    e->kind = kind;
+    e->from[dim_x] = from[dim_x];
+    e->from[dim_y] = from[dim_y];
+    b = dist_cache_hash(m, e->version, from, kind);
+    e->hash_prev = -1;
+    e->hash_next = dist_cache.bucket[b];
+    if (e->hash_next >= 0) {
+      dist_cache.entry[e->hash_next].hash_prev = i;
+    }
+    dist_cache.bucket[b] = i;
+  }
+  dist_cache_lru_push(i);
+  dist_cache.stats.stores++;
+
+  memcpy(dist_cache.entry[i].dist, dist, sizeof (dist_cache.entry[i].dist));
+}
+
+void dist_cache_stats(dist_cache_stats_t *stats)
+{
+  if (!dist_cache.initialized) {
+    dist_cache_init();
+  }
+
+  dist_cache.stats.entries = dist_cache.used;
+  *stats = dist_cache.stats;
+}
@@ -0,0 +1,66 @@
+#ifndef PATH_H
+# define PATH_H
+
+# include <stdint.h>
+
+# include "curse.h"
+
+/* Distance fields are computed from a single source over the interior of *
+ * a map.  A cell's cost is paid when leaving it, and cells with a cost   *
+ * of COST_INF are impassable.  Distances saturate at DIST_INF, which     *
+ * also marks unreachable cells.  Every backend must produce exactly the  *
+ * same field; they differ only in how they get there.                   */
+typedef enum pathfind_backend {
+  pathfind_dijkstra, /* Fibonacci heap from heap.c */
+  pathfind_chamfer,
+  pathfind_binary,   /* Dijkstra over the queues in pqueue.h */
+  pathfind_dary,
+  pathfind_pairing,
+  num_pathfind_backends
+} pathfind_backend_t;
+
+extern const char *pathfind_backend_name[num_pathfind_backends];
+
+/* Backend used by pathfind_ensure().  Selectable from the command line. */
+extern pathfind_backend_t pathfind_backend;
+
+/* Work counters, bumped by the backends and by road routing.  For     *
+ * Dijkstra a node is expanded when it leaves the heap; for the sweeps *
+ * every cell visited in a row pass counts.                            */
+typedef struct path_stats {
+  uint64_t expanded;
+  uint64_t heap_ops;
+} path_stats_t;
+
+extern path_stats_t path_stats;
+
+void cost_grid(map *m, const int32_t cost[], uint8_t grid[MAP_Y][MAP_X]);
+
+void dijkstra_field(const uint8_t cost[MAP_Y][MAP_X], pair_t from,
+                    uint16_t dist[MAP_Y][MAP_X]);
+void chamfer_field(const uint8_t cost[MAP_Y][MAP_X], pair_t from,
+                   uint16_t dist[MAP_Y][MAP_X]);
+void dist_field(const uint8_t cost[MAP_Y][MAP_X], pair_t from,
+                uint16_t dist[MAP_Y][MAP_X]);
+
+/* A small LRU cache of computed fields, keyed by map, terrain version, *
+ * source and which field it is.                                        */
+# define DIST_CACHE_SIZE 32
+
+typedef struct dist_cache_stats {
+  uint64_t lookups;
+  uint64_t hits;
+  uint64_t stores;
+  uint64_t evictions;
+  uint32_t entries;
+  uint32_t bytes;
+} dist_cache_stats_t;
+
+int dist_cache_lookup(map *m, pair_t from, uint32_t kind,
+                      uint16_t dist[MAP_Y][MAP_X]);
+void dist_cache_store(map *m, pair_t from, uint32_t kind,
+                      uint16_t dist[MAP_Y][MAP_X]);
+/* The running totals, and what the cache holds now. */
+void dist_cache_stats(dist_cache_stats_t *stats);
+
+#endif
@@ -1,19 +1,32 @@
 #include <cstdlib>
 #include <algorithm>
+#include <vector>
 
 #include "pokemon.h"
 #include "db_parse.h"
 #include "curse.h"
+#include "encounter.h"
 
 static bool operator<(const levelup_move &f, const levelup_move &s)
 {
   return ((f.level < s.level) || ((f.level == s.level) && f.move < s.move));
 }
 
-static int pkmn_lvl()
+/* rand(), or rand_r(seed) given a seed of our own. */
+static int pkmn_rand(unsigned *seed)
+{
+  return seed ? rand_r(seed) : rand();
+}
+
+/* Manhattan distance of the current map from the center of the world. */
+static int pkmn_md()
+{
+  return (abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)) +
+          abs(world.cur_idx[dim_y] - (WORLD_SIZE / 2)));
+}
+
+static int pkmn_lvl(int md, unsigned *seed)
 {
-    int md = (abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)) +
-            abs(world.cur_idx[dim_y] - (WORLD_SIZE / 2)));
   int minl, maxl;
 
   if (md <= 200) {
@@ -36,67 +49,97 @@ static int pkmn_lvl()
     maxl = 100;
   }
 
-  return (rand() % (maxl - minl + 1)) + minl;
+  return (pkmn_rand(seed) % (maxl - minl + 1)) + minl;
 }
 
-pokemon::pokemon() : pokemon(pkmn_lvl()) {}
+pokemon::pokemon() : pokemon(pkmn_lvl(pkmn_md(), NULL)) {}
 
-pokemon::pokemon(int level) : level(level)
+/* Fills in every species' types, level-up moves and base stats, in one *
+ * pass over each table; call once after db_parse().  Looking these up  *
+ * a species at a time, on first use, took a scan of half a million     *
+ * move rows per species.                                               */
+void pokemon_init()
 {
+  std::vector<pokemon_species_db *> by_id;
   pokemon_species_db *s;
   unsigned i, j;
+  int id;
   bool found;
 
-  // Subtract 1 because array is 1-indexed
-  pokemon_species_index = rand() % ((sizeof (species) /
-                                     sizeof (species[0])) - 1);
-  s = species + pokemon_species_index;
+  for (i = 1; i < sizeof (species) / sizeof (species[0]); i++) {
+    if (species[i].id >= (int) by_id.size()) {
+      by_id.resize(species[i].id + 1, NULL);
+    }
+    if (species[i].id >= 0 && !by_id[species[i].id]) {
+      by_id[species[i].id] = species + i;
+    }
+  }
 
-	if (!s->types.size()) {
-		for (i = 1; i < sizeof (pokemon_types) 
-										/ sizeof (pokemon_types[0]); i++) {
-			if (s->id == pokemon_types[i].pokemon_id) {
-				s->types.push_back(pokemon_types[i].type_id);
-				if (s->id == pokemon_types[++i].pokemon_id) {
-					s->types.push_back(pokemon_types[i].type_id);
-				}
-				break;
-			}
-		}
-	}
-  
-  if (!s->levelup_moves.size()) {
-    // We have never generated a pokemon of this species before, so we
-    // need to find it's level-up moveset and save it for next time.
-    for (i = 1; i < (sizeof (pokemon_moves) /
-                     sizeof (pokemon_moves[0])); i++) {
-      if (s->id == pokemon_moves[i].pokemon_id &&
-          pokemon_moves[i].pokemon_move_method_id == 1) {
-        for (found = false, j = 0; !found && j < s->levelup_moves.size(); j++) {
-          if (s->levelup_moves[j].move == pokemon_moves[i].move_id) {
-            found = true;
-          }
-        }
-        if (!found) {
-          s->levelup_moves.push_back({ pokemon_moves[i].level,
-                                       pokemon_moves[i].move_id });
-        }
+#define species_by_id(id) ((id) >= 0 && (id) < (int) by_id.size() ?          \
+                           by_id[id] : NULL)
+
+  // A species takes the first row with its id, and the row after if
+  // that has its id too.
+  for (i = 1; i < sizeof (pokemon_types) / sizeof (pokemon_types[0]); i++) {
+    id = pokemon_types[i].pokemon_id;
+    if ((s = species_by_id(id)) && !s->types.size()) {
+      s->types.push_back(pokemon_types[i].type_id);
+      if (i + 1 < sizeof (pokemon_types) / sizeof (pokemon_types[0]) &&
+          pokemon_types[i + 1].pokemon_id == id) {
+        s->types.push_back(pokemon_types[++i].type_id);
+      }
+    }
+  }
+
+  for (i = 1; i < (sizeof (pokemon_moves) /
+                   sizeof (pokemon_moves[0])); i++) {
+    if (pokemon_moves[i].pokemon_move_method_id != 1 ||
+        !(s = species_by_id(pokemon_moves[i].pokemon_id))) {
+      continue;
+    }
+    for (found = false, j = 0; !found && j < s->levelup_moves.size(); j++) {
+      if (s->levelup_moves[j].move == pokemon_moves[i].move_id) {
+        found = true;
       }
     }
+    if (!found) {
+      s->levelup_moves.push_back({ pokemon_moves[i].level,
+                                   pokemon_moves[i].move_id });
+    }
+  }
+
+#undef species_by_id
+
+  for (i = 1; i < sizeof (species) / sizeof (species[0]); i++) {
+    s = species + i;
 
     // s->levelup_moves now contains all of the moves this species can learn
     // through leveling up.  Now we'll sort it by level to make that process
     // simpler.
     sort(s->levelup_moves.begin(), s->levelup_moves.end());
 
-    // Also initialize base stats while we're here
-    s->base_stat[0] = pokemon_stats[pokemon_species_index * 6 - 5].base_stat;
-    s->base_stat[1] = pokemon_stats[pokemon_species_index * 6 - 4].base_stat;
-    s->base_stat[2] = pokemon_stats[pokemon_species_index * 6 - 3].base_stat;
-    s->base_stat[3] = pokemon_stats[pokemon_species_index * 6 - 2].base_stat;
-    s->base_stat[4] = pokemon_stats[pokemon_species_index * 6 - 1].base_stat;
-    s->base_stat[5] = pokemon_stats[pokemon_species_index * 6 - 0].base_stat;
+    s->base_stat[0] = pokemon_stats[i * 6 - 5].base_stat;
+    s->base_stat[1] = pokemon_stats[i * 6 - 4].base_stat;
+    s->base_stat[2] = pokemon_stats[i * 6 - 3].base_stat;
+    s->base_stat[3] = pokemon_stats[i * 6 - 2].base_stat;
+    s->base_stat[4] = pokemon_stats[i * 6 - 1].base_stat;
+    s->base_stat[5] = pokemon_stats[i * 6 - 0].base_stat;
   }
+}
+
+// Subtract 1 because array is 1-indexed, and skip the unused entry 0
+pokemon::pokemon(int level) :
+  pokemon(level, 1 + rand() % ((sizeof (species) / sizeof (species[0])) - 1))
+{
+}
+
+pokemon::pokemon(int level, int species_index, unsigned *seed) :
+  level(level), pokemon_species_index(species_index)
+{
+  pokemon_species_db *s;
+  unsigned i, j;
+
+  s = species + pokemon_species_index;
 
   // Get pokemon's move(s).
   for (i = 0;
@@ -108,10 +151,10 @@ pokemon::pokemon(int level) : level(level)
   move_index[0] = move_index[1] = move_index[2] = move_index[3] = 0;
   // I don't think 0 moves is possible, but account for it to be safe
   if (i) {
-    move_index[0] = s->levelup_moves[rand() % i].move;
+    move_index[0] = s->levelup_moves[pkmn_rand(seed) % i].move;
     if (i != 1) {
       do {
-        j = rand() % i;
+        j = pkmn_rand(seed) % i;
       } while (s->levelup_moves[j].move == move_index[0]);
       move_index[1] = s->levelup_moves[j].move;
     }
@@ -119,7 +162,7 @@ pokemon::pokemon(int level) : level(level)
 
   // Calculate IVs
   for (i = 0; i < 6; i++) {
-    IV[i] = rand() & 0xf;
+    IV[i] = pkmn_rand(seed) & 0xf;
     effective_stat[i] = 5 + ((s->base_stat[i] + IV[i]) * 2 * level) / 100;
     if (i == 0) { // HP
       effective_stat[i] += 5 + level;
@@ -127,8 +170,18 @@ pokemon::pokemon(int level) : level(level)
     }
   }
 
-  shiny = (((rand() & 0x1fff) == 0x1fff) ? true : false);
-  gender = ((rand() & 0x1) ? gender_female : gender_male);
+  shiny = (((pkmn_rand(seed) & 0x1fff) == 0x1fff) ? true : false);
+  gender = ((pkmn_rand(seed) & 0x1) ? gender_female : gender_male);
+}
+
+class pokemon *wild_pokemon(int geotype, int md, unsigned *seed)
+{
+  int level = pkmn_lvl(md, seed);
+
+  return new class pokemon(level,
+                           encounter_species((geo_type_t) geotype,
+                                             encounter_band(md), seed),
+                           seed);
 }
 
 int pokemon::get_lvl() const
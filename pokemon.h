@@ -1,6 +1,8 @@
 #ifndef POKEMON_H
 # define POKEMON_H
 
+# include <stddef.h>
+
 class move_db;
 
 enum pokemon_stat {
@@ -33,6 +35,8 @@ class pokemon {
  public:
   pokemon();
   pokemon(int level);
+  /* Rolls with rand_r(seed) rather than rand() given a seed. */
+  pokemon(int level, int species_index, unsigned *seed = NULL);
   int get_lvl() const;
   const char *get_species() const;
   int get_hp() const;
@@ -54,4 +58,11 @@ class pokemon {
   int attack(int move_id, pokemon& target);
 };
 
+void pokemon_init();
+/* A wild pokemon for a map of the given geotype and distance from the *
+ * center, drawn from its encounter table with rand_r(seed).  Touches   *
+ * nothing but the read-only tables, so any thread may call it; the     *
+ * game takes them from encounter_next().                               */
+class pokemon *wild_pokemon(int geotype, int md, unsigned *seed);
+
 #endif
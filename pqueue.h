@@ -0,0 +1,719 @@
+#ifndef PQUEUE_H
+# define PQUEUE_H
+
+# include <stdint.h>
+# include <vector>
+
+# include "heap.h"
+
+/* Header-only min-priority queues with the comparator as a template    *
+ * parameter, so comparisons inline instead of going through heap.c's  *
+ * function pointer.  Less is a default-constructible functor, and T is *
+ * a pointer (pop() and top() return a null T when empty, like          *
+ * heap_remove_min()).  All of them share one interface:                *
+ *                                                                      *
+ *   handle_t push(T v)       insert; the handle stays valid until v    *
+ *                            is popped                                 *
+ *   void build(items, n, handles)                                      *
+ *                            insert n items in linear time, storing    *
+ *                            their handles if handles is not NULL      *
+ *   void decrease(handle_t)  v's key was lowered in place; restore     *
+ *                            order (heap_decrease_key_no_replace())    *
+ *   T top(), T pop()                                                   *
+ *   uint32_t size(), bool empty(), void reserve(n), void clear()       *
+ *                                                                      *
+ * so a call site can be written once against a queue type Q and        *
+ * instantiated with any of pq_binary, pq_4ary, pq_pairing,             *
+ * pq_fibonacci or, for integer keys, pq_wheel.  Like heap.c, none of   *
+ * them own the data.                                                   */
+
+# define PQ_NIL UINT32_MAX
+
+/* Implicit d-ary heap.  Handles are slots in a side table that tracks *
+ * each element's position, so decrease-key is a sift-up from there.   */
+template <typename T, typename Less, uint32_t D>
+class pq_dary {
+  typedef struct entry {
+    T v;
+    uint32_t slot;
+  } entry_t;
+
+  std::vector<entry_t> heap;
+  std::vector<uint32_t> pos;
+  uint32_t free_slot;
+  Less less;
+
+  void place(uint32_t i, const entry_t &e)
+  {
+    heap[i] = e;
+    pos[e.slot] = i;
+  }
+
+  void sift_up(uint32_t i)
+  {
+    entry_t e = heap[i];
+    uint32_t p;
+
+    while (i && less(e.v, heap[p = (i - 1) / D].v)) {
+      place(i, heap[p]);
+      i = p;
+    }
+    place(i, e);
+  }
+
+  void sift_down(uint32_t i)
+  {
+    entry_t e = heap[i];
+    uint32_t c, k, best, n = heap.size();
+
+    while ((c = D * i + 1) < n) {
+      for (best = c, k = c + 1; k < c + D && k < n; k++) {
+        if (less(heap[k].v, heap[best].v)) {
+          best = k;
+        }
+      }
+      if (!less(heap[best].v, e.v)) {
+        break;
+      }
+      place(i, heap[best]);
+      i = best;
+    }
+    place(i, e);
+  }
+
+ public:
+  typedef uint32_t handle_t;
+
+  pq_dary() : free_slot(PQ_NIL) {}
+
+  handle_t push(T v)
+  {
+    entry_t e;
+
+    if (free_slot != PQ_NIL) {
+      e.slot = free_slot;
+      free_slot = pos[free_slot];
+    } else {
+      e.slot = pos.size();
+      pos.push_back(0);
+    }
+    e.v = v;
+    heap.push_back(e);
+    sift_up(heap.size() - 1);
+
+    return e.slot;
+  }
+
+  /* Appends everything, then heapifies bottom-up.  Into an empty heap *
+   * the slots are simply 0 .. n - 1.                                  */
+  void build(const T items[], uint32_t n, handle_t handles[])
+  {
+    entry_t e;
+    uint32_t i;
+
+    if (heap.empty()) {
+      pos.clear();
+      free_slot = PQ_NIL;
+    }
+    for (i = 0; i < n; i++) {
+      if (free_slot != PQ_NIL) {
+        e.slot = free_slot;
+        free_slot = pos[free_slot];
+      } else {
+        e.slot = pos.size();
+        pos.push_back(0);
+      }
+      e.v = items[i];
+      pos[e.slot] = heap.size();
+      heap.push_back(e);
+      if (handles) {
+        handles[i] = e.slot;
+      }
+    }
+    if (heap.size() > 1) {
+      for (i = (heap.size() - 2) / D + 1; i--; ) {
+        sift_down(i);
+      }
+    }
+  }
+
+  void decrease(handle_t h)
+  {
+    sift_up(pos[h]);
+  }
+
+  T top() const
+  {
+    return heap.empty() ? T() : heap[0].v;
+  }
+
+  T pop()
+  {
+    T v;
+
+    if (heap.empty()) {
+      return T();
+    }
+    v = heap[0].v;
+    pos[heap[0].slot] = free_slot;
+    free_slot = heap[0].slot;
+    if (heap.size() > 1) {
+      heap[0] = heap.back();
+      heap.pop_back();
+      sift_down(0);
+    } else {
+      heap.pop_back();
+    }
+
+    return v;
+  }
+
+  uint32_t size() const
+  {
+    return heap.size();
+  }
+
+  bool empty() const
+  {
+    return heap.empty();
+  }
+
+  void reserve(uint32_t n)
+  {
+    heap.reserve(n);
+    pos.reserve(n);
+  }
+
+  void clear()
+  {
+    heap.clear();
+    pos.clear();
+    free_slot = PQ_NIL;
+  }
+};
+
+template <typename T, typename Less>
+class pq_binary : public pq_dary<T, Less, 2> {};
+
+template <typename T, typename Less>
+class pq_4ary : public pq_dary<T, Less, 4> {};
+
+/* Pairing heap over an index-linked node pool.  A node's prev is its   *
+ * left sibling, or its parent if it is the leftmost child.  Popping    *
+ * does the standard two-pass merge of the root's children.             */
+template <typename T, typename Less>
+class pq_pairing {
+  typedef struct node {
+    T v;
+    uint32_t child, sibling, prev;
+  } node_t;
+
+  std::vector<node_t> node;
+  std::vector<uint32_t> pass;
+  uint32_t root, free_node, count;
+  Less less;
+
+  uint32_t meld(uint32_t a, uint32_t b)
+  {
+    uint32_t t;
+
+    if (a == PQ_NIL) {
+      return b;
+    }
+    if (b == PQ_NIL) {
+      return a;
+    }
+    if (less(node[b].v, node[a].v)) {
+      t = a;
+      a = b;
+      b = t;
+    }
+    node[b].prev = a;
+    node[b].sibling = node[a].child;
+    if (node[a].child != PQ_NIL) {
+      node[node[a].child].prev = b;
+    }
+    node[a].child = b;
+
+    return a;
+  }
+
+ public:
+  typedef uint32_t handle_t;
+
+  pq_pairing() : root(PQ_NIL), free_node(PQ_NIL), count(0) {}
+
+  handle_t push(T v)
+  {
+    uint32_t n;
+
+    if (free_node != PQ_NIL) {
+      n = free_node;
+      free_node = node[n].sibling;
+    } else {
+      n = node.size();
+      node.push_back(node_t());
+    }
+    node[n].v = v;
+    node[n].child = node[n].sibling = node[n].prev = PQ_NIL;
+    root = meld(root, n);
+    node[root].prev = PQ_NIL;
+    count++;
+
+    return n;
+  }
+
+  /* The minimum becomes a root with every other item as a child, which *
+   * is a valid pairing heap; the first pop does the real work.  Into   *
+   * an empty heap the nodes are simply 0 .. n - 1.                     */
+  void build(const T items[], uint32_t n, handle_t handles[])
+  {
+    uint32_t i, first, min;
+
+    if (!n) {
+      return;
+    }
+    if (!count) {
+      node.clear();
+      root = free_node = PQ_NIL;
+    }
+    first = node.size();
+    node.resize(first + n);
+    for (min = first, i = first; i < first + n; i++) {
+      node[i].v = items[i - first];
+      node[i].child = node[i].sibling = node[i].prev = PQ_NIL;
+      if (less(node[i].v, node[min].v)) {
+        min = i;
+      }
+      if (handles) {
+        handles[i - first] = i;
+      }
+    }
+    for (i = first + n; i-- > first; ) {
+      if (i != min) {
+        node[i].prev = min;
+        node[i].sibling = node[min].child;
+        if (node[min].child != PQ_NIL) {
+          node[node[min].child].prev = i;
+        }
+        node[min].child = i;
+      }
+    }
+    root = meld(root, min);
+    node[root].prev = PQ_NIL;
+    count += n;
+  }
+
+  void decrease(handle_t n)
+  {
+    uint32_t p;
+
+    if (n == root) {
+      return;
+    }
+    p = node[n].prev;
+    if (node[p].child == n) {
+      node[p].child = node[n].sibling;
+    } else {
+      node[p].sibling = node[n].sibling;
+    }
+    if (node[n].sibling != PQ_NIL) {
+      node[node[n].sibling].prev = p;
+    }
+    node[n].sibling = node[n].prev = PQ_NIL;
+    root = meld(root, n);
+    node[root].prev = PQ_NIL;
+  }
+
+  T top() const
+  {
+    return root == PQ_NIL ? T() : node[root].v;
+  }
+
+  T pop()
+  {
+    uint32_t r, c, a, b, i;
+    T v;
+
+    if (root == PQ_NIL) {
+      return T();
+    }
+    r = root;
+    v = node[r].v;
+
+    pass.clear();
+    for (c = node[r].child; c != PQ_NIL; ) {
+      a = c;
+      b = node[a].sibling;
+      c = b == PQ_NIL ? PQ_NIL : node[b].sibling;
+      node[a].sibling = node[a].prev = PQ_NIL;
+      if (b != PQ_NIL) {
+        node[b].sibling = node[b].prev = PQ_NIL;
+      }
+      pass.push_back(meld(a, b));
+    }
+    for (root = PQ_NIL, i = pass.size(); i; i--) {
+      root = meld(pass[i - 1], root);
+    }
+    if (root != PQ_NIL) {
+      node[root].prev = PQ_NIL;
+    }
+
+    node[r].sibling = free_node;
+    free_node = r;
+    count--;
+
+    return v;
+  }
+
+  uint32_t size() const
+  {
+    return count;
+  }
+
+  bool empty() const
+  {
+    return !count;
+  }
+
+  void reserve(uint32_t n)
+  {
+    node.reserve(n);
+  }
+
+  void clear()
+  {
+    node.clear();
+    root = free_node = PQ_NIL;
+    count = 0;
+  }
+};
+
+/* heap.c's Fibonacci heap behind the same interface, for comparison *
+ * and as the default.                                               */
+template <typename T, typename Less>
+class pq_fibonacci {
+  heap_t h;
+
+  static int32_t compare(const void *key, const void *with)
+  {
+    Less less;
+
+    return (less((T) key, (T) with) ? -1 :
+            less((T) with, (T) key) ? 1  : 0);
+  }
+
+ public:
+  typedef heap_node_t *handle_t;
+
+  pq_fibonacci()
+  {
+    heap_init(&h, compare, NULL);
+  }
+
+  ~pq_fibonacci()
+  {
+    heap_delete(&h);
+  }
+
+  pq_fibonacci(const pq_fibonacci &) = delete;
+  pq_fibonacci &operator=(const pq_fibonacci &) = delete;
+
+  handle_t push(T v)
+  {
+    return heap_insert(&h, (void *) v);
+  }
+
+  void build(const T items[], uint32_t n, handle_t handles[])
+  {
+    heap_build(&h, (void *const *) items, n, handles);
+  }
+
+  void decrease(handle_t n)
+  {
+    heap_decrease_key_no_replace(&h, n);
+  }
+
+  T top()
+  {
+    return (T) heap_peek_min(&h);
+  }
+
+  T pop()
+  {
+    return (T) heap_remove_min(&h);
+  }
+
+  uint32_t size() const
+  {
+    return h.size;
+  }
+
+  bool empty() const
+  {
+    return !h.size;
+  }
+
+  void reserve(uint32_t n)
+  {
+    heap_reserve(&h, n);
+  }
+
+  void clear()
+  {
+    heap_reset(&h);
+  }
+};
+
+/* Timing wheel for integer keys that only move forward by small steps, *
+ * like turn times.  Less must also provide a static key(v) giving v's  *
+ * int32_t key, and must order equal keys among themselves (by seq_num  *
+ * for turns).  Slot key % W holds the entries whose key is exactly key *
+ * for every key in [now, now + W), kept in Less order, so scheduling   *
+ * and popping are O(1) for steps under W and ties come out exactly as  *
+ * a heap would give them.  Keys at or beyond now + W wait on an        *
+ * overflow list and move onto the wheel as it turns.  A key earlier    *
+ * than now winds the wheel back, which is O(n) but never happens in    *
+ * the turn queue, since nothing is scheduled before the current turn.  */
+template <typename T, typename Less, uint32_t W = 64>
+class pq_wheel {
+  static_assert(W && !(W & (W - 1)), "wheel size must be a power of two");
+
+  typedef struct node {
+    T v;
+    int32_t key;
+    uint32_t prev, next;
+  } node_t;
+
+  std::vector<node_t> node;
+  uint32_t slot[W];
+  uint32_t overflow;
+  int32_t overflow_min;
+  int32_t now;
+  uint32_t free_node, count, on_wheel;
+  Less less;
+
+  bool on_overflow(uint32_t n) const
+  {
+    return (int64_t) node[n].key - now >= W;
+  }
+
+  uint32_t *list_of(uint32_t n)
+  {
+    return on_overflow(n) ? &overflow : &slot[node[n].key & (W - 1)];
+  }
+
+  void unlink(uint32_t n)
+  {
+    uint32_t *head = list_of(n);
+
+    if (node[n].prev != PQ_NIL) {
+      node[node[n].prev].next = node[n].next;
+    } else {
+      *head = node[n].next;
+    }
+    if (node[n].next != PQ_NIL) {
+      node[node[n].next].prev = node[n].prev;
+    }
+    if (!on_overflow(n)) {
+      on_wheel--;
+    }
+  }
+
+  /* Overflow entries are unordered; slot entries go in Less order. */
+  void link(uint32_t n)
+  {
+    uint32_t *head, p, c;
+
+    if (node[n].key < now) {
+      rewind(node[n].key);
+    }
+    head = list_of(n);
+    if (on_overflow(n)) {
+      if (overflow == PQ_NIL || node[n].key < overflow_min) {
+        overflow_min = node[n].key;
+      }
+      p = PQ_NIL;
+      c = *head;
+    } else {
+      for (p = PQ_NIL, c = *head;
+           c != PQ_NIL && !less(node[n].v, node[c].v);
+           p = c, c = node[c].next)
+        ;
+      on_wheel++;
+    }
+    node[n].prev = p;
+    node[n].next = c;
+    if (p != PQ_NIL) {
+      node[p].next = n;
+    } else {
+      *head = n;
+    }
+    if (c != PQ_NIL) {
+      node[c].prev = n;
+    }
+  }
+
+  /* Moves whatever has come within reach from the overflow list. */
+  void refill()
+  {
+    uint32_t n, next, pending;
+
+    pending = overflow;
+    overflow = PQ_NIL;
+    for (n = pending; n != PQ_NIL; n = next) {
+      next = node[n].next;
+      link(n);
+    }
+  }
+
+  void rewind(int32_t key)
+  {
+    uint32_t i, n, next, moved;
+
+    now = key;
+    moved = PQ_NIL;
+    for (i = 0; i < W; i++) {
+      for (n = slot[i]; n != PQ_NIL; n = next) {
+        next = node[n].next;
+        if (on_overflow(n)) {
+          if (node[n].prev != PQ_NIL) {
+            node[node[n].prev].next = next;
+          } else {
+            slot[i] = next;
+          }
+          if (next != PQ_NIL) {
+            node[next].prev = node[n].prev;
+          }
+          on_wheel--;
+          node[n].next = moved;
+          moved = n;
+        }
+      }
+    }
+    for (n = moved; n != PQ_NIL; n = next) {
+      next = node[n].next;
+      link(n);
+    }
+  }
+
+  /* Turns the wheel to the first occupied slot. */
+  uint32_t advance()
+  {
+    while (slot[now & (W - 1)] == PQ_NIL) {
+      if (!on_wheel) {
+        now = overflow_min;
+      } else {
+        now++;
+      }
+      if (overflow != PQ_NIL && (int64_t) overflow_min - now < W) {
+        refill();
+      }
+    }
+
+    return slot[now & (W - 1)];
+  }
+
+ public:
+  typedef uint32_t handle_t;
+
+  pq_wheel() : overflow(PQ_NIL), overflow_min(0), now(0),
+               free_node(PQ_NIL), count(0), on_wheel(0)
+  {
+    uint32_t i;
+
+    for (i = 0; i < W; i++) {
+      slot[i] = PQ_NIL;
+    }
+  }
+
+  handle_t push(T v)
+  {
+    uint32_t n;
+
+    if (free_node != PQ_NIL) {
+      n = free_node;
+      free_node = node[n].next;
+    } else {
+      n = node.size();
+      node.push_back(node_t());
+    }
+    node[n].v = v;
+    node[n].key = Less::key(v);
+    link(n);
+    count++;
+
+    return n;
+  }
+
+  /* Linear in n plus the ties it lands among. */
+  void build(const T items[], uint32_t n, handle_t handles[])
+  {
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+      if (handles) {
+        handles[i] = push(items[i]);
+      } else {
+        push(items[i]);
+      }
+    }
+  }
+
+  void decrease(handle_t n)
+  {
+    unlink(n);
+    node[n].key = Less::key(node[n].v);
+    link(n);
+  }
+
+  T top()
+  {
+    return count ? node[advance()].v : T();
+  }
+
+  T pop()
+  {
+    uint32_t n;
+
+    if (!count) {
+      return T();
+    }
+    n = advance();
+    unlink(n);
+    node[n].next = free_node;
+    free_node = n;
+    count--;
+
+    return node[n].v;
+  }
+
+  uint32_t size() const
+  {
+    return count;
+  }
+
+  bool empty() const
+  {
+    return !count;
+  }
+
+  void reserve(uint32_t n)
+  {
+    node.reserve(n);
+  }
+
+  void clear()
+  {
+    uint32_t i;
+
+    node.clear();
+    for (i = 0; i < W; i++) {
+      slot[i] = PQ_NIL;
+    }
+    overflow = free_node = PQ_NIL;
+    count = on_wheel = 0;
+  }
+};
+
+#endif
@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+#include <ncurses.h>
+
+#include "render.h"
+
+/* Longest a single cell can take in a frame: a cursor move, a full *
+ * change of attributes, a change of character set, and the cell.   */
+#define RENDER_CELL_MAX 48
+
+/* How long to wait for the rest of a key after an escape before *
+ * taking the escape as a key of its own, in milliseconds.       */
+#define RENDER_ESC_WAIT 50
+
+/* Longest key sequence after the escape. */
+#define RENDER_SEQ_MAX  8
+
+const char *render_backend_name[num_render_backends] = {
+  "curses",
+  "null",
+  "ansi",
+};
+
+render_backend_t render_backend = render_curses;
+
+/* The terminal modes to restore, if stdin is a terminal we changed. */
+static struct termios render_tty;
+static int render_tty_saved;
+
+/* What the ansi backend last sent: every cell, the attributes and   *
+ * character set in effect, where the cursor is (x of -1 if unknown, *
+ * as after writing the last column), and whether it shows.          */
+static chtype *render_shadow;
+static char *render_buf;
+static chtype render_attr;
+static int render_acs;
+static int render_y, render_x;
+static int render_shown, render_visible;
+
+/* A byte read after an escape that turned out not to start a key. */
+static int render_pending = -1;
+
+static const struct {
+  const char *seq;
+  int key;
+} render_keys[] = {
+  { "[A",    KEY_UP     },
+  { "OA",    KEY_UP     },
+  { "[B",    KEY_DOWN   },
+  { "OB",    KEY_DOWN   },
+  { "[C",    KEY_RIGHT  },
+  { "OC",    KEY_RIGHT  },
+  { "[D",    KEY_LEFT   },
+  { "OD",    KEY_LEFT   },
+  { "[H",    KEY_HOME   },
+  { "OH",    KEY_HOME   },
+  { "[1~",   KEY_HOME   },
+  { "[7~",   KEY_HOME   },
+  { "[F",    KEY_END    },
+  { "OF",    KEY_END    },
+  { "[4~",   KEY_END    },
+  { "[8~",   KEY_END    },
+  { "[5~",   KEY_PPAGE  },
+  { "[6~",   KEY_NPAGE  },
+  { "[E",    KEY_B2     },
+  { "OE",    KEY_B2     },
+  { "[G",    KEY_B2     },
+  { "[1;2C", KEY_SRIGHT },
+};
+
+static void render_write(const char *s, size_t n)
+{
+  ssize_t r;
+
+  while (n) {
+    if ((r = write(STDOUT_FILENO, s, n)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    s += r;
+    n -= r;
+  }
+}
+
+static void render_puts(const char *s)
+{
+  render_write(s, strlen(s));
+}
+
+void render_init()
+{
+  FILE *null_out, *null_in;
+  struct termios t;
+  int i;
+
+  if (render_backend == render_curses) {
+    initscr();
+    return;
+  }
+
+  /* The windows live on a terminal that nobody is looking at. */
+  null_out = fopen("/dev/null", "w");
+  null_in = fopen("/dev/null", "r");
+  if (!null_out || !null_in ||
+      (!newterm((char *) "xterm", null_out, null_in) &&
+       !newterm((char *) "vt100", null_out, null_in))) {
+    fprintf(stderr, "Cannot open a terminal on /dev/null\n");
+    exit(1);
+  }
+
+  /* cbreak() and noecho() went to /dev/null; do their work on stdin. */
+  if (isatty(STDIN_FILENO) && !tcgetattr(STDIN_FILENO, &render_tty)) {
+    render_tty_saved = 1;
+    t = render_tty;
+    t.c_lflag &= ~(ICANON | ECHO);
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &t);
+  }
+
+  if (render_backend == render_ansi) {
+    render_shadow = (chtype *) malloc(LINES * COLS * sizeof (*render_shadow));
+    render_buf = (char *) malloc(LINES * COLS * RENDER_CELL_MAX + 64);
+    if (!render_shadow || !render_buf) {
+      fprintf(stderr, "Cannot allocate a frame buffer\n");
+      exit(1);
+    }
+    /* Matches nothing, so that the first frame sends every cell and *
+     * the screen takes the game's colors rather than the terminal's. */
+    for (i = 0; i < LINES * COLS; i++) {
+      render_shadow[i] = (chtype) -1;
+    }
+    render_attr = (chtype) -1;
+    render_acs = 0;
+    render_y = render_x = 0;
+    render_shown = render_visible = 1;
+    fflush(stdout);
+    render_puts("\x1b[?1049h\x1b[0m\x1b(B\x1b[H\x1b[2J");
+  }
+}
+
+void render_end()
+{
+  endwin();
+
+  if (render_backend == render_ansi) {
+    render_puts("\x1b[0m\x1b(B\x1b[?25h\x1b[?1049l");
+    free(render_shadow);
+    free(render_buf);
+    render_shadow = NULL;
+    render_buf = NULL;
+  }
+
+  if (render_tty_saved) {
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &render_tty);
+    render_tty_saved = 0;
+  }
+}
+
+/* Sets the terminal's attributes to those of a, from scratch.  Pair 0 *
+ * is white on black once colors are started, as curses sends it.     */
+static char *render_sgr(char *p, chtype a)
+{
+  short fg, bg;
+
+  p += sprintf(p, "\x1b[0");
+  if (a & A_BOLD) {
+    p += sprintf(p, ";1");
+  }
+  if (a & A_DIM) {
+    p += sprintf(p, ";2");
+  }
+  if (a & A_UNDERLINE) {
+    p += sprintf(p, ";4");
+  }
+  if (a & A_BLINK) {
+    p += sprintf(p, ";5");
+  }
+  if (a & (A_REVERSE | A_STANDOUT)) {
+    p += sprintf(p, ";7");
+  }
+  if (pair_content(PAIR_NUMBER(a), &fg, &bg) == OK) {
+    if (fg >= 0 && fg < 8) {
+      p += sprintf(p, ";3%d", fg);
+    }
+    if (bg >= 0 && bg < 8) {
+      p += sprintf(p, ";4%d", bg);
+    }
+  }
+  *p++ = 'm';
+
+  return p;
+}
+
+/* Sends every cell of newscr that differs from the shadow, in one write. */
+static void render_flush()
+{
+  char *p;
+  chtype c, a;
+  int y, x;
+
+  p = render_buf;
+  for (y = 0; y < LINES; y++) {
+    if (!is_linetouched(newscr, y)) {
+      continue;
+    }
+    for (x = 0; x < COLS; x++) {
+      c = mvwinch(newscr, y, x);
+      if (c == render_shadow[y * COLS + x]) {
+        continue;
+      }
+      render_shadow[y * COLS + x] = c;
+
+      if (y != render_y || x != render_x) {
+        p += sprintf(p, "\x1b[%d;%dH", y + 1, x + 1);
+      }
+      if ((a = c & (A_ATTRIBUTES & ~A_ALTCHARSET)) != render_attr) {
+        p = render_sgr(p, a);
+        render_attr = a;
+      }
+      if (!(c & A_ALTCHARSET) != !render_acs) {
+        render_acs = !render_acs;
+        p += sprintf(p, render_acs ? "\x1b(0" : "\x1b(B");
+      }
+      *p++ = isprint(c & A_CHARTEXT) ? (c & A_CHARTEXT) : '?';
+
+      render_y = y;
+      render_x = x + 1 < COLS ? x + 1 : -1;
+    }
+  }
+  untouchwin(newscr);
+
+  if (render_visible != render_shown) {
+    p += sprintf(p, render_visible ? "\x1b[?25h" : "\x1b[?25l");
+    render_shown = render_visible;
+  }
+  if (render_visible) {
+    getyx(newscr, y, x);
+    if (y != render_y || x != render_x) {
+      p += sprintf(p, "\x1b[%d;%dH", y + 1, x + 1);
+      render_y = y;
+      render_x = x;
+    }
+  }
+
+  if (p != render_buf) {
+    render_write(render_buf, p - render_buf);
+  }
+}
+
+void render_refresh(WINDOW *w)
+{
+  switch (render_backend) {
+  case render_curses:
+    wrefresh(w ? w : stdscr);
+    break;
+  case render_null:
+    break;
+  case render_ansi:
+    wnoutrefresh(w ? w : stdscr);
+    render_flush();
+    break;
+  case num_render_backends:
+    break;
+  }
+}
+
+/* The next byte from stdin, waiting at most wait milliseconds for it, *
+ * or forever if wait is negative.  -1 if none came.                   */
+static int render_byte(int wait)
+{
+  struct pollfd p;
+  unsigned char c;
+  int r;
+
+  if ((r = render_pending) >= 0) {
+    render_pending = -1;
+    return r;
+  }
+
+  p.fd = STDIN_FILENO;
+  p.events = POLLIN;
+  if (wait >= 0 && poll(&p, 1, wait) <= 0) {
+    return -1;
+  }
+  while ((r = read(STDIN_FILENO, &c, 1)) < 0 && errno == EINTR)
+    ;
+
+  return r == 1 ? c : -1;
+}
+
+int render_getch(WINDOW *w)
+{
+  char seq[RENDER_SEQ_MAX + 1];
+  uint32_t i;
+  int c, n;
+
+  if (render_backend == render_curses) {
+    return w ? wgetch(w) : getch();
+  }
+
+  render_refresh(w);
+
+  for (;;) {
+    if ((c = render_byte(-1)) < 0) {
+      return ERR;
+    }
+    if (c != 27 /* escape */) {
+      return c;
+    }
+    /* An escape on its own, or the start of a key's sequence. */
+    if ((c = render_byte(RENDER_ESC_WAIT)) < 0) {
+      return 27;
+    }
+    if (c != '[' && c != 'O') {
+      render_pending = c;
+      return 27;
+    }
+    seq[0] = c;
+    n = 1;
+    do {
+      if ((c = render_byte(RENDER_ESC_WAIT)) < 0) {
+        break;
+      }
+      seq[n++] = c;
+    } while (n < RENDER_SEQ_MAX && (c < 0x40 || c > 0x7e));
+    seq[n] = '\0';
+
+    for (i = 0; i < sizeof (render_keys) / sizeof (render_keys[0]); i++) {
+      if (!strcmp(seq, render_keys[i].seq)) {
+        return render_keys[i].key;
+      }
+    }
+    /* Not a key the game knows; drop it and wait for the next. */
+  }
+}
+
+void render_cursor(int visible)
+{
+  switch (render_backend) {
+  case render_curses:
+    curs_set(visible);
+    break;
+  case render_null:
+    break;
+  case render_ansi:
+    render_visible = visible;
+    break;
+  case num_render_backends:
+    break;
+  }
+}
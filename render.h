@@ -0,0 +1,43 @@
+#ifndef RENDER_H
+# define RENDER_H
+
+# include <ncurses.h>
+
+/* How frames reach the terminal.  The game always draws into curses   *
+ * windows; the backend decides what becomes of them when a window is  *
+ * refreshed, and where keys come from:                                *
+ *                                                                     *
+ *   curses  wrefresh() and wgetch(), as ever.                         *
+ *   null    Nothing is ever sent to the terminal, and the game does   *
+ *           not pause for effect; for benchmarks, servers, and fast   *
+ *           replays.  Keys are read raw from stdin.                   *
+ *   ansi    Each refresh diffs the screen against what was last sent  *
+ *           and sends the changes as escape sequences in a single     *
+ *           write().  Keys are read raw from stdin.                   *
+ *                                                                     *
+ * With null and ansi, curses runs on /dev/null, only to keep the      *
+ * windows.                                                            */
+typedef enum render_backend {
+  render_curses,
+  render_null,
+  render_ansi,
+  num_render_backends
+} render_backend_t;
+
+extern const char *render_backend_name[num_render_backends];
+extern render_backend_t render_backend;
+
+/* Sets up curses and the terminal for the selected backend; *
+ * render_end() puts the terminal back.  Exits on error.     */
+void render_init();
+void render_end();
+
+/* Stand-ins for wrefresh() and wgetch(); w of NULL means stdscr.  Like *
+ * wgetch(), render_getch() refreshes w before waiting for a key.       */
+void render_refresh(WINDOW *w);
+int render_getch(WINDOW *w);
+
+/* curs_set(), for 0 and 1. */
+void render_cursor(int visible);
+
+#endif
@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ncurses.h>
+
+#include "replay.h"
+#include "curse.h"
+#include "character.h"
+#include "pokemon.h"
+#include "mapgen.h"
+#include "io.h"
+
+#define REPLAY_MAGIC   "P327"
+#define REPLAY_VERSION 3
+
+/* Entry tags.  Keys of 0x80 and up take two bytes, the first of which *
+ * is at most 0x80 | (REPLAY_KEY_MAX >> 8), below all of these.        */
+#define REPLAY_KEY_MAX 0x7cff
+#define REPLAY_ERR     0xfd
+#define REPLAY_INT     0xfe
+#define REPLAY_HASH    0xff
+
+replay_mode_t replay_mode;
+
+static FILE *replay_file;
+static const char *replay_path;
+static uint32_t replay_seed;
+static uint64_t replay_keys;
+
+static const char *phase_name[num_phases] = {
+  "load",
+  "world",
+  "play",
+  "mapgen",
+  "battle",
+  "idle",
+};
+
+static uint64_t phase_ns[num_phases];
+static uint64_t phase_since;
+static phase_t phase_cur = phase_idle;
+
+static void replay_put(uint64_t v, int bytes)
+{
+  int i;
+
+  for (i = 0; i < bytes; i++) {
+    fputc((v >> (8 * i)) & 0xff, replay_file);
+  }
+}
+
+static int replay_get(uint64_t *v, int bytes)
+{
+  int i, c;
+
+  for (*v = 0, i = 0; i < bytes; i++) {
+    if ((c = fgetc(replay_file)) == EOF) {
+      return 1;
+    }
+    *v |= (uint64_t) c << (8 * i);
+  }
+
+  return 0;
+}
+
+void replay_open(const char *path, replay_mode_t mode, uint32_t *seed)
+{
+  char magic[sizeof (REPLAY_MAGIC) - 1];
+  uint64_t v, backend;
+
+  if (!(replay_file = fopen(path, mode == replay_record ? "wb" : "rb"))) {
+    perror(path);
+    exit(1);
+  }
+  replay_path = path;
+  replay_mode = mode;
+
+  if (mode == replay_record) {
+    fwrite(REPLAY_MAGIC, 1, sizeof (magic), replay_file);
+    replay_put(REPLAY_VERSION, 1);
+    replay_put(*seed, 4);
+    replay_put(road_backend, 1);
+    fflush(replay_file);
+  } else {
+    if (fread(magic, 1, sizeof (magic), replay_file) != sizeof (magic) ||
+        memcmp(magic, REPLAY_MAGIC, sizeof (magic)) ||
+        replay_get(&v, 1) || v != REPLAY_VERSION ||
+        replay_get(&v, 4) ||
+        replay_get(&backend, 1) || backend >= num_road_backends) {
+      fprintf(stderr, "%s: not a replay log\n", path);
+      exit(1);
+    }
+    *seed = v;
+    road_backend = (road_backend_t) backend;
+  }
+  replay_seed = *seed;
+}
+
+/* The log ran out before the game did.  Nothing sensible can be fed *
+ * to whatever is waiting on a key, so report what we have and stop. */
+static void replay_truncated()
+{
+  io_reset_terminal();
+  phase_enter(phase_idle);
+  fprintf(stderr, "%s: log ends after %lu keys, before the game did\n",
+          replay_path, (unsigned long) replay_keys);
+  phase_report(stdout);
+  printf("state hash: %016lx (none recorded)\n",
+         (unsigned long) replay_state_hash());
+
+  exit(1);
+}
+
+int replay_key()
+{
+  int c;
+  uint64_t v;
+
+  if ((c = fgetc(replay_file)) == EOF || c == REPLAY_INT || c == REPLAY_HASH) {
+    replay_truncated();
+  }
+  replay_keys++;
+  if (c == REPLAY_ERR) {
+    return ERR;
+  }
+  if (c < 0x80) {
+    return c;
+  }
+  if (replay_get(&v, 1)) {
+    replay_truncated();
+  }
+
+  return ((c & 0x7f) << 8) | v;
+}
+
+void replay_record_key(int key)
+{
+  if (key == ERR || key < 0 || key > REPLAY_KEY_MAX) {
+    replay_put(REPLAY_ERR, 1);
+  } else if (key < 0x80) {
+    replay_put(key, 1);
+  } else {
+    replay_put(0x80 | (key >> 8), 1);
+    replay_put(key & 0xff, 1);
+  }
+  replay_keys++;
+  /* Keys come at typing speed; flushing each keeps the log good up to *
+   * the last key if the game dies.                                    */
+  fflush(replay_file);
+}
+
+int32_t replay_int()
+{
+  uint64_t v;
+
+  if (fgetc(replay_file) != REPLAY_INT || replay_get(&v, 4)) {
+    replay_truncated();
+  }
+
+  return (int32_t) v;
+}
+
+void replay_record_int(int32_t v)
+{
+  replay_put(REPLAY_INT, 1);
+  replay_put((uint32_t) v, 4);
+  fflush(replay_file);
+}
+
+int replay_close()
+{
+  uint64_t hash, recorded;
+  int c, bad;
+
+  hash = replay_state_hash();
+  bad = 0;
+
+  if (replay_mode == replay_record) {
+    replay_put(REPLAY_HASH, 1);
+    replay_put(hash, 8);
+    printf("recorded %lu keys to %s\n", (unsigned long) replay_keys,
+           replay_path);
+    printf("state hash: %016lx\n", (unsigned long) hash);
+  } else {
+    printf("replayed %lu keys from %s, seed %u\n",
+           (unsigned long) replay_keys, replay_path, replay_seed);
+    phase_report(stdout);
+    if ((c = fgetc(replay_file)) != REPLAY_HASH || replay_get(&recorded, 8)) {
+      printf("state hash: %016lx (none recorded)\n", (unsigned long) hash);
+    } else if (recorded == hash) {
+      printf("state hash: %016lx (matches recording)\n", (unsigned long) hash);
+    } else {
+      printf("state hash: %016lx (recording had %016lx)\n",
+             (unsigned long) hash, (unsigned long) recorded);
+      bad = 1;
+    }
+  }
+
+  fclose(replay_file);
+  replay_file = NULL;
+  replay_mode = replay_off;
+
+  return bad;
+}
+
+/* FNV-1a */
+static uint64_t hash_bytes(uint64_t h, const void *v, size_t n)
+{
+  const uint8_t *b = (const uint8_t *) v;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    h = (h ^ b[i]) * 0x100000001b3ULL;
+  }
+
+  return h;
+}
+
+#define hash_val(h, v) hash_bytes(h, &(v), sizeof (v))
+
+static uint64_t hash_pokemon(uint64_t h, pokemon *p)
+{
+  int i, v;
+
+  if (!p) {
+    return hash_bytes(h, "", 1);
+  }
+
+  h = hash_bytes(h, p->get_species(), strlen(p->get_species()) + 1);
+  h = hash_bytes(h, p->get_gender_string(), 1);
+  for (i = 0; i < 4; i++) {
+    h = hash_bytes(h, p->get_move(i), strlen(p->get_move(i)) + 1);
+  }
+  v = p->get_lvl();
+  h = hash_val(h, v);
+  v = p->get_chp();
+  h = hash_val(h, v);
+  v = p->get_hp();
+  h = hash_val(h, v);
+  v = p->get_atk();
+  h = hash_val(h, v);
+  v = p->get_def();
+  h = hash_val(h, v);
+  v = p->get_spatk();
+  h = hash_val(h, v);
+  v = p->get_spdef();
+  h = hash_val(h, v);
+  v = p->get_speed();
+  h = hash_val(h, v);
+  v = p->is_shiny();
+
+  return hash_val(h, v);
+}
+
+static uint64_t hash_character(uint64_t h, character *c)
+{
+  int i;
+
+  h = hash_val(h, c->symbol);
+  h = hash_val(h, c->next_turn);
+  h = hash_val(h, c->seq_num);
+  h = hash_val(h, c->num_buddies);
+  for (i = 0; i < 6; i++) {
+    h = hash_pokemon(h, c->buddy[i]);
+  }
+
+  return h;
+}
+
+static uint64_t hash_npcs(uint64_t h, npc_store *s)
+{
+  uint32_t i;
+
+  for (i = 0; i < s->size(); i++) {
+    h = hash_val(h, s->pos[dim_x][i]);
+    h = hash_val(h, s->pos[dim_y][i]);
+    h = hash_val(h, s->dir[dim_x][i]);
+    h = hash_val(h, s->dir[dim_y][i]);
+    h = hash_val(h, s->ctype[i]);
+    h = hash_val(h, s->mtype[i]);
+    h = hash_val(h, s->seed[i]);
+    h = hash_val(h, s->defeated[i]);
+    h = hash_character(h, s->party[i]);
+  }
+
+  return h;
+}
+
+/* Everything a replay could get wrong: the world layout, every map *
+ * visited, everyone on them, and where the random stream is.       */
+uint64_t replay_state_hash()
+{
+  uint64_t h;
+  map *m;
+  int x, y, r;
+
+  h = 0xcbf29ce484222325ULL;
+  h = hash_val(h, world.wmap);
+  h = hash_val(h, world.cur_idx);
+  h = hash_val(h, world.char_seq_num);
+  h = hash_character(h, &world.pc);
+  h = hash_val(h, world.pc.pos);
+  h = hash_val(h, world.pc.bag);
+  for (y = 0; y < WORLD_SIZE; y++) {
+    for (x = 0; x < WORLD_SIZE; x++) {
+      if (!(m = world.world[y][x])) {
+        continue;
+      }
+      h = hash_val(h, y);
+      h = hash_val(h, x);
+      h = hash_val(h, m->map);
+      h = hash_val(h, m->height);
+      h = hash_val(h, m->geotype);
+      h = hash_val(h, m->num_trainers);
+      h = hash_npcs(h, &m->npcs);
+    }
+  }
+  r = rand();
+
+  return hash_val(h, r);
+}
+
+static uint64_t phase_now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+phase_t phase_enter(phase_t p)
+{
+  phase_t old;
+  uint64_t now;
+
+  now = phase_now();
+  old = phase_cur;
+  if (old != phase_idle) {
+    phase_ns[old] += now - phase_since;
+  }
+  phase_since = now;
+  phase_cur = p;
+
+  return old;
+}
+
+void phase_report(FILE *f)
+{
+  uint64_t total;
+  int i;
+
+  for (total = 0, i = 0; i < phase_idle; i++) {
+    fprintf(f, "%-8s %10.3f s\n", phase_name[i], phase_ns[i] / 1e9);
+    total += phase_ns[i];
+  }
+  fprintf(f, "%-8s %10.3f s\n", "total", total / 1e9);
+}
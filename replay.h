@@ -0,0 +1,56 @@
+#ifndef REPLAY_H
+# define REPLAY_H
+
+# include <stdio.h>
+# include <stdint.h>
+
+/* Input recording and replay.  When recording, the seed and every key  *
+ * the game reads are written to a log; a replay feeds the log back in  *
+ * place of the keyboard, with no delays, and should leave the world in *
+ * exactly the same state.  To check that, the recording ends with a    *
+ * hash of the final world state, which the replay compares against.   *
+ *                                                                      *
+ * The log is a header (magic, seed, road backend), then one entry per  *
+ * key: a byte for keys below 0x80, two for anything else.  Numbers     *
+ * typed at a prompt are entries of their own, and the state hash is    *
+ * the last entry.                                                      */
+typedef enum replay_mode {
+  replay_off,
+  replay_record,
+  replay_play,
+  num_replay_modes
+} replay_mode_t;
+
+extern replay_mode_t replay_mode;
+
+/* Records to or plays from path.  Recording writes *seed to the log; *
+ * playing reads it back into *seed.  Exits on error.                 */
+void replay_open(const char *path, replay_mode_t mode, uint32_t *seed);
+/* Finishes the log: a recording gets the state hash appended, and a *
+ * replay checks it.  Returns nonzero if a replay came out different. */
+int replay_close();
+
+int replay_key();
+void replay_record_key(int key);
+int32_t replay_int();
+void replay_record_int(int32_t v);
+
+uint64_t replay_state_hash();
+
+/* Wall time per phase.  phase_enter() charges the time since the last *
+ * switch to the phase being left and returns it, so a nested phase    *
+ * can hand time back with phase_enter(old).                           */
+typedef enum phase {
+  phase_load,   /* Reading the database */
+  phase_world,  /* Laying out the world */
+  phase_play,   /* Turns, less the two below */
+  phase_mapgen, /* Generating maps on first visit */
+  phase_battle, /* Battles and wild encounters */
+  phase_idle,   /* Not counted */
+  num_phases
+} phase_t;
+
+phase_t phase_enter(phase_t p);
+void phase_report(FILE *f);
+
+#endif
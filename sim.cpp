@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "sim.h"
+#include "curse.h"
+#include "character.h"
+#include "io.h"
+#include "pokemon.h"
+#include "path.h"
+#include "encounter.h"
+
+/* A battle between two pokemon that only know moves that never do *
+ * damage would go on forever; call it a loss after this many.     */
+#define SIM_MAX_ROUNDS 100
+
+/* One step in this many, the random controller wanders off course. */
+#define SIM_DETOUR     16
+
+/* Turns without getting closer to its gate before the random controller *
+ * gives up on it; a defeated trainer may be standing in the only way.   */
+#define SIM_PATIENCE   64
+
+/* Gates given up on before the random controller decides it is boxed in *
+ * and teleports, as a stuck player would with 'p'.                      */
+#define SIM_RETRIES    4
+
+sim_stats_t sim_stats;
+
+static sim_controller_t sim_controller;
+static const char *sim_keys;
+static uint32_t sim_next_key;
+static uint64_t sim_turns;
+
+/* The random controller heads for a gate picked at random, down a     *
+ * distance field built from the PC's move costs.  goal is the cell    *
+ * just inside the gate, and exit the direction from there through it. *
+ * It fights any trainer in its way and heals up at any pokemon center *
+ * it passes over.                                                     */
+static map *sim_map;
+static pair_t sim_goal;
+static uint32_t sim_exit;
+static uint8_t sim_cost[MAP_Y][MAP_X];
+static uint16_t sim_dist[MAP_Y][MAP_X];
+static uint16_t sim_closest;
+static uint32_t sim_stalled;
+static uint32_t sim_retries;
+
+void sim_init(const char *keys, uint64_t turns)
+{
+  sim_controller = keys ? sim_script : sim_random;
+  sim_keys = keys;
+  sim_next_key = 0;
+  sim_turns = turns;
+  sim_map = NULL;
+}
+
+/* Same bindings as io_handle_input(); anything else rests. */
+static uint32_t sim_key_dir(int key)
+{
+  switch (key) {
+  case '7':
+  case 'y':
+    return 7;
+  case '8':
+  case 'k':
+    return 8;
+  case '9':
+  case 'u':
+    return 9;
+  case '6':
+  case 'l':
+    return 6;
+  case '3':
+  case 'n':
+    return 3;
+  case '2':
+  case 'j':
+    return 2;
+  case '1':
+  case 'b':
+    return 1;
+  case '4':
+  case 'h':
+    return 4;
+  case 'Q':
+    world.quit = 1;
+    return 5;
+  default:
+    return 5;
+  }
+}
+
+/* Picks a gate the PC can reach and lays the field toward it.  Returns *
+ * zero if there is none.                                               */
+static int sim_choose_gate()
+{
+  map *m = world.cur_map;
+  int i, g;
+
+  sim_map = m;
+  sim_closest = DIST_INF;
+  sim_stalled = 0;
+  cost_grid(m, move_cost[char_pc], sim_cost);
+  for (i = 0, g = rand() & 0x3; i < 4; i++, g = (g + 1) & 0x3) {
+    switch (g) {
+    case 0:
+      if (m->n < 0) {
+        continue;
+      }
+      sim_goal[dim_x] = m->n;
+      sim_goal[dim_y] = 1;
+      sim_exit = 8;
+      break;
+    case 1:
+      if (m->s < 0) {
+        continue;
+      }
+      sim_goal[dim_x] = m->s;
+      sim_goal[dim_y] = MAP_Y - 2;
+      sim_exit = 2;
+      break;
+    case 2:
+      if (m->e < 0) {
+        continue;
+      }
+      sim_goal[dim_x] = MAP_X - 2;
+      sim_goal[dim_y] = m->e;
+      sim_exit = 6;
+      break;
+    case 3:
+      if (m->w < 0) {
+        continue;
+      }
+      sim_goal[dim_x] = 1;
+      sim_goal[dim_y] = m->w;
+      sim_exit = 4;
+      break;
+    }
+    dist_field(sim_cost, sim_goal, sim_dist);
+    if (sim_dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] != DIST_INF) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static int sim_hurt()
+{
+  int i;
+
+  for (i = 0; i < 6 && world.pc.buddy[i]; i++) {
+    if (world.pc.buddy[i]->get_chp() < world.pc.buddy[i]->get_hp()) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* all_dirs[] order, as keypad directions for move_pc_dir(). */
+static const uint32_t sim_dir_key[8] = { 7, 4, 1, 8, 2, 9, 6, 3 };
+
+static uint32_t sim_random_turn(pair_t dest)
+{
+  uint32_t best[8], d;
+  int i, j, n, base;
+
+  if (world.cur_map != sim_map) {
+    sim_retries = 0;
+  } else if (sim_stalled > SIM_PATIENCE && ++sim_retries > SIM_RETRIES) {
+    sim_retries = 0;
+    sim_closest = DIST_INF;
+    sim_stalled = 0;
+    return io_teleport_pc(dest);
+  }
+  if ((world.cur_map != sim_map || sim_stalled > SIM_PATIENCE) &&
+      !sim_choose_gate()) {
+    sim_map = NULL;
+    return move_pc_dir(sim_dir_key[rand() & 0x7], dest);
+  }
+
+  if (sim_dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] < sim_closest) {
+    sim_closest = sim_dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]];
+    sim_stalled = 0;
+  } else {
+    sim_stalled++;
+  }
+
+  if (world.pc.pos[dim_x] == sim_goal[dim_x] &&
+      world.pc.pos[dim_y] == sim_goal[dim_y]) {
+    return move_pc_dir(sim_exit, dest);
+  }
+
+  if (world.cur_map->map[world.pc.pos[dim_y]][world.pc.pos[dim_x]] ==
+      ter_center && sim_hurt()) {
+    return move_pc_dir('>', dest);
+  }
+
+  if (!(rand() % SIM_DETOUR)) {
+    return move_pc_dir(sim_dir_key[rand() & 0x7], dest);
+  }
+
+  /* Neighbors from nearest to farthest from the goal, ties in random *
+   * order; take the first one the PC can step to.                    */
+  base = rand() & 0x7;
+  for (n = 0, i = base; i < base + 8; i++) {
+    d = sim_dist[world.pc.pos[dim_y] + all_dirs[i & 0x7][dim_y]]
+                [world.pc.pos[dim_x] + all_dirs[i & 0x7][dim_x]];
+    if (d == DIST_INF) {
+      continue;
+    }
+    for (j = n++; j && sim_dist[world.pc.pos[dim_y] +
+                                all_dirs[best[j - 1]][dim_y]]
+                               [world.pc.pos[dim_x] +
+                                all_dirs[best[j - 1]][dim_x]] > d; j--) {
+      best[j] = best[j - 1];
+    }
+    best[j] = i & 0x7;
+  }
+  for (i = 0; i < n; i++) {
+    if (!move_pc_dir(sim_dir_key[best[i]], dest)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+void sim_pc_turn(pair_t dest)
+{
+  uint32_t dir;
+
+  if (++sim_stats.turns >= sim_turns) {
+    world.quit = 1;
+  }
+
+  if (sim_controller == sim_script) {
+    dir = sim_key_dir(sim_keys[sim_next_key++]);
+    if (!sim_keys[sim_next_key]) {
+      sim_next_key = 0;
+    }
+    if (dir != 5 && !move_pc_dir(dir, dest)) {
+      return;
+    }
+  } else if (!sim_random_turn(dest)) {
+    return;
+  }
+
+  /* Blocked, or resting. */
+  dest[dim_y] = world.pc.pos[dim_y];
+  dest[dim_x] = world.pc.pos[dim_x];
+}
+
+void sim_choose_starter()
+{
+  class pokemon *choice[3];
+
+  /* Rolls the same three as io_choose_starter() and takes the first. */
+  choice[0] = new class pokemon();
+  choice[1] = new class pokemon();
+  choice[2] = new class pokemon();
+
+  world.pc.buddy[0] = choice[0];
+  world.pc.num_buddies = 1;
+  delete choice[1];
+  delete choice[2];
+}
+
+/* Index of the first pokemon in a party that can still fight, or -1. */
+static int sim_standing(pokemon *const party[], int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++) {
+    if (party[i] && party[i]->get_chp() > 0) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+static int sim_choose_move(pokemon *p)
+{
+  int i;
+
+  for (i = 0; i < 4 && *p->get_move(i); i++)
+    ;
+
+  return i ? rand() % i : 0;
+}
+
+/* Fights it out between the PC's party and another.  Each round, both *
+ * lead pokemon pick a move at random; as in the battle menu, higher   *
+ * move priority goes first, then higher speed, then a coin toss.      *
+ * Returns nonzero if the PC wins.                                     */
+static int sim_fight(pokemon *const other[], int count)
+{
+  pokemon *a, *f;
+  int a_move, f_move;
+  int a_priority, f_priority;
+  int i, rounds;
+
+  for (rounds = 0; rounds < SIM_MAX_ROUNDS; rounds++) {
+    if ((i = sim_standing(world.pc.buddy, 6)) < 0) {
+      return 0;
+    }
+    a = world.pc.buddy[i];
+    if ((i = sim_standing(other, count)) < 0) {
+      return 1;
+    }
+    f = other[i];
+
+    a_move = sim_choose_move(a);
+    f_move = sim_choose_move(f);
+    a_priority = a->move_priority(a_move);
+    f_priority = f->move_priority(f_move);
+    if (a_priority == f_priority) {
+      a_priority = a->get_speed();
+      f_priority = f->get_speed();
+      if (a_priority == f_priority) {
+        (rand() % 2) ? f_priority++ : f_priority--;
+      }
+    }
+
+    if (f_priority > a_priority) {
+      f->attack(f_move, *a);
+      if (a->get_chp() > 0) {
+        a->attack(a_move, *f);
+      }
+    } else {
+      a->attack(a_move, *f);
+      if (f->get_chp() > 0) {
+        f->attack(f_move, *a);
+      }
+    }
+  }
+
+  return 0;
+}
+
+/* Leads with the first pokemon still standing, so the out-of-pokemon *
+ * check in io_battle() keeps working.  A PC with none left would be   *
+ * stuck for good behind every trainer it has lost to, so it blacks    *
+ * out instead and is patched up on the spot, as at a pokemon center.  */
+static void sim_recover()
+{
+  pokemon *out;
+  int i;
+
+  if ((i = sim_standing(world.pc.buddy, 6)) > 0) {
+    out = world.pc.buddy[0];
+    world.pc.buddy[0] = world.pc.buddy[i];
+    world.pc.buddy[i] = out;
+  } else if (i < 0) {
+    sim_stats.blackouts++;
+    for (i = 0; i < 6 && world.pc.buddy[i]; i++) {
+      world.pc.buddy[i]->heal(world.pc.buddy[i]->get_hp());
+    }
+  }
+}
+
+void sim_battle(npc *n)
+{
+  npc_store *s = &world.cur_map->npcs;
+
+  if (sim_standing(world.pc.buddy, 6) < 0) {
+    return;
+  }
+
+  sim_stats.battles++;
+  if (sim_fight(n->buddy, n->num_buddies)) {
+    sim_stats.won++;
+    s->defeated[n->id] = 1;
+    if (s->ctype[n->id] == char_hiker || s->ctype[n->id] == char_rival) {
+      s->mtype[n->id] = move_wander;
+    }
+  }
+  sim_recover();
+}
+
+void sim_encounter()
+{
+  pokemon *p;
+
+  p = encounter_next();
+
+  if (sim_standing(world.pc.buddy, 6) >= 0) {
+    sim_stats.encounters++;
+    sim_fight(&p, 1);
+    sim_recover();
+  }
+
+  delete p;
+}
+
+void sim_report(double seconds)
+{
+  dist_cache_stats_t cache;
+  uint32_t maps;
+  int x, y;
+
+  for (maps = 0, y = 0; y < WORLD_SIZE; y++) {
+    for (x = 0; x < WORLD_SIZE; x++) {
+      if (world.world[y][x]) {
+        maps++;
+      }
+    }
+  }
+
+  printf("turns: %lu\n", (unsigned long) sim_stats.turns);
+  printf("seconds: %.3f\n", seconds);
+  printf("turns/sec: %.0f\n", seconds > 0 ? sim_stats.turns / seconds : 0.0);
+  printf("maps generated: %u\n", maps);
+  printf("battles fought: %u (%u won)\n", sim_stats.battles, sim_stats.won);
+  printf("wild encounters: %u\n", sim_stats.encounters);
+  printf("blackouts: %u\n", sim_stats.blackouts);
+
+  dist_cache_stats(&cache);
+  printf("distance cache: %lu lookups, %lu hits (%.1f%%), "
+         "%lu evictions, %u entries, %u bytes\n",
+         (unsigned long) cache.lookups, (unsigned long) cache.hits,
+         cache.lookups ? 100.0 * cache.hits / cache.lookups : 0.0,
+         (unsigned long) cache.evictions, cache.entries, cache.bytes);
+}
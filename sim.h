@@ -0,0 +1,46 @@
+#ifndef SIM_H
+# define SIM_H
+
+# include <stdint.h>
+
+# include "pair.h"
+
+class npc;
+
+/* Headless simulation.  With world.headless set, io.cpp never touches  *
+ * the terminal: the PC's turns come from a controller here instead of *
+ * the keyboard, and battles and wild encounters are fought out        *
+ * automatically through pokemon::attack().  A PC whose whole party    *
+ * faints is healed on the spot, so long runs keep battling.           */
+typedef enum sim_controller {
+  /* Heads down a distance field for a gate picked at random, stepping *
+   * off course now and then, and heals at any Pokemon Center it       *
+   * crosses while hurt.  Stuck, it picks another gate; stuck on every *
+   * gate, it teleports.                                               */
+  sim_random,
+  sim_script, /* Replays a string of movement keys, over and over */
+  num_sim_controllers
+} sim_controller_t;
+
+typedef struct sim_stats {
+  uint64_t turns;      /* PC turns taken */
+  uint32_t battles;    /* Trainer battles fought */
+  uint32_t won;        /* ...of which the PC won */
+  uint32_t encounters; /* Wild pokemon fought */
+  uint32_t blackouts;  /* Times the PC's whole party fainted */
+} sim_stats_t;
+
+extern sim_stats_t sim_stats;
+
+# define SIM_DEFAULT_TURNS 100000
+
+/* keys selects the scripted controller when non-NULL.  The game ends *
+ * once the PC has taken turns turns.                                 */
+void sim_init(const char *keys, uint64_t turns);
+void sim_pc_turn(pair_t dest);
+void sim_choose_starter();
+void sim_battle(npc *n);
+void sim_encounter();
+void sim_report(double seconds);
+
+#endif
@@ -0,0 +1,387 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+
+#include "spec.h"
+#include "curse.h"
+#include "character.h"
+
+/* A move worked out ahead: what it was worked out from, then what was *
+ * decided.  The cells around the mover are all a move ever looks at   *
+ * on the board, and the PC and the distance maps' source are all it   *
+ * looks at of the PC.                                                 */
+typedef struct spec_move {
+  int16_t pos[num_dims], dir[num_dims];
+  unsigned seed;
+  movement_type_t mtype;
+  uint8_t defeated;
+  character *near[3][3];
+  pair_t pc, from;
+  int16_t dest[num_dims], new_dir[num_dims];
+  unsigned new_seed;
+  /* The same NPC's next move, or -1. */
+  int32_t next;
+} spec_move_t;
+
+/* The moves kept by the last speculation, on map m.  head[id] is NPC *
+ * id's first move not yet taken or passed over, and tail[id] its     *
+ * last.                                                              */
+static struct {
+  map *m;
+  std::vector<spec_move_t> move;
+  std::vector<int32_t> head, tail;
+} spec;
+
+/* What the worker may change, as spec_begin() found it, and the NPCs *
+ * it took off the turn queue, with their turns.                      */
+static struct {
+  std::vector<int16_t> pos[num_dims], dir[num_dims];
+  std::vector<unsigned> seed;
+  character *cmap[MAP_Y][MAP_X];
+  map_bits_t occupied;
+  pair_t from;
+  int pc_turn;
+  std::vector<character *> due;
+  std::vector<int> due_turn;
+} spec_saved;
+
+/* The worker's turn queue: the NPCs due before the PC, and the PC. */
+static turn_queue_t spec_turn;
+
+static pthread_t worker;
+static pthread_mutex_t spec_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t spec_changed = PTHREAD_COND_INITIALIZER;
+static int spec_running, spec_go, spec_busy, spec_quit;
+/* Asks the worker to stop after the turn in hand. */
+static std::atomic<int> spec_halt;
+/* Set while the worker plays turns, so spec_decide() knows. */
+static int spec_ahead;
+
+static int spec_near_pc(uint32_t id)
+{
+  const npc_store *s = &world.cur_map->npcs;
+
+  return (abs(s->pos[dim_x][id] - world.pc.pos[dim_x]) <= 1 &&
+          abs(s->pos[dim_y][id] - world.pc.pos[dim_y]) <= 1);
+}
+
+/* Starts a move for NPC id with what it is about to be worked out from. */
+static void spec_note(uint32_t id)
+{
+  const npc_store *s = &world.cur_map->npcs;
+  spec_move_t *e;
+  int32_t i;
+  int x, y;
+
+  i = spec.move.size();
+  spec.move.resize(i + 1);
+  e = &spec.move[i];
+
+  s->get_pos(id, e->pos);
+  s->get_dir(id, e->dir);
+  e->seed = s->seed[id];
+  e->mtype = s->mtype[id];
+  e->defeated = s->defeated[id];
+  for (y = 0; y < 3; y++) {
+    for (x = 0; x < 3; x++) {
+      e->near[y][x] = world.cur_map->cmap[e->pos[dim_y] + y - 1]
+                                         [e->pos[dim_x] + x - 1];
+    }
+  }
+  pairCpy(e->pc, world.pc.pos);
+  pairCpy(e->from, world.dist_from);
+
+  e->next = -1;
+  if (spec.tail[id] < 0) {
+    spec.head[id] = i;
+  } else {
+    spec.move[spec.tail[id]].next = i;
+  }
+  spec.tail[id] = i;
+}
+
+/* Finishes NPC id's last move with what was decided. */
+static void spec_keep(uint32_t id, const pair_t dest)
+{
+  const npc_store *s = &world.cur_map->npcs;
+  spec_move_t *e = &spec.move[spec.tail[id]];
+
+  e->dest[dim_x] = dest[dim_x];
+  e->dest[dim_y] = dest[dim_y];
+  s->get_dir(id, e->new_dir);
+  e->new_seed = s->seed[id];
+}
+
+/* Whether e was worked out from exactly what NPC id would decide from *
+ * now.  Hikers and rivals go by the distance maps, and swimmers by    *
+ * where the PC is; the others see the PC only on the board.           */
+static int spec_holds(uint32_t id, const spec_move_t *e)
+{
+  const npc_store *s = &world.cur_map->npcs;
+  int x, y;
+
+  if (s->pos[dim_x][id] != e->pos[dim_x] ||
+      s->pos[dim_y][id] != e->pos[dim_y] ||
+      s->dir[dim_x][id] != e->dir[dim_x] ||
+      s->dir[dim_y][id] != e->dir[dim_y] ||
+      s->seed[id] != e->seed || s->mtype[id] != e->mtype ||
+      s->defeated[id] != e->defeated) {
+    return 0;
+  }
+  for (y = 0; y < 3; y++) {
+    for (x = 0; x < 3; x++) {
+      if (world.cur_map->cmap[e->pos[dim_y] + y - 1]
+                             [e->pos[dim_x] + x - 1] != e->near[y][x]) {
+        return 0;
+      }
+    }
+  }
+
+  switch (s->mtype[id]) {
+  case move_hiker:
+  case move_rival:
+    return (world.dist_from[dim_x] == e->from[dim_x] &&
+            world.dist_from[dim_y] == e->from[dim_y]);
+  case move_swim:
+    return (world.pc.pos[dim_x] == e->pc[dim_x] &&
+            world.pc.pos[dim_y] == e->pc[dim_y]);
+  default:
+    return 1;
+  }
+}
+
+/* Takes NPC id's next speculated move into dest if it still holds. *
+ * Either way, that move is used up.                                */
+static int spec_take(uint32_t id, pair_t dest)
+{
+  npc_store *s = &world.cur_map->npcs;
+  const spec_move_t *e;
+  int32_t i;
+
+  if (id >= spec.head.size() || (i = spec.head[id]) < 0) {
+    return 0;
+  }
+  e = &spec.move[i];
+  spec.head[id] = e->next;
+  if (!spec_holds(id, e)) {
+    return 0;
+  }
+
+  dest[dim_x] = e->dest[dim_x];
+  dest[dim_y] = e->dest[dim_y];
+  s->set_dir(id, e->new_dir);
+  s->seed[id] = e->new_seed;
+
+  return 1;
+}
+
+static void spec_work_out(uint32_t n, const uint32_t id[], pair_t dest[])
+{
+  movement_type_t m = world.cur_map->npcs.mtype[id[0]];
+
+  if (is_batched(m)) {
+    move_batch(n, id, dest);
+  } else {
+    move_func[m](id[0], dest[0]);
+  }
+}
+
+int spec_decide(uint32_t n, const uint32_t id[], pair_t dest[])
+{
+  static std::vector<uint32_t> left, left_id;
+  static std::vector<int16_t> left_xy;
+  pair_t *left_dest;
+  uint32_t i;
+
+  if (spec_ahead) {
+    for (i = 0; i < n; i++) {
+      if (spec_near_pc(id[i])) {
+        return 0;
+      }
+    }
+    for (i = 0; i < n; i++) {
+      spec_note(id[i]);
+    }
+    spec_work_out(n, id, dest);
+    for (i = 0; i < n; i++) {
+      spec_keep(id[i], dest[i]);
+    }
+    return 1;
+  }
+
+  if (spec.m != world.cur_map || spec.move.empty()) {
+    spec_work_out(n, id, dest);
+    return 1;
+  }
+
+  left.clear();
+  left_id.clear();
+  for (i = 0; i < n; i++) {
+    if (!spec_take(id[i], dest[i])) {
+      left.push_back(i);
+      left_id.push_back(id[i]);
+    }
+  }
+  if (!left.empty()) {
+    left_xy.resize(left.size() * num_dims);
+    left_dest = (pair_t *) left_xy.data();
+    spec_work_out(left.size(), left_id.data(), left_dest);
+    for (i = 0; i < left.size(); i++) {
+      dest[left[i]][dim_x] = left_dest[i][dim_x];
+      dest[left[i]][dim_y] = left_dest[i][dim_y];
+    }
+  }
+
+  return 1;
+}
+
+/* Plays the turns on spec_turn up to the PC's, as the game would after *
+ * a PC turn spent standing still.                                       */
+static void spec_run()
+{
+  character *c;
+
+  spec_ahead = 1;
+  pathfind_invalidate();
+  while (!spec_halt.load(std::memory_order_relaxed) &&
+         !is_pc(c = spec_turn.pop()) && npc_turns(&spec_turn, (npc *) c))
+    ;
+  spec_ahead = 0;
+
+  /* Whatever the PC does, hikers and rivals will next go by these. */
+  if (!spec_halt.load(std::memory_order_relaxed)) {
+    pathfind_ensure(dist_hiker);
+    pathfind_ensure(dist_rival);
+  }
+}
+
+static void *spec_work(void *unused)
+{
+  pthread_mutex_lock(&spec_lock);
+  while (!spec_quit) {
+    if (!spec_go) {
+      pthread_cond_wait(&spec_changed, &spec_lock);
+      continue;
+    }
+    spec_go = 0;
+    spec_busy = 1;
+    pthread_mutex_unlock(&spec_lock);
+
+    spec_run();
+
+    pthread_mutex_lock(&spec_lock);
+    spec_busy = 0;
+    pthread_cond_broadcast(&spec_changed);
+  }
+  pthread_mutex_unlock(&spec_lock);
+
+  return unused;
+}
+
+void spec_start()
+{
+  spec_running = !pthread_create(&worker, NULL, spec_work, NULL);
+}
+
+void spec_stop()
+{
+  pthread_mutex_lock(&spec_lock);
+  spec_quit = 1;
+  pthread_cond_broadcast(&spec_changed);
+  pthread_mutex_unlock(&spec_lock);
+
+  if (spec_running) {
+    pthread_join(worker, NULL);
+    spec_running = 0;
+  }
+  spec.m = NULL;
+}
+
+void spec_begin()
+{
+  map *m = world.cur_map;
+  npc_store *s = &m->npcs;
+  character *c;
+  int d;
+
+  if (!spec_running) {
+    return;
+  }
+
+  spec.m = m;
+  spec.move.clear();
+  spec.head.assign(s->size(), -1);
+  spec.tail.assign(s->size(), -1);
+
+  for (d = 0; d < num_dims; d++) {
+    spec_saved.pos[d] = s->pos[d];
+    spec_saved.dir[d] = s->dir[d];
+  }
+  spec_saved.seed = s->seed;
+  memcpy(spec_saved.cmap, m->cmap, sizeof (spec_saved.cmap));
+  spec_saved.occupied = m->occupied;
+  pairCpy(spec_saved.from, world.dist_from);
+  spec_saved.pc_turn = world.pc.next_turn;
+
+  /* The PC's next turn, were it to stand still, is as far as we go. */
+  world.pc.next_turn += move_cost[char_pc][m->map[world.pc.pos[dim_y]]
+                                                 [world.pc.pos[dim_x]]];
+  spec_saved.due.clear();
+  spec_saved.due_turn.clear();
+  spec_turn.clear();
+  while ((c = m->turn.top()) && char_turn_less()(c, &world.pc)) {
+    m->turn.pop();
+    spec_saved.due.push_back(c);
+    spec_saved.due_turn.push_back(c->next_turn);
+    spec_turn.push(c);
+  }
+  spec_turn.push(&world.pc);
+
+  pthread_mutex_lock(&spec_lock);
+  spec_go = 1;
+  pthread_cond_broadcast(&spec_changed);
+  pthread_mutex_unlock(&spec_lock);
+}
+
+void spec_end()
+{
+  map *m = world.cur_map;
+  npc_store *s = &m->npcs;
+  uint32_t i;
+  int d;
+
+  if (!spec_running) {
+    return;
+  }
+
+  pthread_mutex_lock(&spec_lock);
+  spec_go = 0;
+  spec_halt.store(1, std::memory_order_relaxed);
+  while (spec_busy) {
+    pthread_cond_wait(&spec_changed, &spec_lock);
+  }
+  spec_halt.store(0, std::memory_order_relaxed);
+  pthread_mutex_unlock(&spec_lock);
+
+  for (d = 0; d < num_dims; d++) {
+    s->pos[d] = spec_saved.pos[d];
+    s->dir[d] = spec_saved.dir[d];
+  }
+  s->seed = spec_saved.seed;
+  memcpy(m->cmap, spec_saved.cmap, sizeof (m->cmap));
+  m->occupied = spec_saved.occupied;
+  world.pc.next_turn = spec_saved.pc_turn;
+
+  /* The worker's distance maps may be from where the PC is now. */
+  pairCpy(world.dist_from, spec_saved.from);
+  for (d = 0; d < num_dist_maps; d++) {
+    world.dist_valid[d] = 0;
+  }
+
+  for (i = 0; i < spec_saved.due.size(); i++) {
+    spec_saved.due[i]->next_turn = spec_saved.due_turn[i];
+    m->turn.push(spec_saved.due[i]);
+  }
+}
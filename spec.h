@@ -0,0 +1,48 @@
+#ifndef SPEC_H
+# define SPEC_H
+
+# include <stdint.h>
+
+# include "pair.h"
+
+/* Speculative NPC turns.  While the game waits on a key for the PC's    *
+ * turn, a worker thread plays out the NPC turns due before the PC's     *
+ * next one, as though the PC stood still, and keeps every move decided  *
+ * along the way together with everything the decision read: the        *
+ * mover's own row of the npc_store, the cells around it, and where the  *
+ * PC and the distance maps were.  The world is put back as it was as    *
+ * soon as the key comes in, so the key is handled exactly as ever.      *
+ *                                                                       *
+ * When those turns come up for real, a speculated move whose inputs all *
+ * still hold is taken as it stands and anything else is worked out     *
+ * afresh, so the game plays out the same with speculation as without.   *
+ * NPCs draw from random streams of their own, so a move worked out      *
+ * again never throws off anyone else's.  A PC who stands still, or     *
+ * walks away from the NPCs, leaves most moves holding; the distance     *
+ * maps that hikers and rivals need next are computed by the worker      *
+ * either way, since they follow the PC a turn behind.                  *
+ *                                                                       *
+ * The worker only runs between spec_begin() and spec_end(), while the   *
+ * game's thread waits on the keyboard and touches nothing else.  No    *
+ * turn that could start a battle is played ahead: speculation stops at  *
+ * the first NPC to come within reach of the PC.                         */
+
+/* Starts the worker; call with the world in place.  Until then, *
+ * spec_begin() and spec_end() do nothing.                       */
+void spec_start();
+void spec_stop();
+
+/* Call just before waiting on a key for the PC's turn, and as soon as *
+ * the key is in.  The PC must be off the turn queue, as it is during  *
+ * its own turn.                                                       */
+void spec_begin();
+void spec_end();
+
+/* Decides the moves of the NPCs id[0..n), which are one NPC or a batch *
+ * (see move_batch()), into dest, as move_func or move_batch() would,   *
+ * taking any speculated move that still holds.  Called on the worker,  *
+ * it keeps the moves instead, and returns zero, deciding nothing, if   *
+ * any of them is within reach of the PC.                               */
+int spec_decide(uint32_t n, const uint32_t id[], pair_t dest[]);
+
+#endif